@@ -18,6 +18,9 @@ static_assert(kMaxAllowedCounter < kSingleMessagePacketSeqBit, "bad");
 static_assert(kMaxAllowedCounter < kMessageRequiresAckSeqBit, "bad");
 
 constexpr auto kAckSerializedSize = sizeof(uint32_t) + sizeof(uint8_t);
+constexpr auto kAckListHeaderSize = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint8_t);
+constexpr auto kAckListDeltaSize = sizeof(uint16_t);
+constexpr auto kMaxAckListDeltas = 255;
 constexpr auto kNotAckedMessagesLimit = 64 * 1024;
 constexpr auto kMaxIncomingPacketSize = 128 * 1024; // don't try decrypting more
 constexpr auto kKeepIncomingCountersCount = 64;
@@ -30,9 +33,11 @@ constexpr auto kMaxSignalingPacketSize = 16 * 1024;
 
 constexpr auto kServiceCauseAcks = 1;
 constexpr auto kServiceCauseResend = 2;
+constexpr auto kServiceCauseFlush = 3;
 
 static constexpr uint8_t kAckId = uint8_t(-1);
 static constexpr uint8_t kEmptyId = uint8_t(-2);
+static constexpr uint8_t kAckListId = uint8_t(-3);
 
 void AppendSeq(rtc::CopyOnWriteBuffer &buffer, uint32_t seq) {
     const auto bytes = rtc::HostToNetwork32(seq);
@@ -81,6 +86,18 @@ _requestSendService(std::move(requestSendService)) {
     assert(_key.value != nullptr);
 }
 
+void EncryptedConnection::setDelayIntervals(const DelayIntervals &delayIntervals) {
+    _delayIntervals = delayIntervals;
+}
+
+void EncryptedConnection::setSendAckLists(bool sendAckLists) {
+    _sendAckLists = sendAckLists;
+}
+
+auto EncryptedConnection::getStats() const -> Stats {
+    return _stats;
+}
+
 absl::optional<rtc::CopyOnWriteBuffer> EncryptedConnection::encryptRawPacket(rtc::CopyOnWriteBuffer const &buffer) {
     auto seq = ++_counter;
 
@@ -163,16 +180,28 @@ auto EncryptedConnection::prepareForSending(const Message &message)
         return encryptPrepared(serialized);
     }
     const auto type = uint8_t(serialized.cdata()[4]);
+    if (_delayIntervals.messageFlushDelay > 0) {
+        // Let the next outgoing packet carry it, the flush timer sends it otherwise.
+        // Everything still queued goes along, so the order is kept.
+        RTC_LOG(LS_VERBOSE) << logHeader()
+            << "Coalesce SEND:type" << type << "#" << CounterFromSeq(seq);
+        for (auto &queued : _myNotYetAckedMessages) {
+            queued.lastSent = 0;
+        }
+        _myNotYetAckedMessages.push_back({ notYetAckedCopy, 0 });
+        requestFlush(_delayIntervals.messageFlushDelay);
+        return absl::nullopt;
+    }
     const auto sendEnqueued = !_myNotYetAckedMessages.empty();
     if (sendEnqueued) {
         // All requiring ack messages should always be sent in order within
         // one packet, starting with the least not-yet-acked one.
         // So if we still have those, we send an empty message with all
         // requiring ack messages that will fit in correct order.
-        RTC_LOG(LS_INFO) << logHeader()
+        RTC_LOG(LS_VERBOSE) << logHeader()
             << "Enqueue SEND:type" << type << "#" << CounterFromSeq(seq);
     } else {
-        RTC_LOG(LS_INFO) << logHeader()
+        RTC_LOG(LS_VERBOSE) << logHeader()
             << "Add SEND:type" << type << "#" << CounterFromSeq(seq);
         appendAdditionalMessages(serialized);
     }
@@ -192,6 +221,12 @@ auto EncryptedConnection::prepareForSendingService(int cause)
         _sendAcksTimerActive = false;
     } else if (cause == kServiceCauseResend) {
         _resendTimerActive = false;
+    } else if (cause == kServiceCauseFlush) {
+        _flushTimerActive = false;
+        if (!haveUnsentMessages()) {
+            _stats.avoidedServicePackets++;
+            return absl::nullopt;
+        }
     }
     if (!haveAdditionalMessages()) {
         return absl::nullopt;
@@ -205,17 +240,80 @@ auto EncryptedConnection::prepareForSendingService(int cause)
     auto serialized = SerializeEmptyMessageWithSeq(*seq);
     assert(enoughSpaceInPacket(serialized, 0));
 
-    RTC_LOG(LS_INFO) << logHeader()
+    RTC_LOG(LS_VERBOSE) << logHeader()
         << "SEND:empty#" << CounterFromSeq(*seq);
 
     appendAdditionalMessages(serialized);
+    _stats.servicePackets++;
     return encryptPrepared(serialized);
 }
 
+bool EncryptedConnection::canPrepareForSendingInPlace() const {
+    if (!_acksToSendSeqs.empty()) {
+        return false;
+    } else if (_myNotYetAckedMessages.empty()) {
+        return true;
+    }
+    // Messages still inside their resend delay would not be appended anyway.
+    const auto sent = _myNotYetAckedMessages.front().lastSent;
+    return sent && (sent + _delayIntervals.minDelayBeforeMessageResend > rtc::TimeMillis());
+}
+
+auto EncryptedConnection::prepareForSendingInPlace(
+    uint8_t messageId,
+    uint8_t *buffer,
+    size_t payloadSize)
+-> absl::optional<InPlacePacket> {
+    assert(_acksToSendSeqs.empty());
+
+    // Same layout as SerializeMessageWithSeq for a single message packet:
+    // seq, type and the payload without a length prefix.
+    const auto messageRequiresAck = false;
+    const auto singleMessagePacket = true;
+    const auto dataSize = 4 + 1 + payloadSize;
+    if (16 + dataSize > packetLimit()) {
+        return LogError("Too large packet: ", std::to_string(dataSize));
+    }
+    const auto seq = computeNextSeq(messageRequiresAck, singleMessagePacket);
+    if (!seq) {
+        return absl::nullopt;
+    }
+    const auto packet = buffer + kInPlaceHeadroom - 16 - 4 - 1;
+    WriteSeq(packet + 16, *seq);
+    packet[16 + 4] = messageId;
+
+    encryptInPlace(packet, dataSize);
+
+    auto result = InPlacePacket();
+    result.bytes = packet;
+    result.size = 16 + dataSize;
+    result.counter = CounterFromSeq(*seq);
+    return result;
+}
+
 bool EncryptedConnection::haveAdditionalMessages() const {
     return !_myNotYetAckedMessages.empty() || !_acksToSendSeqs.empty();
 }
 
+bool EncryptedConnection::haveUnsentMessages() const {
+    if (!_acksToSendSeqs.empty()) {
+        return true;
+    }
+    for (const auto &message : _myNotYetAckedMessages) {
+        if (!message.lastSent) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void EncryptedConnection::requestFlush(int delayMs) {
+    if (!_flushTimerActive) {
+        _flushTimerActive = true;
+        _requestSendService(delayMs, kServiceCauseFlush);
+    }
+}
+
 absl::optional<uint32_t> EncryptedConnection::computeNextSeq(
         bool messageRequiresAck,
         bool singleMessagePacket) {
@@ -246,17 +344,22 @@ bool EncryptedConnection::enoughSpaceInPacket(const rtc::CopyOnWriteBuffer &buff
 }
 
 void EncryptedConnection::appendAcksToSend(rtc::CopyOnWriteBuffer &buffer) {
+    if (_sendAckLists) {
+        appendAckListsToSend(buffer);
+        return;
+    }
     auto i = _acksToSendSeqs.begin();
     while ((i != _acksToSendSeqs.end())
         && enoughSpaceInPacket(
             buffer,
             kAckSerializedSize)) {
 
-        RTC_LOG(LS_INFO) << logHeader()
+        RTC_LOG(LS_VERBOSE) << logHeader()
             << "Add ACK#" << CounterFromSeq(*i);
 
         AppendSeq(buffer, *i);
         buffer.AppendData(&kAckId, 1);
+        _stats.acks++;
         ++i;
     }
     _acksToSendSeqs.erase(_acksToSendSeqs.begin(), i);
@@ -267,6 +370,75 @@ void EncryptedConnection::appendAcksToSend(rtc::CopyOnWriteBuffer &buffer) {
     }
 }
 
+void EncryptedConnection::appendAckListsToSend(rtc::CopyOnWriteBuffer &buffer) {
+    auto &list = _acksToSendSeqs;
+    std::sort(list.begin(), list.end(), [](uint32_t a, uint32_t b) {
+        return CounterFromSeq(a) < CounterFromSeq(b);
+    });
+
+    // Each list is the first seq, kAckListId, a delta count and the counter
+    // deltas. Only messages requiring ack are acked, so receivers restore
+    // the seq flags from the first one.
+    auto i = list.begin();
+    while ((i != list.end())
+        && enoughSpaceInPacket(buffer, kAckListHeaderSize)) {
+        AppendSeq(buffer, *i);
+        buffer.AppendData(&kAckListId, 1);
+        const auto countPosition = buffer.size();
+        auto count = uint8_t(0);
+        buffer.AppendData(&count, 1);
+
+        auto previous = CounterFromSeq(*i);
+        ++i;
+        while ((i != list.end())
+            && (count < kMaxAckListDeltas)
+            && enoughSpaceInPacket(buffer, kAckListDeltaSize)) {
+            const auto counter = CounterFromSeq(*i);
+            if (counter - previous > std::numeric_limits<uint16_t>::max()) {
+                break;
+            }
+            const auto bytes = rtc::HostToNetwork16(uint16_t(counter - previous));
+            buffer.AppendData(reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+            previous = counter;
+            ++count;
+            ++i;
+        }
+        buffer.MutableData()[countPosition] = count;
+
+        RTC_LOG(LS_VERBOSE) << logHeader()
+            << "Add ACK list till #" << previous << " (" << (count + 1) << " acks)";
+        _stats.acks += count + 1;
+        _stats.ackLists++;
+    }
+    list.erase(list.begin(), i);
+    for (const auto seq : list) {
+        RTC_LOG(LS_VERBOSE) << logHeader()
+            << "Skip ACK#" << CounterFromSeq(seq)
+            << " (no space, already: " << buffer.size() << ")";
+    }
+}
+
+bool EncryptedConnection::readAckList(rtc::ByteBufferReader &reader, uint32_t firstSeq) {
+    reader.Consume(1);
+
+    auto count = uint8_t(0);
+    if (!reader.ReadUInt8(&count) || reader.Length() < count * kAckListDeltaSize) {
+        return false;
+    }
+    ackMyMessage(firstSeq);
+    auto counter = CounterFromSeq(firstSeq);
+    for (auto i = 0; i != count; ++i) {
+        auto delta = uint16_t(0);
+        reader.ReadUInt16(&delta);
+        counter += delta;
+        ackMyMessage(counter | kMessageRequiresAckSeqBit);
+    }
+
+    // The peer understands lists, so answer with them as well.
+    _sendAckLists = true;
+    return true;
+}
+
 size_t EncryptedConnection::fullNotAckedLength() const {
     assert(_myNotYetAckedMessages.size() < kNotAckedMessagesLimit);
 
@@ -300,7 +472,7 @@ void EncryptedConnection::appendAdditionalMessages(rtc::CopyOnWriteBuffer &buffe
                 << " (wait " << (when - now) << "ms).";
             break;
         } else if (enoughSpaceInPacket(buffer, resending.data.size())) {
-            RTC_LOG(LS_INFO) << logHeader()
+            RTC_LOG(LS_VERBOSE) << logHeader()
                 << "Add RESEND:type" << type << "#" << counter;
             buffer.AppendData(resending.data);
             resending.lastSent = now;
@@ -324,6 +496,7 @@ auto EncryptedConnection::encryptPrepared(const rtc::CopyOnWriteBuffer &buffer)
     auto result = EncryptedPacket();
     result.counter = CounterFromSeq(ReadSeq(buffer.data()));
     result.bytes.resize(16 + buffer.size());
+    _stats.packets++;
 
     const auto x = (_key.isOutgoing ? 0 : 8) + (_type == Type::Signaling ? 128 : 0);
     const auto key = _key.value->data();
@@ -344,6 +517,27 @@ auto EncryptedConnection::encryptPrepared(const rtc::CopyOnWriteBuffer &buffer)
     return result;
 }
 
+void EncryptedConnection::encryptInPlace(uint8_t *packet, size_t dataSize) {
+    const auto x = (_key.isOutgoing ? 0 : 8) + (_type == Type::Signaling ? 128 : 0);
+    const auto key = _key.value->data();
+    const auto data = packet + 16;
+    _stats.packets++;
+
+    const auto msgKeyLarge = ConcatSHA256(
+        MemorySpan{ key + 88 + x, 32 },
+        MemorySpan{ data, dataSize });
+    const auto msgKey = packet;
+    memcpy(msgKey, msgKeyLarge.data() + 8, 16);
+
+    auto aesKeyIv = PrepareAesKeyIv(key, msgKey, x);
+
+    // CTR mode allows the output to overlap the input exactly.
+    AesProcessCtr(
+        MemorySpan{ data, dataSize },
+        data,
+        std::move(aesKeyIv));
+}
+
 bool EncryptedConnection::registerIncomingCounter(uint32_t incomingCounter) {
     auto &list = _largestIncomingCounters;
 
@@ -382,20 +576,22 @@ auto EncryptedConnection::handleIncomingPacket(const char *bytes, size_t size)
 
     auto aesKeyIv = PrepareAesKeyIv(key, msgKey, x);
 
-    auto decryptionBuffer = rtc::Buffer(dataSize);
+    // Media payloads are handed out as slices of this buffer, so it is the
+    // only allocation a received RTP packet needs.
+    auto decryptionBuffer = rtc::CopyOnWriteBuffer(dataSize);
     AesProcessCtr(
         MemorySpan{ encryptedData, dataSize },
-        decryptionBuffer.data(),
+        decryptionBuffer.MutableData(),
         std::move(aesKeyIv));
 
     const auto msgKeyLarge = ConcatSHA256(
         MemorySpan{ key + 88 + x, 32 },
-        MemorySpan{ decryptionBuffer.data(), decryptionBuffer.size() });
+        MemorySpan{ decryptionBuffer.cdata(), decryptionBuffer.size() });
     if (ConstTimeIsDifferent(msgKeyLarge.data() + 8, msgKey, 16)) {
         return LogError("Bad incoming data hash.");
     }
 
-    const auto incomingSeq = ReadSeq(decryptionBuffer.data());
+    const auto incomingSeq = ReadSeq(decryptionBuffer.cdata());
     const auto incomingCounter = CounterFromSeq(incomingSeq);
     if (!registerIncomingCounter(incomingCounter)) {
         // We've received that packet already.
@@ -405,7 +601,7 @@ auto EncryptedConnection::handleIncomingPacket(const char *bytes, size_t size)
 }
 
 auto EncryptedConnection::processPacket(
-    const rtc::Buffer &fullBuffer,
+    const rtc::CopyOnWriteBuffer &fullBuffer,
     uint32_t packetSeq)
 -> absl::optional<DecryptedPacket> {
     assert(fullBuffer.size() >= 5);
@@ -417,7 +613,7 @@ auto EncryptedConnection::processPacket(
     auto currentSeq = packetSeq;
     auto currentCounter = CounterFromSeq(currentSeq);
     rtc::ByteBufferReader reader(
-        reinterpret_cast<const char*>(fullBuffer.data() + 4), // Skip seq.
+        reinterpret_cast<const char*>(fullBuffer.cdata() + 4), // Skip seq.
         fullBuffer.size() - 4);
 
     auto result = absl::optional<DecryptedPacket>();
@@ -432,7 +628,7 @@ auto EncryptedConnection::processPacket(
             if (additionalMessage) {
                 return LogError("Empty message should be only the first one in the packet.");
             }
-            RTC_LOG(LS_INFO) << logHeader()
+            RTC_LOG(LS_VERBOSE) << logHeader()
                 << "Got RECV:empty" << "#" << currentCounter;
             reader.Consume(1);
         } else if (type == kAckId) {
@@ -441,6 +637,21 @@ auto EncryptedConnection::processPacket(
             }
             ackMyMessage(currentSeq);
             reader.Consume(1);
+        } else if (type == kAckListId) {
+            if (!additionalMessage) {
+                return LogError("Ack list must not be the first one in the packet.");
+            } else if (!readAckList(reader, currentSeq)) {
+                return LogError("Bad ack list.");
+            }
+        } else if (singleMessagePacket
+            && !(currentSeq & kMessageRequiresAckSeqBit)
+            && (type == AudioDataMessage::kId || type == VideoDataMessage::kId)) {
+            // A single media message takes the rest of the packet, share it instead of copying.
+            auto payload = fullBuffer.Slice(4 + 1, reader.Length() - 1);
+            appendReceivedMessage(result, (type == AudioDataMessage::kId)
+                ? Message{ AudioDataMessage{ std::move(payload) } }
+                : Message{ VideoDataMessage{ std::move(payload) } }, currentSeq);
+            reader.Consume(reader.Length());
         } else if (auto message = DeserializeMessage(reader, singleMessagePacket)) {
             const auto messageRequiresAck = ((currentSeq & kMessageRequiresAckSeqBit) != 0);
             const auto skipMessage = messageRequiresAck
@@ -452,8 +663,13 @@ auto EncryptedConnection::processPacket(
                     newRequiringAckReceived = true;
                 }
                 sendAckPostponed(currentSeq);
-                RTC_LOG(LS_INFO) << logHeader()
-                    << (skipMessage ? "Repeated RECV:type" : "Got RECV:type") << type << "#" << currentCounter;
+                if (skipMessage) {
+                    RTC_LOG(LS_INFO) << logHeader()
+                        << "Repeated RECV:type" << type << "#" << currentCounter;
+                } else {
+                    RTC_LOG(LS_VERBOSE) << logHeader()
+                        << "Got RECV:type" << type << "#" << currentCounter;
+                }
             }
             if (!skipMessage) {
                 appendReceivedMessage(result, std::move(*message), currentSeq);
@@ -478,7 +694,11 @@ auto EncryptedConnection::processPacket(
 
     if (!_acksToSendSeqs.empty()) {
         if (newRequiringAckReceived) {
-            _requestSendService(0, 0);
+            if (_delayIntervals.ackFlushDelay > 0) {
+                requestFlush(_delayIntervals.ackFlushDelay);
+            } else {
+                _requestSendService(0, 0);
+            }
         } else if (!_sendAcksTimerActive) {
             _sendAcksTimerActive = true;
             _requestSendService(
@@ -538,17 +758,23 @@ void EncryptedConnection::sendAckPostponed(uint32_t incomingSeq) {
 void EncryptedConnection::ackMyMessage(uint32_t seq) {
     auto type = uint8_t(0);
     auto &list = _myNotYetAckedMessages;
-    for (auto i = list.begin(), e = list.end(); i != e; ++i) {
-        assert(i->data.size() >= 5);
-        if (ReadSeq(i->data.cdata()) == seq) {
-            type = uint8_t(i->data.cdata()[4]);
-            list.erase(i);
-            break;
-        }
+
+    // Messages are queued in the order their counters were assigned.
+    const auto i = std::lower_bound(list.begin(), list.end(), CounterFromSeq(seq), [](const MessageForResend &message, uint32_t counter) {
+        assert(message.data.size() >= 5);
+        return CounterFromSeq(ReadSeq(message.data.cdata())) < counter;
+    });
+    if (i != list.end() && ReadSeq(i->data.cdata()) == seq) {
+        type = uint8_t(i->data.cdata()[4]);
+        list.erase(i);
+    }
+    if (type) {
+        RTC_LOG(LS_VERBOSE) << logHeader()
+            << "Got ACK:type" << int(type) << "#" << CounterFromSeq(seq);
+    } else {
+        RTC_LOG(LS_INFO) << logHeader()
+            << "Repeated ACK#" << CounterFromSeq(seq);
     }
-    RTC_LOG(LS_INFO) << logHeader()
-        << (type ? "Got ACK:type" + std::to_string(type) + "#" : "Repeated ACK#")
-        << CounterFromSeq(seq);
 }
 
 auto EncryptedConnection::DelayIntervalsByType(Type type) -> DelayIntervals {
@@ -562,6 +788,11 @@ auto EncryptedConnection::DelayIntervalsByType(Type type) -> DelayIntervals {
     result.maxDelayBeforeMessageResend = signaling ? 5000 : 1000;
     result.maxDelayBeforeAckResend = signaling ? 5000 : 1000;
 
+    // Transport packets go out all the time, so acks and messages can wait a
+    // little for one instead of taking a packet of their own.
+    result.ackFlushDelay = signaling ? 0 : 20;
+    result.messageFlushDelay = signaling ? 0 : 20;
+
     return result;
 }
 
@@ -4,6 +4,8 @@
 #include "Instance.h"
 #include "Message.h"
 
+#include <deque>
+
 namespace rtc {
 class ByteBufferReader;
 } // namespace rtc
@@ -21,6 +23,34 @@ public:
         const EncryptionKey &key,
         std::function<void(int delayMs, int cause)> requestSendService);
 
+    struct DelayIntervals {
+        // In milliseconds.
+        int minDelayBeforeMessageResend = 0;
+        int maxDelayBeforeMessageResend = 0;
+        int maxDelayBeforeAckResend = 0;
+
+        // How long acks and new messages requiring ack may wait for an outgoing
+        // packet to ride along with before a dedicated one is sent.
+        int ackFlushDelay = 0;
+        int messageFlushDelay = 0;
+    };
+    void setDelayIntervals(const DelayIntervals &delayIntervals);
+
+    // Acks are packed as a base seq followed by counter deltas. Lists are always
+    // understood on receive, and sent once enabled here or seen from the peer.
+    // Only enable them for peers known to read them, ProtocolVersion::V2 and up.
+    void setSendAckLists(bool sendAckLists);
+
+    struct Stats {
+        int64_t packets = 0;
+        int64_t servicePackets = 0;
+        int64_t acks = 0;
+        int64_t ackLists = 0;
+        // Flush deadlines that passed with everything already piggybacked.
+        int64_t avoidedServicePackets = 0;
+    };
+    Stats getStats() const;
+
     struct EncryptedPacket {
         std::vector<uint8_t> bytes;
         uint32_t counter = 0;
@@ -28,6 +58,18 @@ public:
     absl::optional<EncryptedPacket> prepareForSending(const Message &message);
     absl::optional<EncryptedPacket> prepareForSendingService(int cause);
 
+    // Data messages can be encrypted right inside the caller's buffer when there
+    // are no acks or resends to append. The payload must start kInPlaceHeadroom
+    // bytes into the buffer, the msgKey and header are written in front of it.
+    static constexpr size_t kInPlaceHeadroom = 16 + 4 + 1;
+    struct InPlacePacket {
+        const uint8_t *bytes = nullptr;
+        size_t size = 0;
+        uint32_t counter = 0;
+    };
+    bool canPrepareForSendingInPlace() const;
+    absl::optional<InPlacePacket> prepareForSendingInPlace(uint8_t messageId, uint8_t *buffer, size_t payloadSize);
+
     struct DecryptedPacket {
         DecryptedMessage main;
         std::vector<DecryptedMessage> additional;
@@ -38,12 +80,6 @@ public:
     absl::optional<rtc::CopyOnWriteBuffer> decryptRawPacket(rtc::CopyOnWriteBuffer const &buffer);
 
 private:
-    struct DelayIntervals {
-        // In milliseconds.
-        int minDelayBeforeMessageResend = 0;
-        int maxDelayBeforeMessageResend = 0;
-        int maxDelayBeforeAckResend = 0;
-    };
     struct MessageForResend {
         rtc::CopyOnWriteBuffer data;
         int64_t lastSent = 0;
@@ -53,14 +89,19 @@ private:
     size_t packetLimit() const;
     size_t fullNotAckedLength() const;
     void appendAcksToSend(rtc::CopyOnWriteBuffer &buffer);
+    void appendAckListsToSend(rtc::CopyOnWriteBuffer &buffer);
+    bool readAckList(rtc::ByteBufferReader &reader, uint32_t firstSeq);
     void appendAdditionalMessages(rtc::CopyOnWriteBuffer &buffer);
     EncryptedPacket encryptPrepared(const rtc::CopyOnWriteBuffer &buffer);
+    void encryptInPlace(uint8_t *packet, size_t dataSize);
     bool registerIncomingCounter(uint32_t incomingCounter);
-    absl::optional<DecryptedPacket> processPacket(const rtc::Buffer &fullBuffer, uint32_t packetSeq);
+    absl::optional<DecryptedPacket> processPacket(const rtc::CopyOnWriteBuffer &fullBuffer, uint32_t packetSeq);
     bool registerSentAck(uint32_t counter, bool firstInPacket);
     void ackMyMessage(uint32_t counter);
     void sendAckPostponed(uint32_t incomingSeq);
     bool haveAdditionalMessages() const;
+    bool haveUnsentMessages() const;
+    void requestFlush(int delayMs);
     absl::optional<uint32_t> computeNextSeq(bool messageRequiresAck, bool singleMessagePacket);
     void appendReceivedMessage(
         absl::optional<DecryptedPacket> &to,
@@ -80,10 +121,13 @@ private:
     std::vector<uint32_t> _ackedIncomingCounters;
     std::vector<uint32_t> _acksToSendSeqs;
     std::vector<uint32_t> _acksSentCounters;
-    std::vector<MessageForResend> _myNotYetAckedMessages;
+    std::deque<MessageForResend> _myNotYetAckedMessages;
     std::function<void(int delayMs, int cause)> _requestSendService;
     bool _resendTimerActive = false;
     bool _sendAcksTimerActive = false;
+    bool _flushTimerActive = false;
+    bool _sendAckLists = false;
+    Stats _stats;
 
 };
 
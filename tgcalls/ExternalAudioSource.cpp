@@ -0,0 +1,144 @@
+#include "ExternalAudioSource.h"
+
+#include "common_audio/include/audio_util.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace tgcalls {
+
+namespace {
+
+constexpr size_t kMaxBufferedSamples = 2 * 48000;
+
+// How far the capture clock may drift from the wall clock before the
+// timestamps handed to sources are realigned.
+constexpr int64_t kMaxCaptureDriftUs = 100 * rtc::kNumMicrosecsPerMillisec;
+
+constexpr int64_t kChunkUs = 10 * rtc::kNumMicrosecsPerMillisec;
+
+} // namespace
+
+void BufferedExternalAudioSource::push(const int16_t *samples, size_t count) {
+    webrtc::MutexLock lock(&_mutex);
+    _samples.insert(_samples.end(), samples, samples + count);
+    if (_samples.size() > kMaxBufferedSamples) {
+        const auto dropped = _samples.size() - kMaxBufferedSamples;
+        _samples.erase(_samples.begin(), _samples.begin() + dropped);
+        if (!_isOverrun) {
+            _isOverrun = true;
+            RTC_LOG(LS_WARNING) << "External audio is pushed faster than it is sent, dropped " << dropped << " samples";
+        }
+    } else {
+        _isOverrun = false;
+    }
+}
+
+ExternalAudioSource::Format BufferedExternalAudioSource::format() {
+    return Format();
+}
+
+size_t BufferedExternalAudioSource::pull(void *samples, size_t frames, int64_t timestampUs) {
+    webrtc::MutexLock lock(&_mutex);
+    // Samples that are not a whole chunk yet wait for the rest.
+    if (_samples.size() < frames) {
+        return 0;
+    }
+    memcpy(samples, _samples.data(), frames * sizeof(int16_t));
+    _samples.erase(_samples.begin(), _samples.begin() + frames);
+    return frames;
+}
+
+void ExternalAudioPuller::setSource(std::shared_ptr<ExternalAudioSource> source) {
+    webrtc::MutexLock lock(&_mutex);
+    if (_source != source) {
+        _source = std::move(source);
+        _isSourceChanged = true;
+    }
+}
+
+bool ExternalAudioPuller::pull(float *samples, size_t count) {
+    std::shared_ptr<ExternalAudioSource> source;
+    bool isSourceChanged = false;
+    {
+        webrtc::MutexLock lock(&_mutex);
+        source = _source;
+        isSourceChanged = _isSourceChanged;
+        _isSourceChanged = false;
+    }
+    if (!source) {
+        return false;
+    }
+
+    const auto format = source->format();
+    if (format.sampleRate <= 0 || format.sampleRate % 100 != 0 || format.numChannels <= 0) {
+        return false;
+    }
+    const auto frames = (size_t)(format.sampleRate / 100);
+    const auto channels = (size_t)format.numChannels;
+    const auto timestampUs = nextTimestampUs(source.get(), format.sampleRate, isSourceChanged);
+
+    _floatSamples.resize(frames * channels);
+    size_t pulled = 0;
+    if (format.sampleFormat == ExternalAudioSource::SampleFormat::Int16) {
+        _int16Samples.resize(frames * channels);
+        pulled = std::min(source->pull(_int16Samples.data(), frames, timestampUs), frames);
+        webrtc::S16ToFloatS16(_int16Samples.data(), pulled * channels, _floatSamples.data());
+    } else {
+        pulled = std::min(source->pull(_floatSamples.data(), frames, timestampUs), frames);
+        webrtc::FloatToFloatS16(_floatSamples.data(), pulled * channels, _floatSamples.data());
+    }
+
+    if (pulled < frames) {
+        source->onUnderrun(timestampUs, frames - pulled);
+        if (pulled == 0 || !source->padsUnderruns()) {
+            // Nothing went out, the next pull lines up with the wall clock again.
+            _nextTimestampUs = 0;
+            return false;
+        }
+        std::fill(_floatSamples.begin() + pulled * channels, _floatSamples.end(), 0.0f);
+    }
+
+    if (channels > 1) {
+        // In place, frame i is never written before it has been read.
+        for (size_t i = 0; i < frames; i++) {
+            float sum = 0.0f;
+            for (size_t channel = 0; channel < channels; channel++) {
+                sum += _floatSamples[i * channels + channel];
+            }
+            _floatSamples[i] = sum / channels;
+        }
+    }
+
+    const auto outputRate = (int)count * 100;
+    if (format.sampleRate == outputRate) {
+        std::copy(_floatSamples.begin(), _floatSamples.begin() + count, samples);
+    } else {
+        _resampler.InitializeIfNeeded(format.sampleRate, outputRate, 1);
+        if (_resampler.Resample(_floatSamples.data(), frames, samples, count) != (int)count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int64_t ExternalAudioPuller::nextTimestampUs(ExternalAudioSource *source, int sampleRate, bool isSourceChanged) {
+    const auto nowUs = rtc::TimeMicros();
+    if (_nextTimestampUs == 0 || isSourceChanged) {
+        _nextTimestampUs = nowUs;
+    } else if (nowUs - _nextTimestampUs > kMaxCaptureDriftUs) {
+        const auto skippedFrames = (size_t)((nowUs - _nextTimestampUs) * sampleRate / rtc::kNumMicrosecsPerSec);
+        source->onOverrun(nowUs, skippedFrames);
+        _nextTimestampUs = nowUs;
+    } else if (_nextTimestampUs - nowUs > kMaxCaptureDriftUs) {
+        // The device captures faster than real time, nothing was skipped.
+        _nextTimestampUs = nowUs;
+    }
+    const auto timestampUs = _nextTimestampUs;
+    _nextTimestampUs += kChunkUs;
+    return timestampUs;
+}
+
+} // namespace tgcalls
@@ -0,0 +1,111 @@
+#ifndef TGCALLS_EXTERNAL_AUDIO_SOURCE_H
+#define TGCALLS_EXTERNAL_AUDIO_SOURCE_H
+
+#include "common_audio/resampler/include/push_resampler.h"
+#include "rtc_base/synchronization/mutex.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace tgcalls {
+
+// Audio the app sends into a call, pulled by the call whenever the audio device
+// needs the next 10 ms rather than pushed ahead of time.
+//
+// Everything but format changes is called on the audio capture thread, which
+// must not block. pull() gets the time, on the rtc::TimeMicros() clock, at
+// which its first frame is captured. Consecutive pulls are exactly 10 ms apart
+// unless capture stalled or the previous pull sent nothing, so a source can
+// line its own clock up with them and skip whatever it has queued for earlier
+// times.
+class ExternalAudioSource {
+public:
+    enum class SampleFormat {
+        Int16,
+        // Samples in [-1, 1].
+        Float
+    };
+
+    struct Format {
+        SampleFormat sampleFormat = SampleFormat::Int16;
+        // A multiple of 100, so that 10 ms is a whole number of frames.
+        int sampleRate = 48000;
+        int numChannels = 1;
+    };
+
+    virtual ~ExternalAudioSource() = default;
+
+    // Asked before every pull, may change between them.
+    virtual Format format() = 0;
+
+    // Writes up to `frames` interleaved frames to `samples`, which is int16_t or
+    // float according to format(), and returns how many it wrote.
+    virtual size_t pull(void *samples, size_t frames, int64_t timestampUs) = 0;
+
+    // Whether a short pull goes out padded with silence. Otherwise a pull must
+    // return all the frames or none: a short one sends nothing, and the audio
+    // device asks again shortly, so a source that is only a little late is not
+    // cut up by silence.
+    virtual bool padsUnderruns() {
+        return false;
+    }
+
+    // pull() returned fewer frames than asked for. With padsUnderruns() the rest
+    // went out as silence, otherwise nothing went out.
+    virtual void onUnderrun(int64_t timestampUs, size_t missingFrames) {
+    }
+
+    // Capture stalled and the next pull starts `skippedFrames` later than the
+    // previous one ended. A real-time producer has that much audio queued that
+    // will not be taken.
+    virtual void onOverrun(int64_t timestampUs, size_t skippedFrames) {
+    }
+};
+
+// The source behind addExternalAudioSamples(): 48 kHz mono samples pushed by the
+// app, of which the last two seconds are kept. Only whole 10 ms chunks are taken.
+class BufferedExternalAudioSource final : public ExternalAudioSource {
+public:
+    // Any thread.
+    void push(const int16_t *samples, size_t count);
+
+    Format format() override;
+    size_t pull(void *samples, size_t frames, int64_t timestampUs) override;
+
+private:
+    webrtc::Mutex _mutex;
+    std::vector<int16_t> _samples;
+    bool _isOverrun = false;
+};
+
+// Pulls an ExternalAudioSource for the call and turns what it returns into mono
+// FloatS16 samples at the rate the call captures at.
+class ExternalAudioPuller {
+public:
+    // Any thread.
+    void setSource(std::shared_ptr<ExternalAudioSource> source);
+
+    // Audio capture thread. Fills `count` samples, which are 10 ms at
+    // count * 100 Hz. Returns false, leaving `samples` as they were, when there
+    // is no source or it had nothing to send. Callers pull on a real-time
+    // schedule, one chunk per 10 ms, sources that always have audio are not
+    // paced otherwise.
+    bool pull(float *samples, size_t count);
+
+private:
+    int64_t nextTimestampUs(ExternalAudioSource *source, int sampleRate, bool isSourceChanged);
+
+    webrtc::Mutex _mutex;
+    std::shared_ptr<ExternalAudioSource> _source;
+    bool _isSourceChanged = false;
+
+    int64_t _nextTimestampUs = 0;
+    std::vector<int16_t> _int16Samples;
+    std::vector<float> _floatSamples;
+    webrtc::PushResampler<float> _resampler;
+};
+
+} // namespace tgcalls
+
+#endif
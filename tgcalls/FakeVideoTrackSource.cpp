@@ -1,68 +1,49 @@
 #include "FakeVideoTrackSource.h"
 
 #include "api/video/i420_buffer.h"
+#include "common_video/include/video_frame_buffer_pool.h"
 #include "media/base/video_broadcaster.h"
 #include "pc/video_track_source.h"
+#include "rtc_base/time_utils.h"
 
 #include "libyuv.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <queue>
 #include <thread>
 
 namespace tgcalls {
 
-int WIDTH = 1280;
-int HEIGHT = 720;
+namespace {
 
-class ChessFrameSource : public FrameSource {
-public:
-  ChessFrameSource() {
-    int N = 100;
-    frames_.reserve(N);
-    for (int i = 0; i < N; i++) {
-      frames_.push_back(genFrame(i, N));
-    }
-  }
-  Info info() const override{
-    return Info{WIDTH, HEIGHT};
-  }
-//  webrtc::VideoFrame next_frame() override {
-//    i = (i + 1) % frames_.size();
-//    return frames_[i].frame;
-//  }
-  void next_frame_rgb0(char *buf, double *pts) override {
-    *pts = 0;
-    i = (i + 1) % frames_.size();
-    size_t size = WIDTH * HEIGHT * 4;
-    memcpy(buf, frames_[i].rbga.get(), size);
-  }
+constexpr size_t kMaxPooledBuffers = 8;
 
-private:
-  struct Frame {
-    webrtc::VideoFrame frame;
-    std::unique_ptr<std::uint8_t[]> rbga;
+std::vector<webrtc::VideoFrame> genChessFrames(int width, int height) {
+  int N = 100;
+  std::vector<webrtc::VideoFrame> frames;
+  frames.reserve(N);
+  auto bytes_ptr = std::make_unique<std::uint8_t[]>(width * height * 4);
+  auto bytes = bytes_ptr.get();
+  auto set_rgb = [&](int x, int y, std::uint8_t r, std::uint8_t g, std::uint8_t b) {
+    auto dest = bytes + (x * width + y) * 4;
+    dest[0] = r;
+    dest[1] = g;
+    dest[2] = b;
+    dest[3] = 0;
   };
-  std::vector<Frame> frames_;
-  size_t i = 0;
-  Frame genFrame(int i, int n) {
-    int width = WIDTH;
-    int height = HEIGHT;
-    auto bytes_ptr = std::make_unique<std::uint8_t[]>(width * height * 4);
-    auto bytes = bytes_ptr.get();
-    auto set_rgb = [&](int x, int y, std::uint8_t r, std::uint8_t g, std::uint8_t b) {
-      auto dest = bytes + (x * width + y) * 4;
-      dest[0] = r;
-      dest[1] = g;
-      dest[2] = b;
-      dest[3] = 0;
-    };
-    auto angle = (double)i / n * M_PI;
+  for (int frame_index = 0; frame_index < N; frame_index++) {
+    auto angle = (double)frame_index / N * M_PI;
     auto co = cos(angle);
     auto si = sin(angle);
 
     for (int i = 0; i < height; i++) {
       for (int j = 0; j < width; j++) {
-        double sx = (i - height / 2) * 20.0 / HEIGHT;
-        double sy = (j  - width / 2) * 20.0 / HEIGHT;
+        double sx = (i - height / 2) * 20.0 / height;
+        double sy = (j  - width / 2) * 20.0 / height;
 
         int x, y;
         if (sx * sx + sy * sy < 10) {
@@ -82,39 +63,103 @@ private:
     libyuv::RGBAToI420(bytes, width * 4, buffer->MutableDataY(), buffer->StrideY(), buffer->MutableDataU(),
                        buffer->StrideU(), buffer->MutableDataV(), buffer->StrideV(), width, height);
 
-    return Frame{webrtc::VideoFrame::Builder().set_video_frame_buffer(buffer).build(), std::move(bytes_ptr)};
+    frames.push_back(webrtc::VideoFrame::Builder().set_video_frame_buffer(buffer).build());
+  }
+  return frames;
+}
+
+// The animation is the same for every source of a given size, so it is rendered once and shared.
+std::shared_ptr<const std::vector<webrtc::VideoFrame>> sharedChessFrames(int width, int height) {
+  static std::mutex mutex;
+  static std::map<std::pair<int, int>, std::weak_ptr<const std::vector<webrtc::VideoFrame>>> cache;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &entry = cache[std::make_pair(width, height)];
+  auto result = entry.lock();
+  if (!result) {
+    result = std::make_shared<const std::vector<webrtc::VideoFrame>>(genChessFrames(width, height));
+    entry = result;
   }
+  return result;
+}
 
+}
+
+class ChessFrameSource : public I420FrameSource {
+public:
+  ChessFrameSource(int32_t width, int32_t height) : width_(width), height_(height), frames_(sharedChessFrames(width, height)) {
+  }
+  Info info() const override{
+    return Info{width_, height_};
+  }
+  // Frames are immutable once rendered, so they are handed out without copying.
+  webrtc::VideoFrame next_frame() override {
+    i = (i + 1) % frames_->size();
+    return (*frames_)[i];
+  }
+  void next_frame_i420(webrtc::I420Buffer &buffer, double *pts) override {
+    *pts = 0;
+    i = (i + 1) % frames_->size();
+    auto source = (*frames_)[i].video_frame_buffer()->GetI420();
+    libyuv::I420Copy(source->DataY(), source->StrideY(), source->DataU(), source->StrideU(), source->DataV(),
+                     source->StrideV(), buffer.MutableDataY(), buffer.StrideY(), buffer.MutableDataU(),
+                     buffer.StrideU(), buffer.MutableDataV(), buffer.StrideV(), width_, height_);
+  }
+
+private:
+  int32_t width_;
+  int32_t height_;
+  std::shared_ptr<const std::vector<webrtc::VideoFrame>> frames_;
+  size_t i = 0;
 };
 
+rtc::scoped_refptr<webrtc::I420Buffer> FrameSource::create_i420_buffer(int32_t width, int32_t height) {
+  if (!buffer_pool_) {
+    buffer_pool_ = std::make_shared<webrtc::VideoFrameBufferPool>(false, kMaxPooledBuffers);
+  }
+  auto buffer = buffer_pool_->CreateI420Buffer(width, height);
+  if (!buffer) {
+    // All pooled buffers are still held by the pipeline.
+    buffer = webrtc::I420Buffer::Create(width, height);
+  }
+  return buffer;
+}
+
 webrtc::VideoFrame FrameSource::next_frame() {
   auto info = this->info();
   auto height = info.height;
   auto width = info.width;
-  auto bytes_ptr = std::make_unique<std::uint8_t[]>(width * height * 4);
+  rgb0_.resize(width * height * 4);
   double pts;
-  next_frame_rgb0(reinterpret_cast<char *>(bytes_ptr.get()), &pts);
-  rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(width, height);
-  libyuv::ABGRToI420(bytes_ptr.get(), width * 4, buffer->MutableDataY(), buffer->StrideY(), buffer->MutableDataU(),
+  next_frame_rgb0(reinterpret_cast<char *>(rgb0_.data()), &pts);
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer = create_i420_buffer(width, height);
+  libyuv::ABGRToI420(rgb0_.data(), width * 4, buffer->MutableDataY(), buffer->StrideY(), buffer->MutableDataU(),
                      buffer->StrideU(), buffer->MutableDataV(), buffer->StrideV(), width, height);
   return webrtc::VideoFrame::Builder().set_timestamp_us(static_cast<int64_t>(pts * 1000000)).set_video_frame_buffer(buffer).build();
 }
 
+webrtc::VideoFrame I420FrameSource::next_frame() {
+  auto info = this->info();
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer = create_i420_buffer(info.width, info.height);
+  double pts = 0;
+  next_frame_i420(*buffer, &pts);
+  return webrtc::VideoFrame::Builder().set_timestamp_us(static_cast<int64_t>(pts * 1000000)).set_video_frame_buffer(buffer).build();
+}
+
+void I420FrameSource::next_frame_rgb0(char *buf, double *pt_in_seconds) {
+  auto info = this->info();
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer = create_i420_buffer(info.width, info.height);
+  next_frame_i420(*buffer, pt_in_seconds);
+  video_frame_to_rgb0(webrtc::VideoFrame::Builder().set_video_frame_buffer(buffer).build(), buf);
+}
+
 class FakeVideoSource : public rtc::VideoSourceInterface<webrtc::VideoFrame> {
  public:
-  FakeVideoSource(std::unique_ptr<FrameSource> source) {
+  FakeVideoSource(std::unique_ptr<FrameSource> source, int fps) {
     data_ = std::make_shared<Data>();
-    std::thread([data = data_, source = std::move(source)] {
-      std::uint32_t step = 0;
-      while (!data->flag_) {
-        step++;
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 30));
-        auto frame = source->next_frame();
-        frame.set_id(static_cast<std::uint16_t>(step));
-        frame.set_timestamp_us(rtc::TimeMicros());
-        data->broadcaster_.OnFrame(frame);
-      }
-    }).detach();
+    data_->source_ = std::move(source);
+    data_->interval_us_ = rtc::kNumMicrosecsPerSec / std::max(fps, 1);
+    FrameGenerator::shared().add(data_);
   }
   ~FakeVideoSource() {
     data_->flag_ = true;
@@ -133,19 +178,97 @@ class FakeVideoSource : public rtc::VideoSourceInterface<webrtc::VideoFrame> {
 
  private:
   struct Data {
-    std::atomic<bool> flag_;
+    std::atomic<bool> flag_{false};
     rtc::VideoBroadcaster broadcaster_;
+    std::unique_ptr<FrameSource> source_;
+    int64_t interval_us_ = 0;
+    std::uint32_t step_ = 0;
   };
+
+  // Single thread producing frames for every fake source. Each source keeps
+  // its own absolute schedule, so slow frames do not shift the following ones;
+  // frames that are already late by a whole interval are dropped instead of bursting.
+  class FrameGenerator {
+   public:
+    static FrameGenerator &shared() {
+      static auto generator = new FrameGenerator();
+      return *generator;
+    }
+
+    void add(std::weak_ptr<Data> data) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push(Entry{rtc::TimeMicros(), std::move(data)});
+      condition_.notify_one();
+    }
+
+   private:
+    struct Entry {
+      int64_t deadline_us;
+      std::weak_ptr<Data> data;
+
+      bool operator<(const Entry &other) const {
+        return deadline_us > other.deadline_us;
+      }
+    };
+
+    FrameGenerator() {
+      std::thread([this] {
+        loop();
+      }).detach();
+    }
+
+    void loop() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        if (queue_.empty()) {
+          condition_.wait(lock);
+          continue;
+        }
+        auto now = rtc::TimeMicros();
+        if (queue_.top().deadline_us > now) {
+          condition_.wait_for(lock, std::chrono::microseconds(queue_.top().deadline_us - now));
+          continue;
+        }
+        auto entry = queue_.top();
+        queue_.pop();
+
+        auto data = entry.data.lock();
+        if (!data || data->flag_) {
+          continue;
+        }
+
+        lock.unlock();
+        data->step_++;
+        auto frame = data->source_->next_frame();
+        frame.set_id(static_cast<std::uint16_t>(data->step_));
+        frame.set_timestamp_us(entry.deadline_us);
+        data->broadcaster_.OnFrame(frame);
+        lock.lock();
+
+        auto next_deadline_us = entry.deadline_us + data->interval_us_;
+        now = rtc::TimeMicros();
+        if (next_deadline_us <= now) {
+          next_deadline_us += ((now - next_deadline_us) / data->interval_us_ + 1) * data->interval_us_;
+        }
+        queue_.push(Entry{next_deadline_us, std::move(entry.data)});
+      }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::priority_queue<Entry> queue_;
+  };
+
   std::shared_ptr<Data> data_;
 };
 
 class FakeVideoTrackSourceImpl : public webrtc::VideoTrackSource {
  public:
-  static rtc::scoped_refptr<FakeVideoTrackSourceImpl> Create(std::unique_ptr<FrameSource> source) {
-    return rtc::scoped_refptr<FakeVideoTrackSourceImpl>(new rtc::RefCountedObject<FakeVideoTrackSourceImpl>(std::move(source)));
+  static rtc::scoped_refptr<FakeVideoTrackSourceImpl> Create(std::unique_ptr<FrameSource> source, int fps) {
+    return rtc::scoped_refptr<FakeVideoTrackSourceImpl>(new rtc::RefCountedObject<FakeVideoTrackSourceImpl>(std::move(source), fps));
   }
 
-  explicit FakeVideoTrackSourceImpl(std::unique_ptr<FrameSource> source) : VideoTrackSource(false), source_(std::move(source)) {
+  explicit FakeVideoTrackSourceImpl(std::unique_ptr<FrameSource> source, int fps) : VideoTrackSource(false), source_(std::move(source), fps) {
   }
 
  protected:
@@ -155,14 +278,14 @@ class FakeVideoTrackSourceImpl : public webrtc::VideoTrackSource {
   }
 };
 
-std::function<webrtc::VideoTrackSourceInterface*()> FakeVideoTrackSource::create(std::unique_ptr<FrameSource> frame_source) {
-  auto source = FakeVideoTrackSourceImpl::Create(std::move(frame_source));
+std::function<webrtc::VideoTrackSourceInterface*()> FakeVideoTrackSource::create(std::unique_ptr<FrameSource> frame_source, int fps) {
+  auto source = FakeVideoTrackSourceImpl::Create(std::move(frame_source), fps);
   return [source] {
     return source.get();
   };
 }
-std::unique_ptr<FrameSource> FrameSource::chess(){
-  return std::make_unique<ChessFrameSource>();
+std::unique_ptr<FrameSource> FrameSource::chess(int32_t width, int32_t height){
+  return std::make_unique<ChessFrameSource>(width, height);
 }
 
 void FrameSource::video_frame_to_rgb0(const webrtc::VideoFrame & src, char *dest){
@@ -2,10 +2,15 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
+
+#include "api/scoped_refptr.h"
 
 namespace webrtc {
 class VideoTrackSourceInterface;
 class VideoFrame;
+class I420Buffer;
+class VideoFrameBufferPool;
 }
 
 namespace tgcalls {
@@ -23,12 +28,29 @@ public:
   static void video_frame_to_rgb0(const webrtc::VideoFrame &src, char *dest);
   virtual void next_frame_rgb0(char *buf, double *pt_in_seconds) = 0;
 
-  static std::unique_ptr<FrameSource> chess();
+  static std::unique_ptr<FrameSource> chess(int32_t width = 1280, int32_t height = 720);
   static std::unique_ptr<FrameSource> from_file(std::string path);
+
+protected:
+  // Buffers are recycled once every consumer of the previous frames released them.
+  rtc::scoped_refptr<webrtc::I420Buffer> create_i420_buffer(int32_t width, int32_t height);
+
+private:
+  std::shared_ptr<webrtc::VideoFrameBufferPool> buffer_pool_;
+  std::vector<std::uint8_t> rgb0_;
+};
+
+// Source that renders straight into I420, skipping the RGB conversion of next_frame.
+class I420FrameSource : public FrameSource {
+public:
+  webrtc::VideoFrame next_frame() override;
+  void next_frame_rgb0(char *buf, double *pt_in_seconds) override;
+  virtual void next_frame_i420(webrtc::I420Buffer &buffer, double *pt_in_seconds) = 0;
 };
 
 class FakeVideoTrackSource {
  public:
-  static std::function<webrtc::VideoTrackSourceInterface*()> create(std::unique_ptr<FrameSource> source);
+  // Frames of all fake sources are produced on one shared thread, paced by absolute deadlines.
+  static std::function<webrtc::VideoTrackSourceInterface*()> create(std::unique_ptr<FrameSource> source, int fps = 30);
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,95 @@
+#include "IncomingPacketQueue.h"
+
+#include "rtc_base/thread.h"
+
+namespace tgcalls {
+
+IncomingPacketQueue::IncomingPacketQueue(rtc::Thread *consumerThread, size_t maxPending) :
+_consumerThread(consumerThread),
+_maxPending(maxPending) {
+    assert(_consumerThread != nullptr);
+}
+
+IncomingPacketQueue::~IncomingPacketQueue() {
+}
+
+void IncomingPacketQueue::push(bool isVideo, rtc::CopyOnWriteBuffer &&data) {
+    bool isDeliveryNeeded = false;
+    {
+        webrtc::MutexLock lock(&_mutex);
+        if (_maxPending != 0 && _pending.size() >= _maxPending) {
+            _droppedPackets++;
+            return;
+        }
+        isDeliveryNeeded = _pending.empty();
+        _pending.emplace_back();
+        _pending.back().isVideo = isVideo;
+        _pending.back().data = std::move(data);
+    }
+    if (isDeliveryNeeded) {
+        scheduleDelivery();
+    }
+}
+
+void IncomingPacketQueue::pushMessage(DecryptedMessage &&message) {
+    auto queuedMessage = std::make_unique<DecryptedMessage>(std::move(message));
+
+    bool isDeliveryNeeded = false;
+    {
+        // Never dropped, control messages are rare and must not get lost.
+        webrtc::MutexLock lock(&_mutex);
+        isDeliveryNeeded = _pending.empty();
+        _pending.emplace_back();
+        _pending.back().message = std::move(queuedMessage);
+    }
+    if (isDeliveryNeeded) {
+        scheduleDelivery();
+    }
+}
+
+void IncomingPacketQueue::scheduleDelivery() {
+    _consumerThread->PostTask(RTC_FROM_HERE, [weak = std::weak_ptr<IncomingPacketQueue>(shared_from_this())]() {
+        if (const auto strong = weak.lock()) {
+            strong->deliver();
+        }
+    });
+}
+
+void IncomingPacketQueue::setConsumer(std::function<void(std::vector<Packet> &)> consumer) {
+    assert(_consumerThread->IsCurrent());
+
+    _consumer = std::move(consumer);
+}
+
+IncomingPacketQueue::Stats IncomingPacketQueue::getStats() const {
+    assert(_consumerThread->IsCurrent());
+
+    return _stats;
+}
+
+void IncomingPacketQueue::deliver() {
+    assert(_consumerThread->IsCurrent());
+
+    {
+        webrtc::MutexLock lock(&_mutex);
+        _delivering.swap(_pending);
+        _stats.droppedPackets += _droppedPackets;
+        _droppedPackets = 0;
+    }
+    if (_delivering.empty()) {
+        return;
+    }
+
+    _stats.packets += (int64_t)_delivering.size();
+    _stats.batches++;
+    if ((int64_t)_delivering.size() > _stats.maxBatchSize) {
+        _stats.maxBatchSize = (int64_t)_delivering.size();
+    }
+
+    if (_consumer) {
+        _consumer(_delivering);
+    }
+    _delivering.clear();
+}
+
+} // namespace tgcalls
@@ -0,0 +1,80 @@
+#ifndef TGCALLS_INCOMING_PACKET_QUEUE_H
+#define TGCALLS_INCOMING_PACKET_QUEUE_H
+
+#include "rtc_base/copy_on_write_buffer.h"
+#include "rtc_base/synchronization/mutex.h"
+
+#include "Message.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace rtc {
+class Thread;
+} // namespace rtc
+
+namespace tgcalls {
+
+// Hands decrypted RTP/RTCP packets from the network thread straight to the
+// media thread. Packets that arrive while a delivery is pending join the same
+// batch, so the media thread gets one task per burst instead of one per packet.
+// With maxPending set, packets that arrive while that many are waiting are dropped.
+//
+// Control messages can be queued as well, so that the consumer sees them in
+// the order they arrived in relative to the media around them.
+//
+// Queuing does not allocate once the batch vectors have grown, but every
+// packet still owns the buffer it was decrypted into: WebRTC keeps delivered
+// packets alive, so those buffers cannot be recycled. A queued control message
+// takes one more allocation.
+class IncomingPacketQueue final : public std::enable_shared_from_this<IncomingPacketQueue> {
+public:
+    struct Packet {
+        bool isVideo = false;
+        rtc::CopyOnWriteBuffer data;
+        // Set instead of data for a control message.
+        std::unique_ptr<DecryptedMessage> message;
+    };
+
+    struct Stats {
+        int64_t packets = 0;
+        int64_t batches = 0;
+        int64_t maxBatchSize = 0;
+        int64_t droppedPackets = 0;
+    };
+
+    explicit IncomingPacketQueue(rtc::Thread *consumerThread, size_t maxPending = 0);
+    ~IncomingPacketQueue();
+
+    IncomingPacketQueue(const IncomingPacketQueue&) = delete;
+    IncomingPacketQueue& operator=(const IncomingPacketQueue&) = delete;
+
+    // Any thread.
+    void push(bool isVideo, rtc::CopyOnWriteBuffer &&data);
+    void pushMessage(DecryptedMessage &&message);
+
+    // Consumer thread only.
+    void setConsumer(std::function<void(std::vector<Packet> &)> consumer);
+    Stats getStats() const;
+
+private:
+    void scheduleDelivery();
+    void deliver();
+
+    rtc::Thread *_consumerThread = nullptr;
+    size_t _maxPending = 0;
+
+    webrtc::Mutex _mutex;
+    std::vector<Packet> _pending;
+    int64_t _droppedPackets = 0;
+
+    // Owned by the consumer thread, keeps its capacity between batches.
+    std::vector<Packet> _delivering;
+    std::function<void(std::vector<Packet> &)> _consumer;
+    Stats _stats;
+};
+
+} // namespace tgcalls
+
+#endif
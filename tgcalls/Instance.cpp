@@ -43,6 +43,8 @@ std::unique_ptr<Instance> Meta::Create(
 		descriptor.config.protocolVersion = ProtocolVersion::V0;
 	} else if (version == "3.0.0") {
 		descriptor.config.protocolVersion = ProtocolVersion::V1;
+	} else if (version == "3.0.1") {
+		descriptor.config.protocolVersion = ProtocolVersion::V2;
 	}
 
 	return (i != MetaMap().end())
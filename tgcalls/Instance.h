@@ -25,6 +25,8 @@ class TaskQueueFactory;
 namespace tgcalls {
 
 class VideoCaptureInterface;
+class MetricsRegistry;
+class ExternalAudioSource;
 
 struct FilePath {
 #ifndef _WIN32
@@ -71,7 +73,8 @@ struct Endpoint {
 
 enum class ProtocolVersion {
     V0,
-    V1 // Low-cost network negotiation
+    V1, // Low-cost network negotiation
+    V2 // Acks sent as lists in the transport
 };
 
 enum class NetworkType {
@@ -192,6 +195,9 @@ public:
 	virtual void setAudioOutputDuckingEnabled(bool enabled) = 0;
     virtual void addExternalAudioSamples(std::vector<uint8_t> &&samples) {
     }
+    // Replaces the pushed samples with a source the call pulls from, nullptr goes back to them.
+    virtual void setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source) {
+    }
 
     virtual void setIsLowBatteryLevel(bool isLowBatteryLevel) = 0;
 
@@ -200,6 +206,11 @@ public:
 	virtual int64_t getPreferredRelayId() = 0;
 	virtual TrafficStats getTrafficStats() = 0;
 	virtual PersistentState getPersistentState() = 0;
+	// Per-call counters and histograms, see Metrics.h. Snapshots are cheap to
+	// take from any thread.
+	virtual std::shared_ptr<MetricsRegistry> getMetrics() {
+		return nullptr;
+	}
 
 	virtual void receiveSignalingData(const std::vector<uint8_t> &data) = 0;
 	virtual void setVideoCapture(std::shared_ptr<VideoCaptureInterface> videoCapture) = 0;
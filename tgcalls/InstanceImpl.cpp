@@ -2,15 +2,19 @@
 
 #include "LogSinkImpl.h"
 #include "Manager.h"
+#include "Metrics.h"
+#include "ThreadInstrumentation.h"
 #include "MediaManager.h"
 #include "VideoCaptureInterfaceImpl.h"
 #include "VideoCapturerInterface.h"
 
+#include "rtc_base/null_socket_server.h"
+
 namespace tgcalls {
 namespace {
 
 rtc::Thread *makeManagerThread() {
-	static std::unique_ptr<rtc::Thread> value = rtc::Thread::Create();
+	static std::unique_ptr<rtc::Thread> value = std::make_unique<InstrumentedThread>(std::make_unique<rtc::NullSocketServer>());
 	value->SetName("WebRTC-Manager", nullptr);
 	value->Start();
 	return value.get();
@@ -25,15 +29,18 @@ rtc::Thread *getManagerThread() {
 } // namespace
 
 InstanceImpl::InstanceImpl(Descriptor &&descriptor)
-: _logSink(std::make_unique<LogSinkImpl>(descriptor.config.logPath)) {
+: _metrics(std::make_shared<MetricsRegistry>())
+, _logSink(std::make_unique<LogSinkImpl>(descriptor.config.logPath)) {
     rtc::LogMessage::LogToDebug(rtc::LS_INFO);
     rtc::LogMessage::SetLogToStderr(false);
 	rtc::LogMessage::AddLogToStream(_logSink.get(), rtc::LS_INFO);
 
+    ThreadInstrumentation::addQueueDepthMetrics(_metrics);
+
     auto networkType = descriptor.initialNetworkType;
 
-	_manager.reset(new ThreadLocalObject<Manager>(getManagerThread(), [descriptor = std::move(descriptor)]() mutable {
-		return new Manager(getManagerThread(), std::move(descriptor));
+	_manager.reset(new ThreadLocalObject<Manager>(getManagerThread(), [descriptor = std::move(descriptor), metrics = _metrics]() mutable {
+		return new Manager(getManagerThread(), std::move(descriptor), metrics);
 	}));
 	_manager->perform(RTC_FROM_HERE, [](Manager *manager) {
 		manager->start();
@@ -138,6 +145,12 @@ void InstanceImpl::addExternalAudioSamples(std::vector<uint8_t> &&samples) {
     });
 }
 
+void InstanceImpl::setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source) {
+    _manager->perform(RTC_FROM_HERE, [source](Manager *manager) {
+        manager->setExternalAudioSource(source);
+    });
+}
+
 void InstanceImpl::setIsLowBatteryLevel(bool isLowBatteryLevel) {
     _manager->perform(RTC_FROM_HERE, [isLowBatteryLevel](Manager *manager) {
         manager->setIsLowBatteryLevel(isLowBatteryLevel);
@@ -160,6 +173,10 @@ TrafficStats InstanceImpl::getTrafficStats() {
 	return TrafficStats{};  // TODO: not implemented
 }
 
+std::shared_ptr<MetricsRegistry> InstanceImpl::getMetrics() {
+	return _metrics;
+}
+
 PersistentState InstanceImpl::getPersistentState() {
 	return PersistentState{};  // we dont't have such information
 }
@@ -188,6 +205,7 @@ std::vector<std::string> InstanceImpl::GetVersions() {
     std::vector<std::string> result;
     result.push_back("2.7.7");
     result.push_back("3.0.0");
+    result.push_back("3.0.1");
     return result;
 }
 
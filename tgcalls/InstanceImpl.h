@@ -37,15 +37,18 @@ public:
 	void setOutputVolume(float level) override;
 	void setAudioOutputDuckingEnabled(bool enabled) override;
     void addExternalAudioSamples(std::vector<uint8_t> &&samples) override;
+    void setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source) override;
     void setIsLowBatteryLevel(bool isLowBatteryLevel) override;
 	std::string getLastError() override;
 	std::string getDebugInfo() override;
 	int64_t getPreferredRelayId() override;
 	TrafficStats getTrafficStats() override;
 	PersistentState getPersistentState() override;
+	std::shared_ptr<MetricsRegistry> getMetrics() override;
 	void stop(std::function<void(FinalState)> completion) override;
 
 private:
+	std::shared_ptr<MetricsRegistry> _metrics;
 	std::unique_ptr<ThreadLocalObject<Manager>> _manager;
 	std::unique_ptr<LogSinkImpl> _logSink;
 
@@ -2,70 +2,186 @@
 
 #include "Instance.h"
 
-#ifdef WEBRTC_WIN
-#include "windows.h"
-#include <ctime>
-#else // WEBRTC_WIN
-#include <sys/time.h>
-#endif // WEBRTC_WIN
+#include "rtc_base/time_utils.h"
+
+#include <stdio.h>
 
 namespace tgcalls {
 
-LogSinkImpl::LogSinkImpl(const FilePath &logPath) {
+LogSinkImpl::LogSinkImpl(const FilePath &logPath) :
+_ring(kRingSize),
+_writing(kRingSize) {
 	if (!logPath.data.empty()) {
 		_file.open(logPath.data);
 	}
+	_writer = std::thread([this] {
+		runWriter();
+	});
+}
+
+LogSinkImpl::~LogSinkImpl() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_pendingCondition.notify_all();
+	_writer.join();
 }
 
 void LogSinkImpl::OnLogMessage(const std::string &msg, rtc::LoggingSeverity severity, const char *tag) {
-	OnLogMessage(std::string(tag) + ": " + msg);
+	push(tag, msg);
 }
 
 void LogSinkImpl::OnLogMessage(const std::string &message, rtc::LoggingSeverity severity) {
-	OnLogMessage(message);
+	push(nullptr, message);
 }
 
 void LogSinkImpl::OnLogMessage(const std::string &message) {
-	time_t rawTime;
-	time(&rawTime);
-	struct tm timeinfo;
+	push(nullptr, message);
+}
 
-#ifdef WEBRTC_WIN
-	localtime_s(&timeinfo, &rawTime);
+std::string LogSinkImpl::result() {
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		const auto pushedCount = _pushedCount;
+		_writtenCondition.wait(lock, [&] {
+			return _writtenCount >= pushedCount;
+		});
+	}
 
-	FILETIME ft;
-	unsigned __int64 full = 0;
-	GetSystemTimeAsFileTime(&ft);
+	std::lock_guard<std::mutex> lock(_memoryMutex);
+	if (_truncatedBytes == 0) {
+		return _memory;
+	}
+	return "[" + std::to_string(_truncatedBytes) + " bytes of earlier log truncated]\n" + _memory;
+}
 
-	full |= ft.dwHighDateTime;
-	full <<= 32;
-	full |= ft.dwLowDateTime;
+void LogSinkImpl::push(const char *tag, const std::string &message) {
+	const auto timeUs = rtc::TimeUTCMicros();
 
-	const auto deltaEpochInMicrosecs = 11644473600000000Ui64;
-	full -= deltaEpochInMicrosecs;
-	full /= 10;
-	int32_t milliseconds = (long)(full % 1000000UL) / 1000;
-#else
-	timeval curTime = { 0 };
-	localtime_r(&rawTime, &timeinfo);
-	gettimeofday(&curTime, nullptr);
-	int32_t milliseconds = curTime.tv_usec / 1000;
-#endif
+	bool wakeWriter = false;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_ringCount == kRingSize) {
+			_droppedCount++;
+			return;
+		}
+		// Slots keep their capacity, so after warming up this is just a copy.
+		auto &entry = _ring[(_ringHead + _ringCount) % kRingSize];
+		entry.timeUs = timeUs;
+		if (tag) {
+			entry.text.assign(tag);
+			entry.text.append(": ");
+			entry.text.append(message);
+		} else {
+			entry.text.assign(message);
+		}
+		wakeWriter = (_ringCount == 0);
+		_ringCount++;
+		_pushedCount++;
+	}
+	if (wakeWriter) {
+		_pendingCondition.notify_one();
+	}
+}
 
-	auto &stream = _file.is_open() ? (std::ostream&)_file : _data;
-	stream
-		<< (timeinfo.tm_year + 1900)
-		<< "-" << (timeinfo.tm_mon + 1)
-		<< "-" << (timeinfo.tm_mday)
-		<< " " << timeinfo.tm_hour
-		<< ":" << timeinfo.tm_min
-		<< ":" << timeinfo.tm_sec
-		<< ":" << milliseconds
-		<< " " << message;
+void LogSinkImpl::runWriter() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true) {
+		_pendingCondition.wait(lock, [this] {
+			return _ringCount != 0 || _stopping;
+		});
+		if (_ringCount == 0) {
+			return;
+		}
+
+		// Swap the texts out so the ring gets back strings that already have capacity.
+		const auto count = _ringCount;
+		for (size_t i = 0; i < count; i++) {
+			auto &entry = _ring[(_ringHead + i) % kRingSize];
+			_writing[i].timeUs = entry.timeUs;
+			_writing[i].text.swap(entry.text);
+		}
+		_ringHead = (_ringHead + count) % kRingSize;
+		_ringCount = 0;
+		const auto droppedCount = _droppedCount;
+		_droppedCount = 0;
+
+		lock.unlock();
+		writeBatch(count, droppedCount);
+		lock.lock();
+
+		_writtenCount += count;
+		_writtenCondition.notify_all();
+	}
+}
+
+void LogSinkImpl::writeBatch(size_t count, int64_t droppedCount) {
+	_line.clear();
+	for (size_t i = 0; i < count; i++) {
+		appendTimestamp(_writing[i].timeUs);
+		_line.append(_writing[i].text);
+	}
+	if (droppedCount != 0) {
+		appendTimestamp(rtc::TimeUTCMicros());
+		_line.append("[" + std::to_string(droppedCount) + " log messages dropped]\n");
+	}
+
+	if (_file.is_open()) {
+		_file.write(_line.data(), _line.size());
+		_file.flush();
+	} else {
+		appendToMemory();
+	}
 
 #if DEBUG
-    printf("%d-%d-%d %d:%d:%d:%d %s\n", timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday, timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec, milliseconds, message.c_str());
+	fwrite(_line.data(), 1, _line.size(), stdout);
+#endif
+}
+
+void LogSinkImpl::appendTimestamp(int64_t timeUs) {
+	// Only the milliseconds change between most messages, so the calendar part
+	// is formatted once per second.
+	const auto second = (time_t)(timeUs / rtc::kNumMicrosecsPerSec);
+	if (second != _cachedSecond) {
+		struct tm timeinfo;
+#ifdef WEBRTC_WIN
+		localtime_s(&timeinfo, &second);
+#else
+		localtime_r(&second, &timeinfo);
 #endif
+
+		char buffer[64];
+		snprintf(buffer, sizeof(buffer), "%d-%d-%d %d:%d:%d:",
+			timeinfo.tm_year + 1900,
+			timeinfo.tm_mon + 1,
+			timeinfo.tm_mday,
+			timeinfo.tm_hour,
+			timeinfo.tm_min,
+			timeinfo.tm_sec);
+		_cachedPrefix = buffer;
+		_cachedSecond = second;
+	}
+
+	char milliseconds[16];
+	snprintf(milliseconds, sizeof(milliseconds), "%d ", (int)((timeUs % rtc::kNumMicrosecsPerSec) / rtc::kNumMicrosecsPerMillisec));
+	_line.append(_cachedPrefix);
+	_line.append(milliseconds);
+}
+
+void LogSinkImpl::appendToMemory() {
+	std::lock_guard<std::mutex> lock(_memoryMutex);
+	_memory.append(_line);
+	if (_memory.size() <= kMaxResultSize) {
+		return;
+	}
+
+	// Drop a quarter at once so the erase doesn't happen on every batch.
+	const auto keep = kMaxResultSize * 3 / 4;
+	const auto newline = _memory.find('\n', _memory.size() - keep);
+	const auto cut = (newline == std::string::npos) ? _memory.size() : newline + 1;
+	_memory.erase(0, cut);
+	_truncatedBytes += (int64_t)cut;
 }
 
 } // namespace tgcalls
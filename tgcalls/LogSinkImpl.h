@@ -2,27 +2,75 @@
 #define TGCALLS_LOG_SINK_IMPL_H
 
 #include "rtc_base/logging.h"
+
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
 
 namespace tgcalls {
 
 struct FilePath;
 
+// Logging threads only copy the message into a bounded ring, a background
+// writer formats the timestamps and does the file or memory writes. When the
+// ring is full new messages are dropped and counted instead of blocking.
 class LogSinkImpl final : public rtc::LogSink {
 public:
 	LogSinkImpl(const FilePath &logPath);
+	~LogSinkImpl();
 
 	void OnLogMessage(const std::string &msg, rtc::LoggingSeverity severity, const char *tag) override;
 	void OnLogMessage(const std::string &message, rtc::LoggingSeverity severity) override;
 	void OnLogMessage(const std::string &message) override;
 
-	std::string result() const {
-		return _data.str();
-	}
+	// Waits for the messages logged so far to be written. Only the most recent
+	// kMaxResultSize bytes are kept when logging to memory.
+	std::string result();
 
 private:
+	static constexpr size_t kRingSize = 4096;
+	static constexpr size_t kMaxResultSize = 4 * 1024 * 1024;
+
+	struct Entry {
+		int64_t timeUs = 0;
+		std::string text;
+	};
+
+	void push(const char *tag, const std::string &message);
+	void runWriter();
+	void writeBatch(size_t count, int64_t droppedCount);
+	void appendTimestamp(int64_t timeUs);
+	void appendToMemory();
+
 	std::ofstream _file;
-	std::ostringstream _data;
+
+	std::mutex _mutex;
+	std::condition_variable _pendingCondition;
+	std::condition_variable _writtenCondition;
+	std::vector<Entry> _ring;
+	size_t _ringHead = 0;
+	size_t _ringCount = 0;
+	int64_t _droppedCount = 0;
+	uint64_t _pushedCount = 0;
+	uint64_t _writtenCount = 0;
+	bool _stopping = false;
+
+	// Owned by the writer thread.
+	std::vector<Entry> _writing;
+	std::string _line;
+	time_t _cachedSecond = -1;
+	std::string _cachedPrefix;
+
+	std::mutex _memoryMutex;
+	std::string _memory;
+	int64_t _truncatedBytes = 0;
+
+	std::thread _writer;
 
 };
 
@@ -8,6 +8,26 @@
 namespace tgcalls {
 namespace {
 
+// Enough for a burst of full-size video packets while the network thread is busy.
+constexpr size_t kOutgoingPacketSlots = 256;
+
+// Whether MediaManager takes part in handling a received message.
+bool isMediaManagerMessage(const Message &message) {
+	const auto data = &message.data;
+	return !absl::holds_alternative<CandidatesListMessage>(*data)
+		&& !absl::holds_alternative<RemoteBatteryLevelIsLowMessage>(*data)
+		&& !absl::holds_alternative<RemoteNetworkStatusMessage>(*data);
+}
+
+// Media thread. The part of a received message that MediaManager handles.
+void receiveMediaManagerMessage(MediaManager *mediaManager, DecryptedMessage &&message) {
+	if (const auto remoteMediaState = absl::get_if<RemoteMediaStateMessage>(&message.message.data)) {
+		mediaManager->remoteVideoStateUpdated(remoteMediaState->video);
+	} else {
+		mediaManager->receiveMessage(std::move(message));
+	}
+}
+
 void dumpStatsLog(const FilePath &path, const CallStats &stats) {
 	if (path.data.empty()) {
 		return;
@@ -76,7 +96,7 @@ bool Manager::ResolvedNetworkStatus::operator!=(const ResolvedNetworkStatus &rhs
     return !(*this == rhs);
 }
 
-Manager::Manager(rtc::Thread *thread, Descriptor &&descriptor) :
+Manager::Manager(rtc::Thread *thread, Descriptor &&descriptor, std::shared_ptr<MetricsRegistry> metrics) :
 _thread(thread),
 _encryptionKey(descriptor.encryptionKey),
 _signaling(
@@ -100,6 +120,7 @@ _signalingDataEmitted(std::move(descriptor.signalingDataEmitted)),
 _signalBarsUpdated(std::move(descriptor.signalBarsUpdated)),
 _audioLevelUpdated(std::move(descriptor.audioLevelUpdated)),
 _createAudioDeviceModule(std::move(descriptor.createAudioDeviceModule)),
+_metrics(std::move(metrics)),
 _enableHighBitrateVideo(descriptor.config.enableHighBitrateVideo),
 _dataSaving(descriptor.config.dataSaving) {
 	assert(_thread->IsCurrent());
@@ -108,6 +129,8 @@ _dataSaving(descriptor.config.dataSaving) {
 
     _preferredCodecs = descriptor.config.preferredVideoCodecs;
 
+    _signaling.setSendAckLists(_protocolVersion == ProtocolVersion::V2);
+
 	_sendSignalingMessage = [=](const Message &message) {
 		if (const auto prepared = _signaling.prepareForSending(message)) {
 			_signalingDataEmitted(prepared->bytes);
@@ -155,13 +178,16 @@ void Manager::start() {
 			strong->_sendSignalingMessage(std::move(message));
 		});
 	};
-	_networkManager.reset(new ThreadLocalObject<NetworkManager>(StaticThreads::getNetworkThread(), [weak, thread, sendSignalingMessage, encryptionKey = _encryptionKey, enableP2P = _enableP2P, enableTCP = _enableTCP, enableStunMarking = _enableStunMarking, rtcServers = _rtcServers, proxy = std::move(_proxy)] () mutable {
+	const auto outgoingPackets = std::make_shared<OutgoingPacketQueue>(StaticThreads::getNetworkThread(), kOutgoingPacketSlots);
+	const auto incomingPackets = std::make_shared<IncomingPacketQueue>(StaticThreads::getMediaThread());
+	_networkManager.reset(new ThreadLocalObject<NetworkManager>(StaticThreads::getNetworkThread(), [weak, thread, sendSignalingMessage, outgoingPackets, incomingPackets, metrics = _metrics, encryptionKey = _encryptionKey, enableP2P = _enableP2P, enableTCP = _enableTCP, enableStunMarking = _enableStunMarking, protocolVersion = _protocolVersion, rtcServers = _rtcServers, proxy = std::move(_proxy)] () mutable {
 		return new NetworkManager(
             StaticThreads::getNetworkThread(),
 			encryptionKey,
 			enableP2P,
             enableTCP,
             enableStunMarking,
+            protocolVersion,
 			rtcServers,
             std::move(proxy),
 			[=](const NetworkManager::State &state) {
@@ -218,10 +244,13 @@ void Manager::start() {
 				} else {
 					thread->PostTask(RTC_FROM_HERE, task);
 				}
-			});
+			},
+			outgoingPackets,
+			incomingPackets,
+			metrics);
 	}));
 	bool isOutgoing = _encryptionKey.isOutgoing;
-	_mediaManager.reset(new ThreadLocalObject<MediaManager>(StaticThreads::getMediaThread(), [weak, isOutgoing, protocolVersion = _protocolVersion, thread, sendSignalingMessage, videoCapture = _videoCapture, mediaDevicesConfig = _mediaDevicesConfig, enableHighBitrateVideo = _enableHighBitrateVideo, signalBarsUpdated = _signalBarsUpdated, audioLevelUpdated = _audioLevelUpdated, preferredCodecs = _preferredCodecs, createAudioDeviceModule = _createAudioDeviceModule]() {
+	_mediaManager.reset(new ThreadLocalObject<MediaManager>(StaticThreads::getMediaThread(), [weak, isOutgoing, protocolVersion = _protocolVersion, thread, sendSignalingMessage, outgoingPackets, incomingPackets, metrics = _metrics, videoCapture = _videoCapture, mediaDevicesConfig = _mediaDevicesConfig, enableHighBitrateVideo = _enableHighBitrateVideo, signalBarsUpdated = _signalBarsUpdated, audioLevelUpdated = _audioLevelUpdated, preferredCodecs = _preferredCodecs, createAudioDeviceModule = _createAudioDeviceModule]() {
 		return new MediaManager(
             StaticThreads::getMediaThread(),
 			isOutgoing,
@@ -242,12 +271,28 @@ void Manager::start() {
             audioLevelUpdated,
 			createAudioDeviceModule,
 			enableHighBitrateVideo,
-            preferredCodecs);
+            preferredCodecs,
+            outgoingPackets,
+            incomingPackets,
+            metrics);
 	}));
     _networkManager->perform(RTC_FROM_HERE, [](NetworkManager *networkManager) {
         networkManager->start();
     });
-	_mediaManager->perform(RTC_FROM_HERE, [](MediaManager *mediaManager) {
+	_mediaManager->perform(RTC_FROM_HERE, [weak, thread](MediaManager *mediaManager) {
+		// Transport control messages reach the media thread through the incoming
+		// packet queue. MediaManager handles its part right there, so it sees
+		// them in order with the media, and the rest is done here.
+		mediaManager->setIncomingMessageReceived([weak, thread, mediaManager](DecryptedMessage &&message) {
+			if (isMediaManagerMessage(message.message)) {
+				receiveMediaManagerMessage(mediaManager, DecryptedMessage(message));
+			}
+			thread->PostTask(RTC_FROM_HERE, [weak, message = std::move(message)]() mutable {
+				if (const auto strong = weak.lock()) {
+					strong->handleMessage(std::move(message));
+				}
+			});
+		});
 		mediaManager->start();
 	});
 }
@@ -262,24 +307,26 @@ void Manager::receiveSignalingData(const std::vector<uint8_t> &data) {
 }
 
 void Manager::receiveMessage(DecryptedMessage &&message) {
+	if (isMediaManagerMessage(message.message)) {
+		_mediaManager->perform(RTC_FROM_HERE, [message = DecryptedMessage(message)](MediaManager *mediaManager) mutable {
+			receiveMediaManagerMessage(mediaManager, std::move(message));
+		});
+	}
+	handleMessage(std::move(message));
+}
+
+void Manager::handleMessage(DecryptedMessage &&message) {
 	const auto data = &message.message.data;
 	if (const auto candidatesList = absl::get_if<CandidatesListMessage>(data)) {
 		_networkManager->perform(RTC_FROM_HERE, [message = std::move(message)](NetworkManager *networkManager) mutable {
 			networkManager->receiveSignalingMessage(std::move(message));
 		});
-	} else if (const auto videoFormats = absl::get_if<VideoFormatsMessage>(data)) {
-		_mediaManager->perform(RTC_FROM_HERE, [message = std::move(message)](MediaManager *mediaManager) mutable {
-			mediaManager->receiveMessage(std::move(message));
-		});
-    } else if (const auto remoteMediaState = absl::get_if<RemoteMediaStateMessage>(data)) {
+	} else if (const auto remoteMediaState = absl::get_if<RemoteMediaStateMessage>(data)) {
 		if (_remoteMediaStateUpdated) {
 			_remoteMediaStateUpdated(
 				remoteMediaState->audio,
 				remoteMediaState->video);
 		}
-        _mediaManager->perform(RTC_FROM_HERE, [video = remoteMediaState->video](MediaManager *mediaManager) {
-            mediaManager->remoteVideoStateUpdated(video);
-        });
 	} else if (const auto remoteBatteryLevelIsLow = absl::get_if<RemoteBatteryLevelIsLowMessage>(data)) {
         if (_remoteBatteryLevelIsLowUpdated) {
 			_remoteBatteryLevelIsLowUpdated(remoteBatteryLevelIsLow->batteryLow);
@@ -288,16 +335,11 @@ void Manager::receiveMessage(DecryptedMessage &&message) {
         _remoteNetworkIsLowCost = remoteNetworkStatus->isLowCost;
         _remoteIsLowDataRequested = remoteNetworkStatus->isLowDataRequested;
         updateCurrentResolvedNetworkStatus();
-    } else {
-        if (const auto videoParameters = absl::get_if<VideoParametersMessage>(data)) {
-            float value = ((float)videoParameters->aspectRatio) / 1000.0;
-			if (_remotePrefferedAspectRatioUpdated) {
-				_remotePrefferedAspectRatioUpdated(value);
-			}
-        }
-		_mediaManager->perform(RTC_FROM_HERE, [=, message = std::move(message)](MediaManager *mediaManager) mutable {
-			mediaManager->receiveMessage(std::move(message));
-		});
+    } else if (const auto videoParameters = absl::get_if<VideoParametersMessage>(data)) {
+        float value = ((float)videoParameters->aspectRatio) / 1000.0;
+		if (_remotePrefferedAspectRatioUpdated) {
+			_remotePrefferedAspectRatioUpdated(value);
+		}
 	}
 }
 
@@ -399,6 +441,7 @@ void Manager::updateCurrentResolvedNetworkStatus() {
 
         switch (_protocolVersion) {
             case ProtocolVersion::V1:
+            case ProtocolVersion::V2:
                 if (_didConnectOnce) {
                     _sendTransportMessage({ RemoteNetworkStatusMessage{ localStatus.isLowCost, localStatus.isLowDataRequested } });
                 }
@@ -424,6 +467,7 @@ void Manager::sendInitialSignalingMessages() {
     if (_currentResolvedLocalNetworkStatus.has_value()) {
         switch (_protocolVersion) {
         case ProtocolVersion::V1:
+        case ProtocolVersion::V2:
             _sendTransportMessage({ RemoteNetworkStatusMessage{ _currentResolvedLocalNetworkStatus->isLowCost, _currentResolvedLocalNetworkStatus->isLowDataRequested } });
                 break;
             default:
@@ -462,4 +506,10 @@ void Manager::addExternalAudioSamples(std::vector<uint8_t> &&samples) {
     });
 }
 
+void Manager::setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source) {
+    _mediaManager->perform(RTC_FROM_HERE, [source](MediaManager *mediaManager) {
+        mediaManager->setExternalAudioSource(source);
+    });
+}
+
 } // namespace tgcalls
@@ -23,7 +23,7 @@ private:
 public:
 	static rtc::Thread *getMediaThread();
 
-	Manager(rtc::Thread *thread, Descriptor &&descriptor);
+	Manager(rtc::Thread *thread, Descriptor &&descriptor, std::shared_ptr<MetricsRegistry> metrics);
 	~Manager();
 
 	void start();
@@ -44,10 +44,13 @@ public:
 	void setOutputVolume(float level);
 
     void addExternalAudioSamples(std::vector<uint8_t> &&samples);
+    void setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source);
 
 private:
 	void sendSignalingAsync(int delayMs, int cause);
 	void receiveMessage(DecryptedMessage &&message);
+	// The part of a received message handled on this thread.
+	void handleMessage(DecryptedMessage &&message);
     void updateCurrentResolvedNetworkStatus();
     void sendInitialSignalingMessages();
 
@@ -75,6 +78,7 @@ private:
 	std::function<void(Message&&)> _sendTransportMessage;
 	std::unique_ptr<ThreadLocalObject<NetworkManager>> _networkManager;
 	std::unique_ptr<ThreadLocalObject<MediaManager>> _mediaManager;
+	std::shared_ptr<MetricsRegistry> _metrics;
 	State _state = State::Reconnecting;
     bool _didConnectOnce = false;
     bool _enableHighBitrateVideo = false;
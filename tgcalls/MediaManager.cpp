@@ -8,6 +8,10 @@
 #include "Message.h"
 #include "platform/PlatformInterface.h"
 #include "StaticThreads.h"
+#include "OutgoingPacketQueue.h"
+#include "IncomingPacketQueue.h"
+#include "Metrics.h"
+#include "ExternalAudioSource.h"
 
 #include "api/audio_codecs/audio_decoder_factory_template.h"
 #include "api/audio_codecs/audio_encoder_factory_template.h"
@@ -70,10 +74,9 @@ public:
 
 class AudioCapturePostProcessor : public webrtc::CustomProcessing {
 public:
-    AudioCapturePostProcessor(std::function<void(float)> updated, std::vector<float> *externalAudioSamples, webrtc::Mutex *externalAudioSamplesMutex) :
+    AudioCapturePostProcessor(std::function<void(float)> updated, std::shared_ptr<ExternalAudioPuller> externalAudio) :
     _updated(updated),
-    _externalAudioSamples(externalAudioSamples),
-    _externalAudioSamplesMutex(externalAudioSamplesMutex) {
+    _externalAudio(std::move(externalAudio)) {
     }
 
     virtual ~AudioCapturePostProcessor() {
@@ -117,23 +120,17 @@ private:
             _updated(level);
         }
 
-        _externalAudioSamplesMutex->Lock();
-        if (!_externalAudioSamples->empty()) {
+        _externalSamples.resize(buffer->num_frames());
+        if (_externalAudio->pull(_externalSamples.data(), _externalSamples.size())) {
             float *bufferData = buffer->channels()[0];
-            int takenSamples = 0;
-            for (int i = 0; i < _externalAudioSamples->size() && i < buffer->num_frames(); i++) {
-                float sample = (*_externalAudioSamples)[i];
+            for (size_t i = 0; i < _externalSamples.size(); i++) {
+                float sample = _externalSamples[i];
                 sample += bufferData[i];
                 sample = std::min(sample, 32768.f);
                 sample = std::max(sample, -32768.f);
                 bufferData[i] = sample;
-                takenSamples++;
-            }
-            if (takenSamples != 0) {
-                _externalAudioSamples->erase(_externalAudioSamples->begin(), _externalAudioSamples->begin() + takenSamples);
             }
         }
-        _externalAudioSamplesMutex->Unlock();
     }
 
     virtual std::string ToString() const override {
@@ -149,8 +146,8 @@ private:
     int32_t _peakCount = 0;
     float _peak = 0;
 
-    std::vector<float> *_externalAudioSamples = nullptr;
-    webrtc::Mutex *_externalAudioSamplesMutex = nullptr;
+    std::shared_ptr<ExternalAudioPuller> _externalAudio;
+    std::vector<float> _externalSamples;
 };
 
 } // namespace
@@ -245,12 +242,22 @@ MediaManager::MediaManager(
     std::function<void(float)> audioLevelUpdated,
     std::function<rtc::scoped_refptr<webrtc::AudioDeviceModule>(webrtc::TaskQueueFactory*)> createAudioDeviceModule,
     bool enableHighBitrateVideo,
-    std::vector<std::string> preferredCodecs) :
+    std::vector<std::string> preferredCodecs,
+    std::shared_ptr<OutgoingPacketQueue> outgoingPackets,
+    std::shared_ptr<IncomingPacketQueue> incomingPackets,
+    std::shared_ptr<MetricsRegistry> metrics) :
 _thread(thread),
 _eventLog(std::make_unique<webrtc::RtcEventLogNull>()),
 _taskQueueFactory(webrtc::CreateDefaultTaskQueueFactory()),
 _sendSignalingMessage(std::move(sendSignalingMessage)),
 _sendTransportMessage(std::move(sendTransportMessage)),
+_outgoingPackets(std::move(outgoingPackets)),
+_incomingPackets(std::move(incomingPackets)),
+_metrics(std::move(metrics)),
+_incomingQueueDepthMetric(_metrics->histogram("media.incoming_queue_depth")),
+_audioJitterBufferDelayMetric(_metrics->histogram("audio.jitter_buffer_delay_ms")),
+_videoJitterBufferDelayMetric(_metrics->histogram("video.jitter_buffer_delay_ms")),
+_videoDecodeTimeMetric(_metrics->histogram("video.decode_ms")),
 _signalBarsUpdated(std::move(signalBarsUpdated)),
 _audioLevelUpdated(std::move(audioLevelUpdated)),
 _createAudioDeviceModule(std::move(createAudioDeviceModule)),
@@ -264,6 +271,7 @@ _enableHighBitrateVideo(enableHighBitrateVideo) {
             rewriteFrameRotation = true;
             break;
         case ProtocolVersion::V1:
+        case ProtocolVersion::V2:
             rewriteFrameRotation = false;
             break;
         default:
@@ -309,13 +317,17 @@ _enableHighBitrateVideo(enableHighBitrateVideo) {
 		mediaDeps.video_decoder_factory->GetSupportedFormats(),
         preferredCodecs);
 
+    _bufferedExternalAudioSource = std::make_shared<BufferedExternalAudioSource>();
+    _externalAudioPuller = std::make_shared<ExternalAudioPuller>();
+    _externalAudioPuller->setSource(_bufferedExternalAudioSource);
+
     webrtc::AudioProcessingBuilder builder;
     std::unique_ptr<AudioCapturePostProcessor> audioProcessor = std::make_unique<AudioCapturePostProcessor>([this](float level) {
         this->_thread->PostTask(RTC_FROM_HERE, [this, level](){
             auto strong = this;
             strong->_currentMyAudioLevel = level;
         });
-    }, &_externalAudioSamples, &_externalAudioSamplesMutex);
+    }, _externalAudioPuller);
     builder.SetCapturePostProcessing(std::move(audioProcessor));
     mediaDeps.audio_processing = builder.Create();
 
@@ -437,6 +449,19 @@ void MediaManager::start() {
     }));
     _audioChannel->SetRawAudioSink(_ssrcAudio.incoming, std::move(incomingSink));
 
+    _incomingPackets->setConsumer([weak](std::vector<IncomingPacketQueue::Packet> &packets) {
+        if (const auto strong = weak.lock()) {
+            strong->_incomingQueueDepthMetric->record((int64_t)packets.size());
+            for (auto &packet : packets) {
+                if (!packet.message) {
+                    strong->deliverMediaPacket(packet.isVideo, packet.data);
+                } else if (strong->_incomingMessageReceived) {
+                    strong->_incomingMessageReceived(std::move(*packet.message));
+                }
+            }
+        }
+    });
+
     _sendSignalingMessage({ _myVideoFormats });
 
 	if (_videoCapture != nullptr) {
@@ -454,6 +479,12 @@ MediaManager::~MediaManager() {
 
     RTC_LOG(LS_INFO) << "MediaManager::~MediaManager()";
 
+    _incomingPackets->setConsumer(nullptr);
+
+    const auto incomingStats = _incomingPackets->getStats();
+    RTC_LOG(LS_INFO) << "Incoming packets: " << incomingStats.packets
+        << " in " << incomingStats.batches << " batches (max " << incomingStats.maxBatchSize << ")";
+
 	_call->SignalChannelNetworkState(webrtc::MediaType::AUDIO, webrtc::kNetworkDown);
 	_call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkDown);
 
@@ -586,6 +617,20 @@ void MediaManager::collectStats() {
 
     _bitrateRecords.push_back(CallStatsBitrateRecord { (int32_t)(rtc::TimeMillis() / 1000), stats.send_bandwidth_bps / 1000 });
 
+    cricket::VoiceMediaInfo voiceInfo;
+    if (_audioChannel->GetStats(&voiceInfo, false)) {
+        for (const auto &receiver : voiceInfo.receivers) {
+            _audioJitterBufferDelayMetric->record(receiver.jitter_buffer_ms);
+        }
+    }
+    cricket::VideoMediaInfo videoInfo;
+    if (computeIsReceivingVideo() && _videoChannel->GetStats(&videoInfo)) {
+        for (const auto &receiver : videoInfo.receivers) {
+            _videoJitterBufferDelayMetric->record(receiver.jitter_buffer_ms);
+            _videoDecodeTimeMetric->record(receiver.decode_ms);
+        }
+    }
+
     beginStatsTimer(2000);
 }
 
@@ -732,6 +777,7 @@ void MediaManager::configureSendingVideoIfNeeded() {
     videoSendParameters.extensions.emplace_back(webrtc::RtpExtension::kTransportSequenceNumberUri, 2);
     switch (_protocolVersion) {
         case ProtocolVersion::V1:
+        case ProtocolVersion::V2:
             videoSendParameters.extensions.emplace_back(webrtc::RtpExtension::kVideoRotationUri, 3);
             videoSendParameters.extensions.emplace_back(
                 webrtc::RtpExtension::kTimestampOffsetUri, 4);
@@ -860,6 +906,7 @@ void MediaManager::checkIsReceivingVideoChanged(bool wasReceiving) {
         videoRecvParameters.extensions.emplace_back(webrtc::RtpExtension::kTransportSequenceNumberUri, 2);
         switch (_protocolVersion) {
             case ProtocolVersion::V1:
+            case ProtocolVersion::V2:
                 videoRecvParameters.extensions.emplace_back(webrtc::RtpExtension::kVideoRotationUri, 3);
                 videoRecvParameters.extensions.emplace_back(
                     webrtc::RtpExtension::kTimestampOffsetUri, 4);
@@ -916,26 +963,9 @@ void MediaManager::receiveMessage(DecryptedMessage &&message) {
 	if (const auto formats = absl::get_if<VideoFormatsMessage>(data)) {
 		setPeerVideoFormats(std::move(*formats));
 	} else if (const auto audio = absl::get_if<AudioDataMessage>(data)) {
-        if (webrtc::IsRtcpPacket(audio->data)) {
-            RTC_LOG(LS_VERBOSE) << "Deliver audio RTCP";
-        }
-        if (webrtc::IsRtcpPacket(audio->data)) {
-            _call->Receiver()->DeliverPacket(webrtc::MediaType::ANY, audio->data, -1);
-        } else {
-            _call->Receiver()->DeliverPacket(webrtc::MediaType::AUDIO, audio->data, -1);
-        }
+        deliverMediaPacket(false, audio->data);
 	} else if (const auto video = absl::get_if<VideoDataMessage>(data)) {
-		if (_videoChannel) {
-			if (_readyToReceiveVideo) {
-                if (webrtc::IsRtcpPacket(video->data)) {
-                    _call->Receiver()->DeliverPacket(webrtc::MediaType::ANY, video->data, -1);
-                } else {
-                    _call->Receiver()->DeliverPacket(webrtc::MediaType::VIDEO, video->data, -1);
-                }
-			} else {
-				// maybe we need to queue packets for some time?
-			}
-		}
+        deliverMediaPacket(true, video->data);
     } else if (const auto videoParameters = absl::get_if<VideoParametersMessage>(data)) {
         float value = ((float)videoParameters->aspectRatio) / 1000.0;
         _preferredAspectRatio = value;
@@ -945,6 +975,31 @@ void MediaManager::receiveMessage(DecryptedMessage &&message) {
     }
 }
 
+void MediaManager::setIncomingMessageReceived(std::function<void(DecryptedMessage &&)> incomingMessageReceived) {
+    _incomingMessageReceived = std::move(incomingMessageReceived);
+}
+
+void MediaManager::deliverMediaPacket(bool isVideo, const rtc::CopyOnWriteBuffer &packet) {
+    if (!isVideo) {
+        if (webrtc::IsRtcpPacket(packet)) {
+            RTC_LOG(LS_VERBOSE) << "Deliver audio RTCP";
+            _call->Receiver()->DeliverPacket(webrtc::MediaType::ANY, packet, -1);
+        } else {
+            _call->Receiver()->DeliverPacket(webrtc::MediaType::AUDIO, packet, -1);
+        }
+    } else if (_videoChannel) {
+        if (_readyToReceiveVideo) {
+            if (webrtc::IsRtcpPacket(packet)) {
+                _call->Receiver()->DeliverPacket(webrtc::MediaType::ANY, packet, -1);
+            } else {
+                _call->Receiver()->DeliverPacket(webrtc::MediaType::VIDEO, packet, -1);
+            }
+        } else {
+            // maybe we need to queue packets for some time?
+        }
+    }
+}
+
 void MediaManager::remoteVideoStateUpdated(VideoState videoState) {
     switch (videoState) {
         case VideoState::Active:
@@ -1028,17 +1083,15 @@ void MediaManager::addExternalAudioSamples(std::vector<uint8_t> &&samples) {
     if (samples.size() % 2 != 0) {
         return;
     }
-    _externalAudioSamplesMutex.Lock();
-
-    size_t previousSize = _externalAudioSamples.size();
-    _externalAudioSamples.resize(_externalAudioSamples.size() + samples.size() / 2);
-    webrtc::S16ToFloatS16((const int16_t *)samples.data(), samples.size() / 2, _externalAudioSamples.data() + previousSize);
+    _bufferedExternalAudioSource->push((const int16_t *)samples.data(), samples.size() / 2);
+}
 
-    if (_externalAudioSamples.size() > 2 * 48000) {
-        _externalAudioSamples.erase(_externalAudioSamples.begin(), _externalAudioSamples.begin() + (_externalAudioSamples.size() - 2 * 48000));
+void MediaManager::setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source) {
+    if (source) {
+        _externalAudioPuller->setSource(std::move(source));
+    } else {
+        _externalAudioPuller->setSource(_bufferedExternalAudioSource);
     }
-
-    _externalAudioSamplesMutex.Unlock();
 }
 
 MediaManager::NetworkInterfaceImpl::NetworkInterfaceImpl(MediaManager *mediaManager, bool isVideo) :
@@ -1058,9 +1111,10 @@ bool MediaManager::NetworkInterfaceImpl::sendTransportMessage(rtc::CopyOnWriteBu
     if (_isVideo) {
         RTC_LOG(LS_VERBOSE) << "Send video packet";
     }
-	_mediaManager->_sendTransportMessage(_isVideo
-		? Message{ VideoDataMessage{ *packet } }
-		: Message{ AudioDataMessage{ *packet } });
+	if (!_mediaManager->_outgoingPackets->push(_isVideo, packet->cdata(), packet->size())) {
+		// All slots are waiting for the network thread, behave like a full socket buffer.
+		return false;
+	}
 	rtc::SentPacket sentPacket(options.packet_id, rtc::TimeMillis(), options.info_signaled_after_sent);
 	_mediaManager->notifyPacketSent(sentPacket);
 	return true;
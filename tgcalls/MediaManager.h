@@ -33,6 +33,12 @@ class VideoMediaChannel;
 namespace tgcalls {
 
 class VideoSinkInterfaceProxyImpl;
+class OutgoingPacketQueue;
+class IncomingPacketQueue;
+class MetricsRegistry;
+class MetricsHistogram;
+class BufferedExternalAudioSource;
+class ExternalAudioPuller;
 
 class MediaManager : public sigslot::has_slots<>, public std::enable_shared_from_this<MediaManager> {
 public:
@@ -50,7 +56,10 @@ public:
         std::function<void(float)> audioLevelUpdated,
 		std::function<rtc::scoped_refptr<webrtc::AudioDeviceModule>(webrtc::TaskQueueFactory*)> createAudioDeviceModule,
         bool enableHighBitrateVideo,
-        std::vector<std::string> preferredCodecs);
+        std::vector<std::string> preferredCodecs,
+        std::shared_ptr<OutgoingPacketQueue> outgoingPackets,
+        std::shared_ptr<IncomingPacketQueue> incomingPackets,
+        std::shared_ptr<MetricsRegistry> metrics);
 	~MediaManager();
 
 	void start();
@@ -63,6 +72,9 @@ public:
 	void setIncomingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink);
 	void receiveMessage(DecryptedMessage &&message);
     void remoteVideoStateUpdated(VideoState videoState);
+    // Control messages that arrive through the incoming packet queue, in order
+    // with the media around them. Set before start().
+    void setIncomingMessageReceived(std::function<void(DecryptedMessage &&)> incomingMessageReceived);
     void setNetworkParameters(bool isLowCost, bool isDataSavingActive);
     void fillCallStats(CallStats &callStats);
 
@@ -72,6 +84,7 @@ public:
 	void setOutputVolume(float level);
 
     void addExternalAudioSamples(std::vector<uint8_t> &&samples);
+    void setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source);
 
 private:
 	struct SSRC {
@@ -99,6 +112,7 @@ private:
 	friend class MediaManager::NetworkInterfaceImpl;
 
 	void setPeerVideoFormats(VideoFormatsMessage &&peerFormats);
+	void deliverMediaPacket(bool isVideo, const rtc::CopyOnWriteBuffer &packet);
 
 	bool computeIsSendingVideo() const;
     void configureSendingVideoIfNeeded();
@@ -128,6 +142,14 @@ private:
 
 	std::function<void(Message &&)> _sendSignalingMessage;
 	std::function<void(Message &&)> _sendTransportMessage;
+	std::shared_ptr<OutgoingPacketQueue> _outgoingPackets;
+	std::shared_ptr<IncomingPacketQueue> _incomingPackets;
+	std::function<void(DecryptedMessage &&)> _incomingMessageReceived;
+	std::shared_ptr<MetricsRegistry> _metrics;
+	MetricsHistogram *_incomingQueueDepthMetric = nullptr;
+	MetricsHistogram *_audioJitterBufferDelayMetric = nullptr;
+	MetricsHistogram *_videoJitterBufferDelayMetric = nullptr;
+	MetricsHistogram *_videoDecodeTimeMetric = nullptr;
     std::function<void(int)> _signalBarsUpdated;
     std::function<void(float)> _audioLevelUpdated;
 	std::function<rtc::scoped_refptr<webrtc::AudioDeviceModule>(webrtc::TaskQueueFactory*)> _createAudioDeviceModule;
@@ -175,8 +197,8 @@ private:
 
     std::vector<CallStatsBitrateRecord> _bitrateRecords;
 
-    std::vector<float> _externalAudioSamples;
-    webrtc::Mutex _externalAudioSamplesMutex;
+    std::shared_ptr<BufferedExternalAudioSource> _bufferedExternalAudioSource;
+    std::shared_ptr<ExternalAudioPuller> _externalAudioPuller;
 };
 
 } // namespace tgcalls
@@ -0,0 +1,140 @@
+#include "Metrics.h"
+
+#include "rtc_base/time_utils.h"
+
+#include <algorithm>
+
+namespace tgcalls {
+namespace {
+
+int FloorLog2(uint64_t value) {
+    auto result = 0;
+    for (auto shift = 32; shift > 0; shift >>= 1) {
+        if (value >> shift) {
+            value >>= shift;
+            result += shift;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+void MetricsHistogram::record(int64_t value) {
+    if (value < 0) {
+        value = 0;
+    }
+    _buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+
+    auto max = _max.load(std::memory_order_relaxed);
+    while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+MetricsHistogram::Summary MetricsHistogram::summary() const {
+    int64_t buckets[kBucketCount];
+    auto total = int64_t(0);
+    for (int i = 0; i < kBucketCount; i++) {
+        buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += buckets[i];
+    }
+
+    Summary result;
+    result.count = total;
+    result.sum = _sum.load(std::memory_order_relaxed);
+    result.max = _max.load(std::memory_order_relaxed);
+
+    // Percentiles are reported as the upper bound of their bucket, capped by
+    // the exact maximum.
+    auto seen = int64_t(0);
+    for (int i = 0; i < kBucketCount && total > 0; i++) {
+        if (!buckets[i]) {
+            continue;
+        }
+        seen += buckets[i];
+        const auto bound = std::min(BucketUpperBound(i), result.max);
+        if (!result.p50 && seen * 2 >= total) {
+            result.p50 = bound;
+        }
+        if (!result.p90 && seen * 10 >= total * 9) {
+            result.p90 = bound;
+        }
+        if (seen * 100 >= total * 99) {
+            result.p99 = bound;
+            break;
+        }
+    }
+
+    return result;
+}
+
+int MetricsHistogram::BucketIndex(int64_t value) {
+    if (value < kSubBucketCount) {
+        return (int)value;
+    }
+    const auto exponent = FloorLog2((uint64_t)value);
+    if (exponent >= kMaxExponent) {
+        return kBucketCount - 1;
+    }
+    const auto subBucket = (int)((value >> (exponent - kSubBucketBits)) & (kSubBucketCount - 1));
+    return (exponent - kSubBucketBits + 1) * kSubBucketCount + subBucket;
+}
+
+int64_t MetricsHistogram::BucketUpperBound(int index) {
+    if (index < kSubBucketCount) {
+        return index;
+    }
+    const auto exponent = index / kSubBucketCount + kSubBucketBits - 1;
+    const auto subBucket = index % kSubBucketCount;
+    return ((int64_t)(kSubBucketCount + subBucket + 1) << (exponent - kSubBucketBits)) - 1;
+}
+
+MetricsRegistry::MetricsRegistry() {
+}
+
+MetricsRegistry::~MetricsRegistry() {
+}
+
+MetricsCounter *MetricsRegistry::counter(std::string const &name) {
+    webrtc::MutexLock lock(&_mutex);
+    auto &result = _counters[name];
+    if (!result) {
+        result = std::make_unique<MetricsCounter>();
+    }
+    return result.get();
+}
+
+MetricsHistogram *MetricsRegistry::histogram(std::string const &name) {
+    webrtc::MutexLock lock(&_mutex);
+    auto &result = _histograms[name];
+    if (!result) {
+        result = std::make_unique<MetricsHistogram>();
+    }
+    return result.get();
+}
+
+MetricsSnapshot MetricsRegistry::snapshot() const {
+    MetricsSnapshot result;
+    result.timestampMs = rtc::TimeMillis();
+
+    webrtc::MutexLock lock(&_mutex);
+    result.counters.reserve(_counters.size());
+    for (const auto &it : _counters) {
+        MetricsSnapshot::Counter counter;
+        counter.name = it.first;
+        counter.value = it.second->value();
+        result.counters.push_back(std::move(counter));
+    }
+    result.histograms.reserve(_histograms.size());
+    for (const auto &it : _histograms) {
+        MetricsSnapshot::Histogram histogram;
+        histogram.name = it.first;
+        histogram.summary = it.second->summary();
+        result.histograms.push_back(std::move(histogram));
+    }
+    return result;
+}
+
+} // namespace tgcalls
@@ -0,0 +1,105 @@
+#ifndef TGCALLS_METRICS_H
+#define TGCALLS_METRICS_H
+
+#include "rtc_base/synchronization/mutex.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace tgcalls {
+
+class MetricsCounter {
+public:
+    // Any thread.
+    void add(int64_t value = 1) {
+        _value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    int64_t value() const {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> _value{ 0 };
+};
+
+// Log-linear buckets: exact below 8, then 8 buckets per power of two, so any
+// recorded value is reported within 12.5%. Values above 2^40 share the last bucket.
+class MetricsHistogram {
+public:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kSubBucketCount = 1 << kSubBucketBits;
+    static constexpr int kMaxExponent = 40;
+    static constexpr int kBucketCount = (kMaxExponent - kSubBucketBits + 1) * kSubBucketCount;
+
+    struct Summary {
+        int64_t count = 0;
+        int64_t sum = 0;
+        int64_t max = 0;
+        int64_t p50 = 0;
+        int64_t p90 = 0;
+        int64_t p99 = 0;
+    };
+
+    // Any thread, negative values are recorded as 0.
+    void record(int64_t value);
+
+    Summary summary() const;
+
+private:
+    static int BucketIndex(int64_t value);
+    static int64_t BucketUpperBound(int index);
+
+    std::atomic<int64_t> _buckets[kBucketCount] = {};
+    std::atomic<int64_t> _count{ 0 };
+    std::atomic<int64_t> _sum{ 0 };
+    std::atomic<int64_t> _max{ 0 };
+};
+
+struct MetricsSnapshot {
+    struct Counter {
+        std::string name;
+        int64_t value = 0;
+    };
+
+    struct Histogram {
+        std::string name;
+        MetricsHistogram::Summary summary;
+    };
+
+    int64_t timestampMs = 0;
+    std::vector<Counter> counters;
+    std::vector<Histogram> histograms;
+};
+
+// Per-call telemetry. Components look their metrics up once by name and keep
+// the pointers, which stay valid for the registry's lifetime; updates are
+// plain atomics. snapshot() only reads the atomics, so it is fine to poll
+// every second from any thread.
+class MetricsRegistry {
+public:
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    // Any thread. Returns the existing metric when the name is already registered.
+    MetricsCounter *counter(std::string const &name);
+    MetricsHistogram *histogram(std::string const &name);
+
+    MetricsSnapshot snapshot() const;
+
+private:
+    mutable webrtc::Mutex _mutex;
+    std::map<std::string, std::unique_ptr<MetricsCounter>> _counters;
+    std::map<std::string, std::unique_ptr<MetricsHistogram>> _histograms;
+};
+
+} // namespace tgcalls
+
+#endif
@@ -68,12 +68,16 @@ NetworkManager::NetworkManager(
 	bool enableP2P,
     bool enableTCP,
     bool enableStunMarking,
+    ProtocolVersion protocolVersion,
 	std::vector<RtcServer> const &rtcServers,
     std::unique_ptr<Proxy> proxy,
 	std::function<void(const NetworkManager::State &)> stateUpdated,
 	std::function<void(DecryptedMessage &&)> transportMessageReceived,
 	std::function<void(Message &&)> sendSignalingMessage,
-	std::function<void(int delayMs, int cause)> sendTransportServiceAsync) :
+	std::function<void(int delayMs, int cause)> sendTransportServiceAsync,
+	std::shared_ptr<OutgoingPacketQueue> outgoingPackets,
+	std::shared_ptr<IncomingPacketQueue> incomingPackets,
+	std::shared_ptr<MetricsRegistry> metrics) :
 _thread(thread),
 _enableP2P(enableP2P),
 _enableTCP(enableTCP),
@@ -88,9 +92,21 @@ _isOutgoing(encryptionKey.isOutgoing),
 _stateUpdated(std::move(stateUpdated)),
 _transportMessageReceived(std::move(transportMessageReceived)),
 _sendSignalingMessage(std::move(sendSignalingMessage)),
+_outgoingPackets(std::move(outgoingPackets)),
+_incomingPackets(std::move(incomingPackets)),
+_metrics(std::move(metrics)),
+_packetsSentMetric(_metrics->counter("network.packets_sent")),
+_packetsReceivedMetric(_metrics->counter("network.packets_received")),
+_heapBufferedPacketsMetric(_metrics->counter("network.heap_buffered_packets")),
+_encryptTimeMetric(_metrics->histogram("network.encrypt_us")),
+_decryptTimeMetric(_metrics->histogram("network.decrypt_us")),
+_outgoingQueueDepthMetric(_metrics->histogram("network.outgoing_queue_depth")),
 _localIceParameters(rtc::CreateRandomString(cricket::ICE_UFRAG_LENGTH), rtc::CreateRandomString(cricket::ICE_PWD_LENGTH)) {
 	assert(_thread->IsCurrent());
 
+	// Both sides of a V2 call read ack lists, older peers would drop the packets.
+	_transport.setSendAckLists(protocolVersion == ProtocolVersion::V2);
+
     _networkMonitorFactory = PlatformInterface::SharedInstance()->createNetworkMonitorFactory();
 }
 
@@ -99,6 +115,22 @@ NetworkManager::~NetworkManager() {
     
     RTC_LOG(LS_INFO) << "NetworkManager::~NetworkManager()";
 
+    const auto transportStats = _transport.getStats();
+    RTC_LOG(LS_INFO) << "Transport packets: " << transportStats.packets
+        << ", service only " << transportStats.servicePackets
+        << " (avoided " << transportStats.avoidedServicePackets << ")"
+        << ", acks " << transportStats.acks << " in " << transportStats.ackLists << " lists";
+
+    if (_outgoingPackets) {
+        _outgoingPackets->setConsumer(nullptr);
+
+        const auto stats = _outgoingPackets->getStats();
+        RTC_LOG(LS_INFO) << "Outgoing packets: sent " << stats.sentPackets
+            << " (" << stats.packetsPerSecond << "/s), dropped " << stats.droppedPackets
+            << ", batches " << stats.batches << " (max " << stats.maxBatchSize << ")"
+            << ", latency p50 " << stats.latencyP50Us << "us, p99 " << stats.latencyP99Us << "us";
+    }
+
 	_transportChannel.reset();
 	_asyncResolverFactory.reset();
 	_portAllocator.reset();
@@ -194,6 +226,15 @@ void NetworkManager::start() {
 
     _transportChannel->MaybeStartGathering();
 
+    if (_outgoingPackets) {
+        const auto weak = std::weak_ptr<NetworkManager>(shared_from_this());
+        _outgoingPackets->setConsumer([weak]() {
+            if (const auto strong = weak.lock()) {
+                strong->sendOutgoingPackets();
+            }
+        });
+    }
+
     _transportChannel->SetRemoteIceMode(cricket::ICEMODE_FULL);
     
     _lastNetworkActivityMs = rtc::TimeMillis();
@@ -224,20 +265,57 @@ void NetworkManager::receiveSignalingMessage(DecryptedMessage &&message) {
 }
 
 uint32_t NetworkManager::sendMessage(const Message &message) {
+	const auto startUs = rtc::TimeMicros();
 	if (const auto prepared = _transport.prepareForSending(message)) {
+		_encryptTimeMetric->record(rtc::TimeMicros() - startUs);
+		_heapBufferedPacketsMetric->add();
 		rtc::PacketOptions packetOptions;
 		_transportChannel->SendPacket((const char *)prepared->bytes.data(), prepared->bytes.size(), packetOptions, 0);
         addTrafficStats(prepared->bytes.size(), false);
+		_packetsSentMetric->add();
 		return prepared->counter;
 	}
 	return 0;
 }
 
+void NetworkManager::sendOutgoingPackets() {
+    _outgoingPackets->beginDrain();
+    auto count = 0;
+    while (const auto slot = _outgoingPackets->pop()) {
+        sendOutgoingPacket(*slot);
+        _outgoingPackets->release(slot);
+        count++;
+    }
+    _outgoingQueueDepthMetric->record(count);
+}
+
+void NetworkManager::sendOutgoingPacket(OutgoingPacketQueue::Slot &slot) {
+    if (!_transport.canPrepareForSendingInPlace()) {
+        // Pending acks and resends are appended by the regular serialization path.
+        // Counted as a heap-buffered packet by sendMessage.
+        auto data = rtc::CopyOnWriteBuffer(slot.payload(), slot.size);
+        sendMessage(slot.isVideo
+            ? Message{ VideoDataMessage{ std::move(data) } }
+            : Message{ AudioDataMessage{ std::move(data) } });
+        return;
+    }
+    const auto messageId = slot.isVideo ? VideoDataMessage::kId : AudioDataMessage::kId;
+    const auto startUs = rtc::TimeMicros();
+    if (const auto prepared = _transport.prepareForSendingInPlace(messageId, slot.data, slot.size)) {
+        _encryptTimeMetric->record(rtc::TimeMicros() - startUs);
+        rtc::PacketOptions packetOptions;
+        _transportChannel->SendPacket((const char *)prepared->bytes, prepared->size, packetOptions, 0);
+        addTrafficStats(prepared->size, false);
+        _packetsSentMetric->add();
+    }
+}
+
 void NetworkManager::sendTransportService(int cause) {
 	if (const auto prepared = _transport.prepareForSendingService(cause)) {
 		rtc::PacketOptions packetOptions;
 		_transportChannel->SendPacket((const char *)prepared->bytes.data(), prepared->bytes.size(), packetOptions, 0);
         addTrafficStats(prepared->bytes.size(), false);
+		_packetsSentMetric->add();
 	}
 }
 
@@ -332,16 +410,39 @@ void NetworkManager::transportPacketReceived(rtc::PacketTransportInternal *trans
     
     addTrafficStats(size, true);
 
+	_packetsReceivedMetric->add();
+
+	const auto startUs = rtc::TimeMicros();
 	if (auto decrypted = _transport.handleIncomingPacket(bytes, size)) {
-		if (_transportMessageReceived) {
-			_transportMessageReceived(std::move(decrypted->main));
-			for (auto &message : decrypted->additional) {
-				_transportMessageReceived(std::move(message));
-			}
+		_decryptTimeMetric->record(rtc::TimeMicros() - startUs);
+		// Every packet is decrypted into a buffer of its own, see handleIncomingPacket.
+		_heapBufferedPacketsMetric->add();
+		receiveTransportMessage(std::move(decrypted->main));
+		for (auto &message : decrypted->additional) {
+			receiveTransportMessage(std::move(message));
 		}
 	}
 }
 
+void NetworkManager::receiveTransportMessage(DecryptedMessage &&message) {
+	// Media goes straight to the media thread. Control messages take the same
+	// queue, so that the media thread sees them in order with the media.
+	const auto data = &message.message.data;
+	if (_incomingPackets) {
+		if (const auto audio = absl::get_if<AudioDataMessage>(data)) {
+			_incomingPackets->push(false, std::move(audio->data));
+		} else if (const auto video = absl::get_if<VideoDataMessage>(data)) {
+			_incomingPackets->push(true, std::move(video->data));
+		} else {
+			_incomingPackets->pushMessage(std::move(message));
+		}
+		return;
+	}
+	if (_transportMessageReceived) {
+		_transportMessageReceived(std::move(message));
+	}
+}
+
 void NetworkManager::transportRouteChanged(absl::optional<rtc::NetworkRoute> route) {
     assert(_thread->IsCurrent());
     
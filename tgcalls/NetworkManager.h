@@ -6,6 +6,9 @@
 #include "EncryptedConnection.h"
 #include "Instance.h"
 #include "Message.h"
+#include "IncomingPacketQueue.h"
+#include "Metrics.h"
+#include "OutgoingPacketQueue.h"
 #include "Stats.h"
 
 #include "rtc_base/copy_on_write_buffer.h"
@@ -55,12 +58,16 @@ public:
 		bool enableP2P,
         bool enableTCP,
         bool enableStunMarking,
+        ProtocolVersion protocolVersion,
 		std::vector<RtcServer> const &rtcServers,
         std::unique_ptr<Proxy> proxy,
 		std::function<void(const State &)> stateUpdated,
 		std::function<void(DecryptedMessage &&)> transportMessageReceived,
 		std::function<void(Message &&)> sendSignalingMessage,
-		std::function<void(int delayMs, int cause)> sendTransportServiceAsync);
+		std::function<void(int delayMs, int cause)> sendTransportServiceAsync,
+		std::shared_ptr<OutgoingPacketQueue> outgoingPackets,
+		std::shared_ptr<IncomingPacketQueue> incomingPackets,
+		std::shared_ptr<MetricsRegistry> metrics);
 	~NetworkManager();
 
     void start();
@@ -74,6 +81,9 @@ public:
 
 private:
     void checkConnectionTimeout();
+    void sendOutgoingPackets();
+    void sendOutgoingPacket(OutgoingPacketQueue::Slot &slot);
+    void receiveTransportMessage(DecryptedMessage &&message);
 	void candidateGathered(cricket::IceTransportInternal *transport, const cricket::Candidate &candidate);
 	void candidateGatheringState(cricket::IceTransportInternal *transport);
 	void transportStateChanged(cricket::IceTransportInternal *transport);
@@ -93,6 +103,17 @@ private:
 	std::function<void(const NetworkManager::State &)> _stateUpdated;
 	std::function<void(DecryptedMessage &&)> _transportMessageReceived;
 	std::function<void(Message &&)> _sendSignalingMessage;
+	std::shared_ptr<OutgoingPacketQueue> _outgoingPackets;
+	std::shared_ptr<IncomingPacketQueue> _incomingPackets;
+	std::shared_ptr<MetricsRegistry> _metrics;
+	MetricsCounter *_packetsSentMetric = nullptr;
+	MetricsCounter *_packetsReceivedMetric = nullptr;
+	// Packets sent or received through a heap buffer of their own rather than
+	// a pooled slot, each counted once.
+	MetricsCounter *_heapBufferedPacketsMetric = nullptr;
+	MetricsHistogram *_encryptTimeMetric = nullptr;
+	MetricsHistogram *_decryptTimeMetric = nullptr;
+	MetricsHistogram *_outgoingQueueDepthMetric = nullptr;
 
     std::unique_ptr<rtc::NetworkMonitorFactory> _networkMonitorFactory;
 	std::unique_ptr<rtc::BasicPacketSocketFactory> _socketFactory;
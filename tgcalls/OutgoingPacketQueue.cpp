@@ -0,0 +1,197 @@
+#include "OutgoingPacketQueue.h"
+
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+
+#include <string.h>
+
+namespace tgcalls {
+namespace {
+
+int LatencyBucket(int64_t latencyUs, int bucketCount) {
+    auto bucket = 0;
+    while (latencyUs > 0 && bucket < bucketCount - 1) {
+        latencyUs >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+} // namespace
+
+OutgoingPacketQueue::OutgoingPacketQueue(rtc::Thread *consumerThread, size_t slotCount) :
+_consumerThread(consumerThread),
+_head(&_stub),
+_tail(&_stub) {
+    assert(_consumerThread != nullptr);
+
+    _slots.reserve(slotCount);
+    _freeSlots.reserve(slotCount);
+    for (size_t i = 0; i < slotCount; i++) {
+        _slots.push_back(std::make_unique<Slot>());
+        _freeSlots.push_back(_slots.back().get());
+    }
+}
+
+OutgoingPacketQueue::~OutgoingPacketQueue() {
+}
+
+bool OutgoingPacketQueue::push(bool isVideo, const uint8_t *data, size_t size) {
+    if (size > kMaxPayloadSize) {
+        _droppedPackets.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Slot *slot = nullptr;
+    {
+        webrtc::MutexLock lock(&_freeMutex);
+        if (!_freeSlots.empty()) {
+            slot = _freeSlots.back();
+            _freeSlots.pop_back();
+        }
+    }
+    if (!slot) {
+        _droppedPackets.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    slot->isVideo = isVideo;
+    slot->size = size;
+    slot->enqueuedAtUs = rtc::TimeMicros();
+    memcpy(slot->payload(), data, size);
+
+    enqueue(slot);
+
+    // The consumer clears the flag before it starts popping, so a packet pushed
+    // while a drain is running either gets popped by it or schedules the next one.
+    if (!_drainScheduled.exchange(true, std::memory_order_acq_rel)) {
+        scheduleDrain();
+    }
+    return true;
+}
+
+void OutgoingPacketQueue::enqueue(Slot *slot) {
+    slot->next.store(nullptr, std::memory_order_relaxed);
+    const auto previous = _head.exchange(slot, std::memory_order_acq_rel);
+    previous->next.store(slot, std::memory_order_release);
+}
+
+void OutgoingPacketQueue::scheduleDrain() {
+    _consumerThread->PostTask(RTC_FROM_HERE, [weak = std::weak_ptr<OutgoingPacketQueue>(shared_from_this())]() {
+        const auto strong = weak.lock();
+        if (!strong) {
+            return;
+        }
+        if (strong->_consumer) {
+            strong->_consumer();
+        } else {
+            // Nobody to send to yet, keep the packets from piling up in the pool.
+            strong->beginDrain();
+            while (const auto slot = strong->pop()) {
+                strong->_droppedPackets.fetch_add(1, std::memory_order_relaxed);
+                strong->recycle(slot);
+            }
+        }
+    });
+}
+
+void OutgoingPacketQueue::setConsumer(std::function<void()> consumer) {
+    assert(_consumerThread->IsCurrent());
+
+    _consumer = std::move(consumer);
+}
+
+void OutgoingPacketQueue::beginDrain() {
+    assert(_consumerThread->IsCurrent());
+
+    _drainScheduled.store(false, std::memory_order_release);
+    _batches++;
+    _currentBatchSize = 0;
+}
+
+auto OutgoingPacketQueue::pop() -> Slot* {
+    assert(_consumerThread->IsCurrent());
+
+    auto tail = _tail;
+    auto next = tail->next.load(std::memory_order_acquire);
+    if (tail == &_stub) {
+        if (!next) {
+            return nullptr;
+        }
+        _tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    if (tail != _head.load(std::memory_order_acquire)) {
+        // A producer is in the middle of a push, its drain will pick this up.
+        return nullptr;
+    }
+    enqueue(&_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+void OutgoingPacketQueue::release(Slot *slot) {
+    assert(_consumerThread->IsCurrent());
+
+    const auto now = rtc::TimeMicros();
+    _latencyBuckets[LatencyBucket(now - slot->enqueuedAtUs, kLatencyBucketCount)]++;
+    if (!_firstSentAtUs) {
+        _firstSentAtUs = now;
+    }
+    _lastSentAtUs = now;
+    _currentBatchSize++;
+    if (_currentBatchSize > _maxBatchSize) {
+        _maxBatchSize = _currentBatchSize;
+    }
+
+    recycle(slot);
+}
+
+void OutgoingPacketQueue::recycle(Slot *slot) {
+    webrtc::MutexLock lock(&_freeMutex);
+    _freeSlots.push_back(slot);
+}
+
+OutgoingPacketQueue::Stats OutgoingPacketQueue::getStats() const {
+    assert(_consumerThread->IsCurrent());
+
+    Stats stats;
+    stats.droppedPackets = _droppedPackets.load(std::memory_order_relaxed);
+    stats.batches = _batches;
+    stats.maxBatchSize = _maxBatchSize;
+
+    auto total = int64_t(0);
+    for (const auto count : _latencyBuckets) {
+        total += count;
+    }
+    stats.sentPackets = total;
+    if (_lastSentAtUs > _firstSentAtUs) {
+        stats.packetsPerSecond = (double)(total - 1) * 1000000.0 / (double)(_lastSentAtUs - _firstSentAtUs);
+    }
+
+    // Percentiles are reported as the upper bound of their power-of-two bucket.
+    auto seen = int64_t(0);
+    for (int i = 0; i < kLatencyBucketCount && total > 0; i++) {
+        seen += _latencyBuckets[i];
+        if (!stats.latencyP50Us && seen * 2 >= total) {
+            stats.latencyP50Us = int64_t(1) << i;
+        }
+        if (seen * 100 >= total * 99) {
+            stats.latencyP99Us = int64_t(1) << i;
+            break;
+        }
+    }
+
+    return stats;
+}
+
+} // namespace tgcalls
@@ -0,0 +1,99 @@
+#ifndef TGCALLS_OUTGOING_PACKET_QUEUE_H
+#define TGCALLS_OUTGOING_PACKET_QUEUE_H
+
+#include "rtc_base/synchronization/mutex.h"
+
+#include "EncryptedConnection.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace rtc {
+class Thread;
+} // namespace rtc
+
+namespace tgcalls {
+
+// Hands outgoing RTP/RTCP packets from the media thread to the network thread.
+// Packets are copied once into preallocated slots that leave room for the
+// transport header, so they can be encrypted in place. Producers push through
+// a lock-free intrusive queue and only the push that finds the consumer idle
+// posts a task, which then drains everything queued so far.
+class OutgoingPacketQueue final : public std::enable_shared_from_this<OutgoingPacketQueue> {
+public:
+    static constexpr size_t kMaxPayloadSize = 1500;
+
+    struct Slot {
+        std::atomic<Slot*> next{ nullptr };
+        bool isVideo = false;
+        size_t size = 0;
+        int64_t enqueuedAtUs = 0;
+        uint8_t data[EncryptedConnection::kInPlaceHeadroom + kMaxPayloadSize];
+
+        uint8_t *payload() {
+            return data + EncryptedConnection::kInPlaceHeadroom;
+        }
+    };
+
+    struct Stats {
+        int64_t sentPackets = 0;
+        int64_t droppedPackets = 0;
+        int64_t batches = 0;
+        int64_t maxBatchSize = 0;
+        double packetsPerSecond = 0.0;
+        // Time from push() to release(), in microseconds.
+        int64_t latencyP50Us = 0;
+        int64_t latencyP99Us = 0;
+    };
+
+    OutgoingPacketQueue(rtc::Thread *consumerThread, size_t slotCount);
+    ~OutgoingPacketQueue();
+
+    OutgoingPacketQueue(const OutgoingPacketQueue&) = delete;
+    OutgoingPacketQueue& operator=(const OutgoingPacketQueue&) = delete;
+
+    // Any thread. Returns false when every slot is in flight.
+    bool push(bool isVideo, const uint8_t *data, size_t size);
+
+    // Consumer thread only.
+    void setConsumer(std::function<void()> consumer);
+    void beginDrain();
+    Slot *pop();
+    void release(Slot *slot);
+    Stats getStats() const;
+
+private:
+    static constexpr int kLatencyBucketCount = 32;
+
+    void enqueue(Slot *slot);
+    void recycle(Slot *slot);
+    void scheduleDrain();
+
+    rtc::Thread *_consumerThread = nullptr;
+    std::vector<std::unique_ptr<Slot>> _slots;
+
+    webrtc::Mutex _freeMutex;
+    std::vector<Slot*> _freeSlots;
+
+    Slot _stub;
+    std::atomic<Slot*> _head{ nullptr };
+    std::atomic<bool> _drainScheduled{ false };
+    std::atomic<int64_t> _droppedPackets{ 0 };
+
+    // Owned by the consumer thread.
+    Slot *_tail = nullptr;
+    std::function<void()> _consumer;
+    int64_t _batches = 0;
+    int64_t _currentBatchSize = 0;
+    int64_t _maxBatchSize = 0;
+    int64_t _firstSentAtUs = 0;
+    int64_t _lastSentAtUs = 0;
+    int64_t _latencyBuckets[kLatencyBucketCount] = { 0 };
+};
+
+} // namespace tgcalls
+
+#endif
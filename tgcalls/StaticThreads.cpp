@@ -1,6 +1,8 @@
 #include "StaticThreads.h"
+#include "ThreadInstrumentation.h"
 
 #include "rtc_base/thread.h"
+#include "rtc_base/null_socket_server.h"
 #include "call/call.h"
 
 #include <mutex>
@@ -95,11 +97,12 @@ private:
   Thread worker_;
   rtc::scoped_refptr<webrtc::SharedModuleThread> shared_module_thread_;
 
+  // Same as rtc::Thread::Create and CreateWithSocketServer, but measured, see ThreadInstrumentation.h
   static Thread create(const std::string &name) {
-    return init(std::unique_ptr<rtc::Thread>(rtc::Thread::Create()), name);
+    return init(std::make_unique<InstrumentedThread>(std::make_unique<rtc::NullSocketServer>()), name);
   }
   static Thread create_network(const std::string &name) {
-    return init(std::unique_ptr<rtc::Thread>(rtc::Thread::CreateWithSocketServer()), name);
+    return init(std::make_unique<InstrumentedThread>(rtc::SocketServer::CreateDefault()), name);
   }
 
   static Thread init(Thread value, const std::string &name) {
@@ -0,0 +1,329 @@
+#include "ThreadInstrumentation.h"
+
+#include "StaticThreads.h"
+#include "Metrics.h"
+
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace tgcalls {
+namespace {
+
+// Invokes from one pooled thread into another are reported once they block this long.
+constexpr int64_t kSlowHotInvokeUs = 5000;
+constexpr size_t kDumpedOffendersCount = 10;
+constexpr int kQueueDepthSampleIntervalMs = 100;
+
+std::atomic<bool> isEnabledValue{ false };
+std::atomic<int> dumpGeneration{ 0 };
+
+webrtc::Mutex &threadsMutex() {
+    static webrtc::Mutex value;
+    return value;
+}
+
+std::vector<InstrumentedThread*> &threads() {
+    static std::vector<InstrumentedThread*> value;
+    return value;
+}
+
+bool isInstrumented(rtc::Thread *thread) {
+    webrtc::MutexLock lock(&threadsMutex());
+    const auto &list = threads();
+    return std::find(list.begin(), list.end(), thread) != list.end();
+}
+
+struct QueueDepthMetrics {
+    webrtc::Mutex mutex;
+    std::vector<std::weak_ptr<MetricsRegistry>> registries;
+    bool isSampling = false;
+};
+
+QueueDepthMetrics &queueDepthMetrics() {
+    static QueueDepthMetrics value;
+    return value;
+}
+
+void scheduleQueueDepthSample() {
+    StaticThreads::getMediaThread()->PostDelayedTask(RTC_FROM_HERE, []() {
+        auto &metrics = queueDepthMetrics();
+        std::vector<std::shared_ptr<MetricsRegistry>> registries;
+        {
+            webrtc::MutexLock lock(&metrics.mutex);
+            auto &list = metrics.registries;
+            list.erase(std::remove_if(list.begin(), list.end(), [](std::weak_ptr<MetricsRegistry> const &registry) {
+                return registry.expired();
+            }), list.end());
+            for (const auto &registry : list) {
+                if (auto strong = registry.lock()) {
+                    registries.push_back(std::move(strong));
+                }
+            }
+            if (registries.empty()) {
+                metrics.isSampling = false;
+                return;
+            }
+        }
+
+        {
+            webrtc::MutexLock lock(&threadsMutex());
+            for (const auto thread : threads()) {
+                const auto depth = (int64_t)thread->size();
+                const auto name = "thread." + thread->name() + ".queue_depth";
+                for (const auto &registry : registries) {
+                    registry->histogram(name)->record(depth);
+                }
+            }
+        }
+        scheduleQueueDepthSample();
+    }, kQueueDepthSampleIntervalMs);
+}
+
+void scheduleDump(int generation, int intervalMs) {
+    StaticThreads::getMediaThread()->PostDelayedTask(RTC_FROM_HERE, [generation, intervalMs]() {
+        if (dumpGeneration.load() != generation) {
+            return;
+        }
+        if (ThreadInstrumentation::isEnabled()) {
+            for (const auto &stats : ThreadInstrumentation::getTopOffenders(kDumpedOffendersCount)) {
+                RTC_LOG(LS_INFO) << "Thread " << stats.threadName << " " << stats.location
+                    << ": busy " << (stats.busyUs() / 1000) << "ms"
+                    << ", tasks " << stats.tasks
+                    << " (run max " << stats.maxRunUs << "us, wait avg " << (stats.tasks ? stats.totalWaitUs / stats.tasks : 0) << "us, max " << stats.maxWaitUs << "us)"
+                    << ", invokes " << stats.invokes << " (hot " << stats.hotInvokes << ", max " << stats.maxInvokeUs << "us)";
+            }
+        }
+        scheduleDump(generation, intervalMs);
+    }, intervalMs);
+}
+
+} // namespace
+
+namespace ThreadInstrumentation {
+
+void setEnabled(bool enabled) {
+    isEnabledValue.store(enabled);
+    if (!enabled) {
+        webrtc::MutexLock lock(&threadsMutex());
+        for (const auto thread : threads()) {
+            thread->resetDueTimes();
+        }
+    }
+}
+
+bool isEnabled() {
+    return isEnabledValue.load(std::memory_order_relaxed);
+}
+
+std::vector<ThreadTaskStats> getTopOffenders(size_t count) {
+    std::vector<ThreadTaskStats> result;
+    {
+        webrtc::MutexLock lock(&threadsMutex());
+        for (const auto thread : threads()) {
+            thread->collectStats(result);
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const ThreadTaskStats &lhs, const ThreadTaskStats &rhs) {
+        return lhs.busyUs() > rhs.busyUs();
+    });
+    if (result.size() > count) {
+        result.resize(count);
+    }
+    return result;
+}
+
+void reset() {
+    webrtc::MutexLock lock(&threadsMutex());
+    for (const auto thread : threads()) {
+        thread->resetStats();
+    }
+}
+
+void setPeriodicDumpInterval(int intervalMs) {
+    const auto generation = ++dumpGeneration;
+    if (intervalMs > 0) {
+        scheduleDump(generation, intervalMs);
+    }
+}
+
+void addQueueDepthMetrics(std::shared_ptr<MetricsRegistry> metrics) {
+    auto &queueDepth = queueDepthMetrics();
+    webrtc::MutexLock lock(&queueDepth.mutex);
+    queueDepth.registries.push_back(metrics);
+    if (!queueDepth.isSampling) {
+        queueDepth.isSampling = true;
+        scheduleQueueDepthSample();
+    }
+}
+
+} // namespace ThreadInstrumentation
+
+InstrumentedThread::InstrumentedThread(std::unique_ptr<rtc::SocketServer> socketServer) :
+rtc::Thread(std::move(socketServer)) {
+    webrtc::MutexLock lock(&threadsMutex());
+    threads().push_back(this);
+}
+
+InstrumentedThread::~InstrumentedThread() {
+    {
+        webrtc::MutexLock lock(&threadsMutex());
+        auto &list = threads();
+        list.erase(std::remove(list.begin(), list.end(), this), list.end());
+    }
+    // Subclasses of rtc::Thread have to stop it before their members go away.
+    Stop();
+}
+
+void InstrumentedThread::Post(const rtc::Location &posted_from, rtc::MessageHandler *handler, uint32_t id, rtc::MessageData *data, bool time_sensitive) {
+    if (data && ThreadInstrumentation::isEnabled()) {
+        notePosted(data, rtc::TimeMicros());
+    }
+    rtc::Thread::Post(posted_from, handler, id, data, time_sensitive);
+}
+
+void InstrumentedThread::PostDelayed(const rtc::Location &posted_from, int delay_ms, rtc::MessageHandler *handler, uint32_t id, rtc::MessageData *data) {
+    if (data && ThreadInstrumentation::isEnabled()) {
+        notePosted(data, rtc::TimeMicros() + (int64_t)delay_ms * rtc::kNumMicrosecsPerMillisec);
+    }
+    rtc::Thread::PostDelayed(posted_from, delay_ms, handler, id, data);
+}
+
+void InstrumentedThread::notePosted(rtc::MessageData *data, int64_t dueUs) {
+    webrtc::MutexLock lock(&_mutex);
+    _dueAtUs[data] = dueUs;
+    _dueAtCount.store(_dueAtUs.size(), std::memory_order_relaxed);
+}
+
+void InstrumentedThread::forgetPosted(rtc::MessageData *data) {
+    webrtc::MutexLock lock(&_mutex);
+    _dueAtUs.erase(data);
+    _dueAtCount.store(_dueAtUs.size(), std::memory_order_relaxed);
+}
+
+void InstrumentedThread::Clear(rtc::MessageHandler *handler, uint32_t id, rtc::MessageList *removed) {
+    if (_dueAtCount.load(std::memory_order_relaxed) == 0) {
+        rtc::Thread::Clear(handler, id, removed);
+        return;
+    }
+
+    // Cleared messages are never dispatched, their entries go here instead.
+    rtc::MessageList cleared;
+    rtc::Thread::Clear(handler, id, &cleared);
+    {
+        webrtc::MutexLock lock(&_mutex);
+        for (const auto &message : cleared) {
+            if (message.pdata) {
+                _dueAtUs.erase(message.pdata);
+            }
+        }
+        _dueAtCount.store(_dueAtUs.size(), std::memory_order_relaxed);
+    }
+    if (removed) {
+        removed->splice(removed->end(), cleared);
+    } else {
+        for (const auto &message : cleared) {
+            delete message.pdata;
+        }
+    }
+}
+
+void InstrumentedThread::Send(const rtc::Location &posted_from, rtc::MessageHandler *handler, uint32_t id, rtc::MessageData *data) {
+    if (IsCurrent() || !ThreadInstrumentation::isEnabled()) {
+        rtc::Thread::Send(posted_from, handler, id, data);
+        return;
+    }
+
+    const auto startUs = rtc::TimeMicros();
+    rtc::Thread::Send(posted_from, handler, id, data);
+    const auto blockedUs = rtc::TimeMicros() - startUs;
+
+    const auto caller = rtc::Thread::Current();
+    const auto isHot = caller != nullptr && isInstrumented(caller);
+
+    auto reportSlow = false;
+    {
+        webrtc::MutexLock lock(&_mutex);
+        auto &stats = statsForLocation(posted_from);
+        stats.invokes++;
+        stats.totalInvokeUs += blockedUs;
+        if (isHot) {
+            stats.hotInvokes++;
+            // Like rtc::Thread's own dispatch warning, only report new maximums.
+            reportSlow = blockedUs >= kSlowHotInvokeUs && blockedUs > stats.maxInvokeUs;
+        }
+        stats.maxInvokeUs = std::max(stats.maxInvokeUs, blockedUs);
+    }
+    if (reportSlow) {
+        RTC_LOG(LS_WARNING) << "Invoke from " << caller->name() << " into " << name()
+            << " blocked for " << (blockedUs / 1000) << "ms, posted from " << posted_from.ToString();
+    }
+}
+
+void InstrumentedThread::Dispatch(rtc::Message *message) {
+    if (!ThreadInstrumentation::isEnabled()) {
+        // Posted while recording was on, the data may be freed and reused.
+        if (message->pdata && _dueAtCount.load(std::memory_order_relaxed) != 0) {
+            forgetPosted(message->pdata);
+        }
+        rtc::Thread::Dispatch(message);
+        return;
+    }
+
+    const auto startUs = rtc::TimeMicros();
+    auto waitUs = int64_t(0);
+    // Looked up first, the handler usually deletes the message data.
+    if (message->pdata) {
+        webrtc::MutexLock lock(&_mutex);
+        const auto it = _dueAtUs.find(message->pdata);
+        if (it != _dueAtUs.end()) {
+            waitUs = std::max(startUs - it->second, int64_t(0));
+            _dueAtUs.erase(it);
+            _dueAtCount.store(_dueAtUs.size(), std::memory_order_relaxed);
+        }
+    }
+
+    rtc::Thread::Dispatch(message);
+    const auto runUs = rtc::TimeMicros() - startUs;
+
+    webrtc::MutexLock lock(&_mutex);
+    auto &stats = statsForLocation(message->posted_from);
+    stats.tasks++;
+    stats.totalWaitUs += waitUs;
+    stats.maxWaitUs = std::max(stats.maxWaitUs, waitUs);
+    stats.totalRunUs += runUs;
+    stats.maxRunUs = std::max(stats.maxRunUs, runUs);
+}
+
+ThreadTaskStats &InstrumentedThread::statsForLocation(const rtc::Location &location) {
+    const auto key = LocationKey(location.function_name(), location.file_and_line());
+    auto it = _stats.find(key);
+    if (it == _stats.end()) {
+        it = _stats.emplace(key, ThreadTaskStats()).first;
+        it->second.location = location.ToString();
+    }
+    return it->second;
+}
+
+void InstrumentedThread::collectStats(std::vector<ThreadTaskStats> &result) {
+    webrtc::MutexLock lock(&_mutex);
+    for (const auto &it : _stats) {
+        result.push_back(it.second);
+        result.back().threadName = name();
+    }
+}
+
+void InstrumentedThread::resetStats() {
+    webrtc::MutexLock lock(&_mutex);
+    _stats.clear();
+}
+
+void InstrumentedThread::resetDueTimes() {
+    webrtc::MutexLock lock(&_mutex);
+    _dueAtUs.clear();
+    _dueAtCount.store(0, std::memory_order_relaxed);
+}
+
+} // namespace tgcalls
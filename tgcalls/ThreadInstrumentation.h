@@ -0,0 +1,102 @@
+#ifndef TGCALLS_THREAD_INSTRUMENTATION_H
+#define TGCALLS_THREAD_INSTRUMENTATION_H
+
+#include "rtc_base/thread.h"
+#include "rtc_base/location.h"
+#include "rtc_base/synchronization/mutex.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace tgcalls {
+
+class MetricsRegistry;
+
+struct ThreadTaskStats {
+    std::string threadName;
+    // Where the task was posted from, as given by RTC_FROM_HERE.
+    std::string location;
+
+    int64_t tasks = 0;
+    // From the time a task was due until it started running.
+    int64_t totalWaitUs = 0;
+    int64_t maxWaitUs = 0;
+    int64_t totalRunUs = 0;
+    int64_t maxRunUs = 0;
+
+    // Time callers spent blocked in Invoke. Hot invokes are the ones made
+    // from another pooled thread, which stalls that thread's queue as well.
+    int64_t invokes = 0;
+    int64_t hotInvokes = 0;
+    int64_t totalInvokeUs = 0;
+    int64_t maxInvokeUs = 0;
+
+    // How long the location kept pooled threads busy or blocked.
+    int64_t busyUs() const {
+        return totalRunUs + totalInvokeUs;
+    }
+};
+
+namespace ThreadInstrumentation {
+
+// Recording is off by default, posting costs a map update while it is on.
+void setEnabled(bool enabled);
+bool isEnabled();
+
+// The locations that kept pooled threads busy the longest, across all of them.
+std::vector<ThreadTaskStats> getTopOffenders(size_t count);
+void reset();
+
+// Logs the top offenders every intervalMs while recording is enabled, 0 stops it.
+void setPeriodicDumpInterval(int intervalMs);
+
+// Samples how many tasks wait on each pooled thread, delayed ones included,
+// into the registry as the "thread.<name>.queue_depth" histogram for as long
+// as the registry is alive. Sampling does not depend on recording.
+void addQueueDepthMetrics(std::shared_ptr<MetricsRegistry> metrics);
+
+} // namespace ThreadInstrumentation
+
+// The threads handed out by Threads. Measures every task posted to it and
+// every Invoke into it, keyed by the posting location.
+class InstrumentedThread final : public rtc::Thread {
+public:
+    explicit InstrumentedThread(std::unique_ptr<rtc::SocketServer> socketServer);
+    ~InstrumentedThread() override;
+
+    void Post(const rtc::Location &posted_from, rtc::MessageHandler *handler, uint32_t id = 0, rtc::MessageData *data = nullptr, bool time_sensitive = false) override;
+    void PostDelayed(const rtc::Location &posted_from, int delay_ms, rtc::MessageHandler *handler, uint32_t id = 0, rtc::MessageData *data = nullptr) override;
+    void Send(const rtc::Location &posted_from, rtc::MessageHandler *handler, uint32_t id = 0, rtc::MessageData *data = nullptr) override;
+    void Clear(rtc::MessageHandler *handler, uint32_t id = rtc::MQID_ANY, rtc::MessageList *removed = nullptr) override;
+    void Dispatch(rtc::Message *message) override;
+
+    void collectStats(std::vector<ThreadTaskStats> &result);
+    void resetStats();
+    void resetDueTimes();
+
+private:
+    using LocationKey = std::pair<const char *, const char *>;
+
+    ThreadTaskStats &statsForLocation(const rtc::Location &location);
+    void notePosted(rtc::MessageData *data, int64_t dueUs);
+    void forgetPosted(rtc::MessageData *data);
+
+    webrtc::Mutex _mutex;
+    // Keyed by the message data, which every PostTask allocates anew. Entries
+    // are dropped when their message is dispatched or cleared, whether or not
+    // recording is still on, so a reused address never inherits one.
+    std::unordered_map<rtc::MessageData *, int64_t> _dueAtUs;
+    // Mirrors _dueAtUs.size(), so that dispatching skips the lock while it is empty.
+    std::atomic<size_t> _dueAtCount{ 0 };
+    std::map<LocationKey, ThreadTaskStats> _stats;
+};
+
+} // namespace tgcalls
+
+#endif
@@ -17,7 +17,8 @@ std::string DesktopCaptureSourceData::cachedKey() const {
         + ':'
         + std::to_string(fps)
         + ':'
-        + (captureMouse ? '1' : '0');
+        + (captureMouse ? '1' : '0')
+        + (adaptiveFps ? ":a" : "");
 }
 
 DesktopCaptureSource::DesktopCaptureSource(
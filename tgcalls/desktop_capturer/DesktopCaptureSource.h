@@ -35,6 +35,8 @@ struct DesktopCaptureSourceData {
 	DesktopSize aspectSize;
 	double fps = 24.;
 	bool captureMouse = true;
+	// Lowers the capture rate while nothing on screen changes.
+	bool adaptiveFps = false;
 
 	std::string cachedKey() const;
 };
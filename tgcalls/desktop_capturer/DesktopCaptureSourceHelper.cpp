@@ -18,12 +18,15 @@
 
 #include "tgcalls/desktop_capturer/DesktopCaptureSourceManager.h"
 #include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
 #include "api/video/video_sink_interface.h"
 #include "api/video/video_frame.h"
 #include "modules/desktop_capture/desktop_and_cursor_composer.h"
 #include "modules/desktop_capture/desktop_capturer.h"
 #include "system_wrappers/include/clock.h"
 #include "api/video/i420_buffer.h"
+#include "common_video/include/video_frame_buffer_pool.h"
+#include "modules/desktop_capture/desktop_region.h"
 #include "third_party/libyuv/include/libyuv.h"
 
 #ifdef WEBRTC_MAC
@@ -33,6 +36,20 @@
 namespace tgcalls {
 namespace {
 
+constexpr auto kMaxPooledBuffers = size_t(8);
+constexpr auto kStripeHeight = 16;
+
+// Adaptive mode: idle captures stretch the delay up to kMaxIdleDelayMs,
+// unchanged frames are still delivered every kIdleKeepAliveMs.
+constexpr auto kIdleDelayFactor = 1.25;
+constexpr auto kMaxIdleDelayMs = 500.;
+constexpr auto kIdleKeepAliveMs = int64_t(1000);
+constexpr auto kTimingSmoothing = 0.1;
+
+double SmoothTiming(double average, double value) {
+    return average + (value - average) * kTimingSmoothing;
+}
+
 #ifdef WEBRTC_MAC
 class CaptureScheduler {
 public:
@@ -79,6 +96,33 @@ private:
 };
 #endif // WEBRTC_MAC
 
+// Converts captured ARGB frames to I420 in a single pass over pooled buffers.
+// Sources at least twice as large as the requested size are box-downscaled 2x
+// in small stripes right before conversion, and only the updated region is
+// converted when the previous output can be reused.
+class DesktopFrameConverter {
+public:
+    DesktopFrameConverter();
+
+    rtc::scoped_refptr<webrtc::I420Buffer> convert(
+        const webrtc::DesktopFrame &frame,
+        DesktopSize size,
+        webrtc::VideoFrame::UpdateRect &updateRect);
+
+private:
+    void convertRect(
+        const webrtc::DesktopFrame &frame,
+        webrtc::I420Buffer *buffer,
+        const webrtc::DesktopRect &rect,
+        int scale);
+
+    webrtc::VideoFrameBufferPool _bufferPool;
+    rtc::scoped_refptr<webrtc::I420Buffer> _previousBuffer;
+    int _previousScale = 0;
+    std::vector<uint8_t> _scaledStripe;
+
+};
+
 class SourceFrameCallbackImpl : public webrtc::DesktopCapturer::Callback {
 public:
     SourceFrameCallbackImpl(DesktopSize size, int fps);
@@ -92,8 +136,18 @@ public:
 		std::shared_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink);
     void setOnFatalError(std::function<void ()>);
     void setOnPause(std::function<void (bool)>);
+    void setAdaptive(bool adaptive);
+
+    bool lastFrameHadChanges() const;
+    void addCaptureTiming(int64_t captureUs);
+    DesktopCaptureStats &stats();
 private:
-    rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer_;
+    DesktopFrameConverter _converter;
+    bool _adaptive = false;
+    bool _lastFrameHadChanges = true;
+    int64_t _lastConvertUs = 0;
+    int64_t _lastDeliveredMs = 0;
+    DesktopCaptureStats _stats;
 	std::shared_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> _sink;
 	std::shared_ptr<
         rtc::VideoSinkInterface<webrtc::VideoFrame>> _secondarySink;
@@ -116,6 +170,7 @@ public:
     void loop();
     void setOnFatalError(std::function<void ()>);
     void setOnPause(std::function<void (bool)>);
+    DesktopCaptureStats stats();
 private:
     CaptureScheduler &_scheduler;
     std::unique_ptr<webrtc::DesktopCapturer> _capturer;
@@ -126,10 +181,170 @@ private:
     bool _isRunning = false;
     bool _fatalError = false;
     bool _currentlyOnPause = false;
+    bool _adaptiveFps = false;
+    double _baseDelayMs = 0.;
     double _delayMs = 0.;
 
 };
 
+DesktopFrameConverter::DesktopFrameConverter()
+: _bufferPool(false, kMaxPooledBuffers) {
+}
+
+rtc::scoped_refptr<webrtc::I420Buffer> DesktopFrameConverter::convert(
+        const webrtc::DesktopFrame &frame,
+        DesktopSize size,
+        webrtc::VideoFrame::UpdateRect &updateRect) {
+    const auto frameSize = frame.size();
+    const auto scale = (frameSize.width() >= size.width * 2
+        || frameSize.height() >= size.height * 2)
+        ? 2
+        : 1;
+
+    // The few pixels that do not fit the multiple of 4 are cropped
+    // from the right and bottom edges instead of being stretched.
+    auto width = frameSize.width() / scale;
+    auto height = frameSize.height() / scale;
+    width -= (width % 4);
+    height -= (height % 4);
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+
+    const auto outputRect = webrtc::DesktopRect::MakeWH(width, height);
+    const auto canReusePrevious = _previousBuffer
+        && _previousBuffer->width() == width
+        && _previousBuffer->height() == height
+        && _previousScale == scale;
+
+    auto updatedRegion = webrtc::DesktopRegion(outputRect);
+    if (canReusePrevious) {
+        updatedRegion.Clear();
+        for (webrtc::DesktopRegion::Iterator i(frame.updated_region());
+                !i.IsAtEnd();
+                i.Advance()) {
+            const auto &rect = i.rect();
+
+            // Aligned to whole 2x2 chroma blocks of the output.
+            auto outputUpdatedRect = webrtc::DesktopRect::MakeLTRB(
+                (rect.left() / scale) & ~1,
+                (rect.top() / scale) & ~1,
+                ((rect.right() + scale - 1) / scale + 1) & ~1,
+                ((rect.bottom() + scale - 1) / scale + 1) & ~1);
+            outputUpdatedRect.IntersectWith(outputRect);
+            if (!outputUpdatedRect.is_empty()) {
+                updatedRegion.AddRect(outputUpdatedRect);
+            }
+        }
+        if (updatedRegion.is_empty()) {
+            updateRect = webrtc::VideoFrame::UpdateRect{ 0, 0, 0, 0 };
+            return _previousBuffer;
+        }
+    }
+
+    auto updatedBounds = webrtc::DesktopRect();
+    for (webrtc::DesktopRegion::Iterator i(updatedRegion);
+            !i.IsAtEnd();
+            i.Advance()) {
+        updatedBounds.UnionWith(i.rect());
+    }
+    updateRect = webrtc::VideoFrame::UpdateRect{
+        updatedBounds.left(),
+        updatedBounds.top(),
+        updatedBounds.width(),
+        updatedBounds.height()
+    };
+
+    auto buffer = _bufferPool.CreateI420Buffer(width, height);
+    if (!buffer) {
+        // Every pooled buffer is still referenced further down the pipeline.
+        buffer = webrtc::I420Buffer::Create(width, height);
+    }
+
+    auto updatedArea = int64_t(0);
+    for (webrtc::DesktopRegion::Iterator i(updatedRegion);
+            !i.IsAtEnd();
+            i.Advance()) {
+        updatedArea += int64_t(i.rect().width()) * i.rect().height();
+    }
+
+    // Copying 12 bits per pixel is cheaper than converting 32 of them,
+    // but not when most of the frame has changed anyway.
+    if (canReusePrevious
+        && updatedArea * 2 < int64_t(width) * height) {
+        libyuv::I420Copy(
+            _previousBuffer->DataY(), _previousBuffer->StrideY(),
+            _previousBuffer->DataU(), _previousBuffer->StrideU(),
+            _previousBuffer->DataV(), _previousBuffer->StrideV(),
+            buffer->MutableDataY(), buffer->StrideY(),
+            buffer->MutableDataU(), buffer->StrideU(),
+            buffer->MutableDataV(), buffer->StrideV(),
+            width,
+            height);
+        for (webrtc::DesktopRegion::Iterator i(updatedRegion);
+                !i.IsAtEnd();
+                i.Advance()) {
+            convertRect(frame, buffer.get(), i.rect(), scale);
+        }
+    } else {
+        convertRect(frame, buffer.get(), outputRect, scale);
+    }
+
+    _previousBuffer = buffer;
+    _previousScale = scale;
+    return buffer;
+}
+
+void DesktopFrameConverter::convertRect(
+        const webrtc::DesktopFrame &frame,
+        webrtc::I420Buffer *buffer,
+        const webrtc::DesktopRect &rect,
+        int scale) {
+    const auto width = rect.width();
+    const auto scaledStride = width * webrtc::DesktopFrame::kBytesPerPixel;
+    if (scale != 1) {
+        _scaledStripe.resize(size_t(scaledStride) * kStripeHeight);
+    }
+
+    for (auto top = rect.top(); top < rect.bottom(); top += kStripeHeight) {
+        const auto height = std::min(kStripeHeight, rect.bottom() - top);
+        const auto source = frame.GetFrameDataAtPos(
+            webrtc::DesktopVector(rect.left() * scale, top * scale));
+
+        auto argb = source;
+        auto argbStride = frame.stride();
+        if (scale != 1) {
+            // Exact 2x box downscale, so stripes never sample each other.
+            libyuv::ARGBScale(
+                source,
+                frame.stride(),
+                width * scale,
+                height * scale,
+                _scaledStripe.data(),
+                scaledStride,
+                width,
+                height,
+                libyuv::kFilterBox);
+            argb = _scaledStripe.data();
+            argbStride = scaledStride;
+        }
+
+        const auto i420Result = libyuv::ARGBToI420(
+            argb,
+            argbStride,
+            buffer->MutableDataY() + top * buffer->StrideY() + rect.left(),
+            buffer->StrideY(),
+            buffer->MutableDataU() + (top / 2) * buffer->StrideU() + rect.left() / 2,
+            buffer->StrideU(),
+            buffer->MutableDataV() + (top / 2) * buffer->StrideV() + rect.left() / 2,
+            buffer->StrideV(),
+            width,
+            height);
+        assert(i420Result == 0);
+        (void)i420Result;
+    }
+}
+
 SourceFrameCallbackImpl::SourceFrameCallbackImpl(DesktopSize size, int fps)
 : size_(size) {
 }
@@ -149,80 +364,43 @@ void SourceFrameCallbackImpl::OnCaptureResult(
         } else if (_onPause) {
             _onPause(true);
         }
+        _lastFrameHadChanges = true;
+        _lastConvertUs = 0;
         return;
     } else if (_onPause) {
         _onPause(false);
     }
 
-    const auto frameSize = frame->size();
-    auto fittedSize = (frameSize.width() >= size_.width * 2
-        || frameSize.height() >= size_.height * 2)
-        ? DesktopSize{ frameSize.width() / 2, frameSize.height() / 2 }
-        : DesktopSize{ frameSize.width(), frameSize.height() };
-
-    fittedSize.width -= (fittedSize.width % 4);
-    fittedSize.height -= (fittedSize.height % 4);
-
-    const auto outputSize = webrtc::DesktopSize{
-        fittedSize.width,
-        fittedSize.height
-    };
-
-    webrtc::BasicDesktopFrame outputFrame{ outputSize };
-
-	const auto outputRect = webrtc::DesktopRect::MakeSize(outputSize);
-
-	const auto outputRectData = outputFrame.data() +
-        outputFrame.stride() * outputRect.top() +
-		webrtc::DesktopFrame::kBytesPerPixel * outputRect.left();
-
+    ++_stats.capturedFrames;
 
-	libyuv::ARGBScale(
-		frame->data(),
-		frame->stride(),
-		frame->size().width(),
-		frame->size().height(),
-        outputRectData,
-        outputFrame.stride(),
-        outputSize.width(),
-        outputSize.height(),
-		libyuv::kFilterBilinear);
+    const auto convertStarted = rtc::TimeMicros();
+    auto updateRect = webrtc::VideoFrame::UpdateRect{ 0, 0, 0, 0 };
+    const auto buffer = _converter.convert(*frame, size_, updateRect);
+    _lastConvertUs = rtc::TimeMicros() - convertStarted;
+    _stats.averageConvertMs = SmoothTiming(
+        _stats.averageConvertMs,
+        _lastConvertUs / 1000.);
+    if (!buffer) {
+        return;
+    }
 
-	int width = outputFrame.size().width();
-	int height = outputFrame.size().height();
-	int stride_y = width;
-	int stride_uv = (width + 1) / 2;
+    _lastFrameHadChanges = !updateRect.IsEmpty();
 
-	if (!i420_buffer_
-        || i420_buffer_->width() != width
-        || i420_buffer_->height() != height) {
-		i420_buffer_ = webrtc::I420Buffer::Create(
-            width,
-            height,
-            stride_y,
-            stride_uv,
-            stride_uv);
-	}
+    const auto now = rtc::TimeMillis();
+    if (_adaptive
+        && !_lastFrameHadChanges
+        && now - _lastDeliveredMs < kIdleKeepAliveMs) {
+        ++_stats.skippedFrames;
+        return;
+    }
+    _lastDeliveredMs = now;
+    ++_stats.deliveredFrames;
 
-	int i420Result = libyuv::ConvertToI420(
-        outputFrame.data(),
-		width * height,
-		i420_buffer_->MutableDataY(), i420_buffer_->StrideY(),
-		i420_buffer_->MutableDataU(), i420_buffer_->StrideU(),
-		i420_buffer_->MutableDataV(), i420_buffer_->StrideV(),
-		0, 0,
-		width, height,
-		width, height,
-		libyuv::kRotate0,
-		libyuv::FOURCC_ARGB);
-
-
-	assert(i420Result == 0);
-	(void)i420Result;
 	webrtc::VideoFrame nativeVideoFrame = webrtc::VideoFrame(
-		i420_buffer_,
+		buffer,
 		webrtc::kVideoRotation_0,
         webrtc::Clock::GetRealTimeClock()->CurrentTime().us());
+	nativeVideoFrame.set_update_rect(updateRect);
 	if (const auto sink = _sink.get()) {
 		_sink->OnFrame(nativeVideoFrame);
 	}
@@ -236,6 +414,27 @@ void SourceFrameCallbackImpl::setOutput(
     _sink = std::move(sink);
 }
 
+void SourceFrameCallbackImpl::setAdaptive(bool adaptive) {
+    _adaptive = adaptive;
+}
+
+bool SourceFrameCallbackImpl::lastFrameHadChanges() const {
+    return _lastFrameHadChanges;
+}
+
+void SourceFrameCallbackImpl::addCaptureTiming(int64_t captureUs) {
+    // CaptureFrame() delivers the result synchronously, conversion included.
+    const auto ownUs = std::max(captureUs - _lastConvertUs, int64_t(0));
+    _stats.averageCaptureMs = SmoothTiming(
+        _stats.averageCaptureMs,
+        ownUs / 1000.);
+    _lastConvertUs = 0;
+}
+
+DesktopCaptureStats &SourceFrameCallbackImpl::stats() {
+    return _stats;
+}
+
 void SourceFrameCallbackImpl::setOnFatalError(std::function<void ()> error) {
     _onFatalError = error;
 }
@@ -254,7 +453,11 @@ DesktopSourceRenderer::DesktopSourceRenderer(
     DesktopCaptureSourceData data)
 : _scheduler(scheduler)
 , _callback(data.aspectSize, data.fps)
+, _adaptiveFps(data.adaptiveFps)
+, _baseDelayMs(1000. / data.fps)
 , _delayMs(1000. / data.fps) {
+    _callback.setAdaptive(_adaptiveFps);
+
 	_callback.setOnFatalError([=] {
 		stop();
 		_fatalError = true;
@@ -331,7 +534,18 @@ void DesktopSourceRenderer::loop() {
         return;
     }
 
+    const auto captureStarted = rtc::TimeMicros();
     _capturer->CaptureFrame();
+    _callback.addCaptureTiming(rtc::TimeMicros() - captureStarted);
+
+    if (_adaptiveFps) {
+        _delayMs = _callback.lastFrameHadChanges()
+            ? _baseDelayMs
+            : std::min(
+                _delayMs * kIdleDelayFactor,
+                std::max(kMaxIdleDelayMs, _baseDelayMs));
+    }
+
     const auto guard = std::weak_ptr<bool>(_timerGuard);
     _scheduler.runDelayed(_delayMs, [=] {
         if (guard.lock()) {
@@ -340,6 +554,12 @@ void DesktopSourceRenderer::loop() {
     });
 }
 
+DesktopCaptureStats DesktopSourceRenderer::stats() {
+    auto result = _callback.stats();
+    result.currentFps = _isRunning ? (1000. / _delayMs) : 0.;
+    return result;
+}
+
 void DesktopSourceRenderer::setOnFatalError(std::function<void ()> error) {
     if (_fatalError) {
         error();
@@ -450,6 +670,12 @@ void DesktopCaptureSourceHelper::setOnPause(std::function<void (bool)> pause) co
     });
 }
 
+void DesktopCaptureSourceHelper::getStats(std::function<void (DesktopCaptureStats)> callback) const {
+    _renderer->scheduler.runAsync([renderer = _renderer, callback = callback] {
+        callback(renderer->renderer->stats());
+    });
+}
+
 void DesktopCaptureSourceHelper::stop() const {
 	_renderer->scheduler.runAsync([renderer = _renderer] {
 		renderer->renderer->stop();
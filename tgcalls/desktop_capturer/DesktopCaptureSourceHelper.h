@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <functional>
+#include <cstdint>
 
 namespace webrtc {
 class VideoFrame;
@@ -24,6 +25,15 @@ class VideoSinkInterface;
 
 namespace tgcalls {
 
+struct DesktopCaptureStats {
+	int64_t capturedFrames = 0;
+	int64_t deliveredFrames = 0;
+	int64_t skippedFrames = 0;
+	double averageCaptureMs = 0.;
+	double averageConvertMs = 0.;
+	double currentFps = 0.;
+};
+
 DesktopCaptureSource DesktopCaptureSourceForKey(
 	const std::string &uniqueKey);
 bool ShouldBeDesktopCapture(const std::string &uniqueKey);
@@ -45,6 +55,7 @@ public:
 	void stop() const;
     void setOnFatalError(std::function<void ()>) const;
     void setOnPause(std::function<void (bool)>) const;
+    void getStats(std::function<void (DesktopCaptureStats)>) const;
 private:
 	struct Renderer;
 	std::shared_ptr<Renderer> _renderer;
@@ -15,13 +15,13 @@ namespace {
 int AVIOContextImplRead(void *opaque, unsigned char *buffer, int bufferSize) {
     AVIOContextImpl *instance = static_cast<AVIOContextImpl *>(opaque);
 
-    int bytesToRead = std::min(bufferSize, ((int)instance->_fileData.size()) - instance->_fileReadPosition);
+    int bytesToRead = std::min(bufferSize, instance->_fileSize - instance->_fileReadPosition);
     if (bytesToRead < 0) {
         bytesToRead = 0;
     }
 
     if (bytesToRead > 0) {
-        memcpy(buffer, instance->_fileData.data() + instance->_fileReadPosition, bytesToRead);
+        memcpy(buffer, instance->_fileBytes + instance->_fileReadPosition, bytesToRead);
         instance->_fileReadPosition += bytesToRead;
 
         return bytesToRead;
@@ -34,9 +34,9 @@ int64_t AVIOContextImplSeek(void *opaque, int64_t offset, int whence) {
     AVIOContextImpl *instance = static_cast<AVIOContextImpl *>(opaque);
 
     if (whence == 0x10000) {
-        return (int64_t)instance->_fileData.size();
+        return (int64_t)instance->_fileSize;
     } else {
-        int64_t seekOffset = std::min(offset, (int64_t)instance->_fileData.size());
+        int64_t seekOffset = std::min(offset, (int64_t)instance->_fileSize);
         if (seekOffset < 0) {
             seekOffset = 0;
         }
@@ -48,7 +48,21 @@ int64_t AVIOContextImplSeek(void *opaque, int64_t offset, int whence) {
 }
 
 AVIOContextImpl::AVIOContextImpl(std::vector<uint8_t> &&fileData) :
+_fileData(std::make_shared<StreamingPartVectorData>(std::move(fileData))) {
+    initialize(0, _fileData->size());
+}
+
+AVIOContextImpl::AVIOContextImpl(std::shared_ptr<StreamingPartData> fileData, size_t offset, size_t length) :
 _fileData(std::move(fileData)) {
+    initialize(offset, length);
+}
+
+void AVIOContextImpl::initialize(size_t offset, size_t length) {
+    if (_fileData && offset + length <= _fileData->size()) {
+        _fileBytes = _fileData->data() + offset;
+        _fileSize = (int)length;
+    }
+
     _buffer.resize(4 * 1024);
     _context = avio_alloc_context(_buffer.data(), (int)_buffer.size(), 0, this, &AVIOContextImplRead, NULL, &AVIOContextImplSeek);
 }
@@ -3,11 +3,14 @@
 
 #include "absl/types/optional.h"
 #include <vector>
+#include <memory>
 #include <stdint.h>
 
 #include "api/video/video_frame.h"
 #include "absl/types/optional.h"
 
+#include "StreamingPartData.h"
+
 // Fix build on Windows - this should appear before FFmpeg timestamp include.
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -23,12 +26,18 @@ namespace tgcalls {
 class AVIOContextImpl {
 public:
     AVIOContextImpl(std::vector<uint8_t> &&fileData);
+    AVIOContextImpl(std::shared_ptr<StreamingPartData> fileData, size_t offset, size_t length);
     ~AVIOContextImpl();
 
     AVIOContext *getContext() const;
 
+private:
+    void initialize(size_t offset, size_t length);
+
 public:
-    std::vector<uint8_t> _fileData;
+    std::shared_ptr<StreamingPartData> _fileData;
+    uint8_t const *_fileBytes = nullptr;
+    int _fileSize = 0;
     int _fileReadPosition = 0;
 
     std::vector<uint8_t> _buffer;
@@ -7,8 +7,9 @@
 
 #include <string>
 #include <bitset>
-#include <set>
 #include <map>
+#include <algorithm>
+#include <cstring>
 
 namespace tgcalls {
 
@@ -26,16 +27,13 @@ public:
     AudioStreamingPartState(std::vector<uint8_t> &&data, std::string const &container, bool isSingleChannel) :
     _isSingleChannel(isSingleChannel),
     _parsedPart(std::move(data), container) {
-        if (_parsedPart.getChannelUpdates().size() == 0 && !isSingleChannel) {
-            _didReadToEnd = true;
-            return;
-        }
-
-        _remainingMilliseconds = _parsedPart.getDurationInMilliseconds();
+        initialize();
+    }
 
-        for (const auto &it : _parsedPart.getChannelUpdates()) {
-            _allSsrcs.insert(it.ssrc);
-        }
+    AudioStreamingPartState(std::shared_ptr<StreamingPartData> data, size_t offset, size_t length, std::string const &container, bool isSingleChannel) :
+    _isSingleChannel(isSingleChannel),
+    _parsedPart(std::move(data), offset, length, container) {
+        initialize();
     }
 
     ~AudioStreamingPartState() {
@@ -49,9 +47,9 @@ public:
         return _remainingMilliseconds;
     }
 
-    std::vector<AudioStreamingPart::StreamingPartChannel> get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder) {
+    bool get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<AudioStreamingPart::StreamingPartChannel> &channels) {
         if (_didReadToEnd) {
-            return {};
+            return false;
         }
 
         for (const auto &update : _parsedPart.getChannelUpdates()) {
@@ -63,44 +61,18 @@ public:
         auto readResult = _parsedPart.readPcm(persistentDecoder, _pcm10ms);
         if (readResult.numSamples <= 0) {
             _didReadToEnd = true;
-            return {};
+            return false;
         }
 
-        std::vector<AudioStreamingPart::StreamingPartChannel> resultChannels;
-
         if (_isSingleChannel) {
-            AudioStreamingPart::StreamingPartChannel singlePart;
-            singlePart.ssrc = 1;
-
-            for (int j = 0; j < readResult.numSamples; j++) {
-                singlePart.pcmData.push_back(_pcm10ms[j * readResult.numChannels]);
-            }
-            
-            singlePart.numSamples += readResult.numSamples;
-            
-            resultChannels.push_back(std::move(singlePart));
+            channels.resize(1);
+            channels[0].ssrc = 1;
+            copyChannel(0, readResult.numSamples, readResult.numChannels, channels[0]);
         } else {
-            for (const auto ssrc : _allSsrcs) {
-                AudioStreamingPart::StreamingPartChannel emptyPart;
-                emptyPart.ssrc = ssrc;
-                resultChannels.push_back(emptyPart);
-            }
-
-            for (auto &channel : resultChannels) {
-                auto mappedChannelIndex = getCurrentMappedChannelIndex(channel.ssrc);
-
-                if (mappedChannelIndex) {
-                    int sourceChannelIndex = mappedChannelIndex.value();
-                    for (int j = 0; j < readResult.numSamples; j++) {
-                        channel.pcmData.push_back(_pcm10ms[sourceChannelIndex + j * readResult.numChannels]);
-                    }
-                    channel.numSamples += readResult.numSamples;
-                } else {
-                    for (int j = 0; j < readResult.numSamples; j++) {
-                        channel.pcmData.push_back(0);
-                    }
-                    channel.numSamples += readResult.numSamples;
-                }
+            channels.resize(_allSsrcs.size());
+            for (size_t i = 0; i < _allSsrcs.size(); i++) {
+                channels[i].ssrc = _allSsrcs[i];
+                copyChannel(_mappedChannelIndices[i], readResult.numSamples, readResult.numChannels, channels[i]);
             }
         }
 
@@ -110,17 +82,42 @@ public:
         }
         _frameIndex++;
 
-        return resultChannels;
+        return true;
     }
 
 private:
-    absl::optional<int> getCurrentMappedChannelIndex(uint32_t ssrc) {
-        for (const auto &it : _currentChannelMapping) {
-            if (it.ssrc == ssrc) {
-                return it.channelIndex;
+    void initialize() {
+        if (_parsedPart.getChannelUpdates().size() == 0 && !_isSingleChannel) {
+            _didReadToEnd = true;
+            return;
+        }
+
+        _remainingMilliseconds = _parsedPart.getDurationInMilliseconds();
+
+        for (const auto &it : _parsedPart.getChannelUpdates()) {
+            _allSsrcs.push_back(it.ssrc);
+        }
+        std::sort(_allSsrcs.begin(), _allSsrcs.end());
+        _allSsrcs.erase(std::unique(_allSsrcs.begin(), _allSsrcs.end()), _allSsrcs.end());
+        _mappedChannelIndices.resize(_allSsrcs.size(), -1);
+    }
+
+    // Writes one channel of the interleaved pcm to `channel`, or silence if
+    // `channelIndex` is not in it. Reuses the buffer the caller passed in.
+    void copyChannel(int channelIndex, int numSamples, int numChannels, AudioStreamingPart::StreamingPartChannel &channel) {
+        channel.numSamples = numSamples;
+        channel.pcmData.resize(numSamples);
+        int16_t *samples = channel.pcmData.data();
+        if (channelIndex < 0 || channelIndex >= numChannels) {
+            memset(samples, 0, numSamples * sizeof(int16_t));
+        } else if (numChannels == 1) {
+            memcpy(samples, _pcm10ms.data(), numSamples * sizeof(int16_t));
+        } else {
+            const int16_t *source = _pcm10ms.data() + channelIndex;
+            for (int j = 0; j < numSamples; j++) {
+                samples[j] = source[j * numChannels];
             }
         }
-        return absl::nullopt;
     }
 
     void updateCurrentMapping(uint32_t ssrc, int channelIndex) {
@@ -133,12 +130,22 @@ private:
             }
         }
         _currentChannelMapping.emplace_back(ssrc, channelIndex);
+
+        std::fill(_mappedChannelIndices.begin(), _mappedChannelIndices.end(), -1);
+        for (const auto &entry : _currentChannelMapping) {
+            const auto it = std::lower_bound(_allSsrcs.begin(), _allSsrcs.end(), entry.ssrc);
+            if (it != _allSsrcs.end() && *it == entry.ssrc) {
+                _mappedChannelIndices[it - _allSsrcs.begin()] = entry.channelIndex;
+            }
+        }
     }
 
 private:
     bool _isSingleChannel = false;
     AudioStreamingPartInternal _parsedPart;
-    std::set<uint32_t> _allSsrcs;
+    // Sorted, with the channel each one is currently mapped to (or -1) at the same index.
+    std::vector<uint32_t> _allSsrcs;
+    std::vector<int> _mappedChannelIndices;
 
     std::vector<int16_t> _pcm10ms;
     std::vector<ChannelMapping> _currentChannelMapping;
@@ -154,6 +161,12 @@ AudioStreamingPart::AudioStreamingPart(std::vector<uint8_t> &&data, std::string
     }
 }
 
+AudioStreamingPart::AudioStreamingPart(std::shared_ptr<StreamingPartData> data, size_t offset, size_t length, std::string const &container, bool isSingleChannel) {
+    if (data && length != 0) {
+        _state = new AudioStreamingPartState(std::move(data), offset, length, container, isSingleChannel);
+    }
+}
+
 AudioStreamingPart::~AudioStreamingPart() {
     if (_state) {
         delete _state;
@@ -169,9 +182,17 @@ int AudioStreamingPart::getRemainingMilliseconds() const {
 }
 
 std::vector<AudioStreamingPart::StreamingPartChannel> AudioStreamingPart::get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder) {
-    return _state
-        ? _state->get10msPerChannel(persistentDecoder)
-        : std::vector<AudioStreamingPart::StreamingPartChannel>();
+    std::vector<AudioStreamingPart::StreamingPartChannel> channels;
+    get10msPerChannel(persistentDecoder, channels);
+    return channels;
+}
+
+bool AudioStreamingPart::get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<StreamingPartChannel> &channels) {
+    if (!_state || !_state->get10msPerChannel(persistentDecoder, channels)) {
+        channels.clear();
+        return false;
+    }
+    return true;
 }
 
 }
@@ -8,6 +8,7 @@
 #include <stdint.h>
 
 #include "AudioStreamingPartPersistentDecoder.h"
+#include "StreamingPartData.h"
 
 namespace tgcalls {
 
@@ -22,6 +23,7 @@ public:
     };
     
     explicit AudioStreamingPart(std::vector<uint8_t> &&data, std::string const &container, bool isSingleChannel);
+    explicit AudioStreamingPart(std::shared_ptr<StreamingPartData> data, size_t offset, size_t length, std::string const &container, bool isSingleChannel);
     ~AudioStreamingPart();
     
     AudioStreamingPart(const AudioStreamingPart&) = delete;
@@ -35,6 +37,9 @@ public:
     std::map<std::string, int32_t> getEndpointMapping() const;
     int getRemainingMilliseconds() const;
     std::vector<StreamingPartChannel> get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder);
+    // Same, but reuses `channels` and the sample buffers already in it. Returns
+    // false, leaving it empty, once the part is over.
+    bool get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<StreamingPartChannel> &channels);
     
 private:
     AudioStreamingPartState *_state = nullptr;
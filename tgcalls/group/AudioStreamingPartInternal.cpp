@@ -1,6 +1,7 @@
 #include "AudioStreamingPartInternal.h"
 
 #include "rtc_base/logging.h"
+#include "rtc_base/checks.h"
 #include "rtc_base/third_party/base64/base64.h"
 
 extern "C" {
@@ -13,15 +14,181 @@ extern "C" {
 #include <bitset>
 #include <set>
 #include <map>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TGCALLS_PCM_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define TGCALLS_PCM_NEON 1
+#include <arm_neon.h>
+#endif
 
 namespace tgcalls {
 
 namespace {
 
-int16_t sampleFloatToInt16(float sample) {
+// The original conversion, kept as the reference the kernels are checked
+// against. Only defined while lrint's result fits, that is for finite samples
+// below 65536 in magnitude.
+int16_t referenceSampleFloatToInt16(float sample) {
   return av_clip_int16 (static_cast<int32_t>(lrint(sample*32767)));
 }
 
+// Same results as the reference wherever that is defined. Larger samples and
+// infinities clip, NaN is silence.
+int16_t sampleFloatToInt16(float sample) {
+    const float scaled = sample * 32767;
+    if (scaled != scaled) {
+        return 0;
+    }
+    return static_cast<int16_t>(lrintf(std::min(std::max(scaled, -32768.0f), 32767.0f)));
+}
+
+// Same results as sampleFloatToInt16 for every sample: all paths round to
+// nearest even, and clamping before or after rounding makes no difference.
+void samplesFloatToInt16(const float *from, int16_t *to, int count) {
+    int i = 0;
+#if TGCALLS_PCM_SSE2
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 minValue = _mm_set1_ps(-32768.0f);
+    const __m128 maxValue = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128 first = _mm_mul_ps(_mm_loadu_ps(from + i), scale);
+        __m128 second = _mm_mul_ps(_mm_loadu_ps(from + i + 4), scale);
+        // NaN lanes become zero, max_ps would turn them into the minimum.
+        first = _mm_and_ps(first, _mm_cmpord_ps(first, first));
+        second = _mm_and_ps(second, _mm_cmpord_ps(second, second));
+        first = _mm_min_ps(_mm_max_ps(first, minValue), maxValue);
+        second = _mm_min_ps(_mm_max_ps(second, minValue), maxValue);
+        const __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(first), _mm_cvtps_epi32(second));
+        _mm_storeu_si128((__m128i *)(to + i), packed);
+    }
+#elif TGCALLS_PCM_NEON
+    const float32x4_t minValue = vdupq_n_f32(-32768.0f);
+    const float32x4_t maxValue = vdupq_n_f32(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        float32x4_t first = vmulq_n_f32(vld1q_f32(from + i), 32767.0f);
+        float32x4_t second = vmulq_n_f32(vld1q_f32(from + i + 4), 32767.0f);
+        // NaN stays NaN through the clamp and vcvtnq turns it into zero.
+        first = vminq_f32(vmaxq_f32(first, minValue), maxValue);
+        second = vminq_f32(vmaxq_f32(second, minValue), maxValue);
+        const int16x8_t packed = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(first)), vqmovn_s32(vcvtnq_s32_f32(second)));
+        vst1q_s16(to + i, packed);
+    }
+#endif
+    for (; i < count; i++) {
+        to[i] = sampleFloatToInt16(from[i]);
+    }
+}
+
+void interleaveInt16(const int16_t *const *planes, int count, int channels, int16_t *to) {
+    if (channels == 1) {
+        memcpy(to, planes[0], count * sizeof(int16_t));
+    } else if (channels == 2) {
+        const int16_t *left = planes[0];
+        const int16_t *right = planes[1];
+        for (int i = 0; i < count; i++) {
+            to[2 * i] = left[i];
+            to[2 * i + 1] = right[i];
+        }
+    } else {
+        for (int channel = 0; channel < channels; channel++) {
+            const int16_t *plane = planes[channel];
+            for (int i = 0; i < count; i++) {
+                to[i * channels + channel] = plane[i];
+            }
+        }
+    }
+}
+
+#if RTC_DCHECK_IS_ON
+// Checks the kernels against the scalar reference on the values that tell
+// them apart, at every start offset and tail length around the vector width.
+bool checkSampleConversionKernels() {
+    std::vector<float> samples = {
+        0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f,
+        1.0f + FLT_EPSILON, -1.0f - FLT_EPSILON, 1.5f, -2.0f, 1000.0f, -65535.0f,
+        FLT_MIN, -FLT_MIN, std::numeric_limits<float>::denorm_min()
+    };
+    // Rounding ties and their neighbours, in the middle and at both ends.
+    for (float tie : { 0.5f, 1.5f, 2.5f, 100.5f, 32765.5f, 32766.5f, 32767.5f, 32768.5f }) {
+        for (float sign : { 1.0f, -1.0f }) {
+            float sample = sign * tie / 32767;
+            sample = nextafterf(nextafterf(sample, -2.0f * sign), -2.0f * sign);
+            for (int step = 0; step < 5; step++) {
+                samples.push_back(sample);
+                sample = nextafterf(sample, 2.0f * sign);
+            }
+        }
+    }
+    // Outside of the reference's domain only the clipping is prescribed.
+    const std::vector<std::pair<float, int16_t>> undefinedSamples = {
+        { std::numeric_limits<float>::quiet_NaN(), 0 },
+        { -std::numeric_limits<float>::quiet_NaN(), 0 },
+        { std::numeric_limits<float>::infinity(), 32767 },
+        { -std::numeric_limits<float>::infinity(), -32768 },
+        { 65536.0f, 32767 },
+        { -1e30f, -32768 },
+        { FLT_MAX, 32767 }
+    };
+
+    // The undefined samples go first, so the short runs put them in vector lanes too.
+    std::vector<float> from;
+    std::vector<int16_t> expected;
+    for (const auto &sample : undefinedSamples) {
+        from.push_back(sample.first);
+        expected.push_back(sample.second);
+    }
+    for (const auto sample : samples) {
+        from.push_back(sample);
+        expected.push_back(referenceSampleFloatToInt16(sample));
+    }
+
+    const int count = (int)from.size();
+    std::vector<int16_t> to(count);
+    for (int offset = 0; offset < 8; offset++) {
+        for (int length = 0; length <= 17 && offset + length <= count; length++) {
+            samplesFloatToInt16(from.data() + offset, to.data(), length);
+            if (!std::equal(to.begin(), to.begin() + length, expected.begin() + offset)) {
+                return false;
+            }
+        }
+        samplesFloatToInt16(from.data() + offset, to.data(), count - offset);
+        if (!std::equal(to.begin(), to.begin() + count - offset, expected.begin() + offset)) {
+            return false;
+        }
+    }
+
+    for (int channels = 1; channels <= 3; channels++) {
+        for (int length = 1; length <= 17; length += 2) {
+            std::vector<std::vector<int16_t>> planeData(channels);
+            std::vector<const int16_t *> planes;
+            for (int channel = 0; channel < channels; channel++) {
+                for (int i = 0; i < length; i++) {
+                    planeData[channel].push_back((int16_t)(channel * 1000 + i));
+                }
+                planes.push_back(planeData[channel].data());
+            }
+            std::vector<int16_t> interleaved(length * channels);
+            interleaveInt16(planes.data(), length, channels, interleaved.data());
+            for (int i = 0; i < length; i++) {
+                for (int channel = 0; channel < channels; channel++) {
+                    if (interleaved[i * channels + channel] != planeData[channel][i]) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+#endif
+
 uint32_t stringToUInt32(std::string const &string) {
     std::stringstream stringStream(string);
     uint32_t value = 0;
@@ -100,6 +267,20 @@ std::vector<AudioStreamingPartInternal::ChannelUpdate> parseChannelUpdates(std::
 
 AudioStreamingPartInternal::AudioStreamingPartInternal(std::vector<uint8_t> &&fileData, std::string const &container) :
 _avIoContext(std::move(fileData)) {
+    open(container);
+}
+
+AudioStreamingPartInternal::AudioStreamingPartInternal(std::shared_ptr<StreamingPartData> fileData, size_t offset, size_t length, std::string const &container) :
+_avIoContext(std::move(fileData), offset, length) {
+    open(container);
+}
+
+void AudioStreamingPartInternal::open(std::string const &container) {
+#if RTC_DCHECK_IS_ON
+    static const bool areSampleConversionKernelsValid = checkSampleConversionKernels();
+    RTC_DCHECK(areSampleConversionKernelsValid);
+#endif
+
     int ret = 0;
 
     _frame = av_frame_alloc();
@@ -320,30 +501,33 @@ void AudioStreamingPartInternal::fillPcmBuffer(AudioStreamingPartPersistentDecod
     } break;
 
     case AV_SAMPLE_FMT_S16P: {
-        int16_t *to = _pcmBuffer.data();
-        for (int sample = 0; sample < _frame->nb_samples; ++sample) {
-            for (int channel = 0; channel < _frame->channels; ++channel) {
-                int16_t *shortChannel = (int16_t*)_frame->data[channel];
-                *to++ = shortChannel[sample];
-            }
-        }
+        interleaveInt16((const int16_t *const *)_frame->data, _frame->nb_samples, _frame->channels, _pcmBuffer.data());
     } break;
 
     case AV_SAMPLE_FMT_FLT: {
-		float *floatData = (float *)&_frame->data[0];
-		for (int i = 0; i < _frame->nb_samples * _frame->channels; i++) {
-			_pcmBuffer[i] = sampleFloatToInt16(floatData[i]);
-		}
+        samplesFloatToInt16((const float *)_frame->data[0], _pcmBuffer.data(), _frame->nb_samples * _frame->channels);
     } break;
 
     case AV_SAMPLE_FMT_FLTP: {
-		int16_t *to = _pcmBuffer.data();
-		for (int sample = 0; sample < _frame->nb_samples; ++sample) {
-			for (int channel = 0; channel < _frame->channels; ++channel) {
-				float *floatChannel = (float*)_frame->data[channel];
-				*to++ = sampleFloatToInt16(floatChannel[sample]);
-			}
-		}
+        if (_frame->channels == 1) {
+            samplesFloatToInt16((const float *)_frame->data[0], _pcmBuffer.data(), _frame->nb_samples);
+            break;
+        }
+        // Each plane is converted a block at a time into scratch space that
+        // stays in cache, then the blocks are interleaved.
+        int16_t scratch[8 * 256];
+        const int blockSize = (int)(sizeof(scratch) / sizeof(scratch[0])) / _frame->channels;
+        const int16_t *planes[8];
+        for (int channel = 0; channel < _frame->channels; channel++) {
+            planes[channel] = scratch + channel * blockSize;
+        }
+        for (int offset = 0; offset < _frame->nb_samples; offset += blockSize) {
+            const int count = std::min(blockSize, _frame->nb_samples - offset);
+            for (int channel = 0; channel < _frame->channels; channel++) {
+                samplesFloatToInt16((const float *)_frame->data[channel] + offset, scratch + channel * blockSize, count);
+            }
+            interleaveInt16(planes, count, _frame->channels, _pcmBuffer.data() + offset * _frame->channels);
+        }
     } break;
 
     default: {
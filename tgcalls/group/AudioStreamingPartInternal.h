@@ -27,6 +27,7 @@ public:
 
 public:
     AudioStreamingPartInternal(std::vector<uint8_t> &&fileData, std::string const &container);
+    AudioStreamingPartInternal(std::shared_ptr<StreamingPartData> fileData, size_t offset, size_t length, std::string const &container);
     ~AudioStreamingPartInternal();
 
     ReadPcmResult readPcm(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<int16_t> &outPcm);
@@ -36,6 +37,7 @@ public:
     std::map<std::string, int32_t> getEndpointMapping() const;
 
 private:
+    void open(std::string const &container);
     void fillPcmBuffer(AudioStreamingPartPersistentDecoder &persistentDecoder);
 
 private:
@@ -55,6 +57,7 @@ private:
     std::vector<ChannelUpdate> _channelUpdates;
     std::map<std::string, int32_t> _endpointMapping;
 
+    // Only grows, to the largest frame seen.
     std::vector<int16_t> _pcmBuffer;
     int _pcmBufferSampleOffset = 0;
     int _pcmBufferSampleSize = 0;
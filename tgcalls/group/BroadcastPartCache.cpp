@@ -0,0 +1,369 @@
+#include "BroadcastPartCache.h"
+
+#include "rtc_base/logging.h"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include "windows.h"
+#else // _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace tgcalls {
+
+namespace {
+
+using PathString = decltype(FilePath::data);
+
+PathString toPathString(std::string const &value) {
+    return PathString(value.begin(), value.end());
+}
+
+PathString appendPathComponent(PathString const &directory, std::string const &component) {
+    PathString result = directory;
+    if (!result.empty() && result.back() != '/' && result.back() != '\\') {
+        result.push_back('/');
+    }
+    result.append(toPathString(component));
+    return result;
+}
+
+FILE *openFile(PathString const &path, bool write) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+    return fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+bool removeFile(PathString const &path) {
+#ifdef _WIN32
+    return _wremove(path.c_str()) == 0;
+#else
+    return remove(path.c_str()) == 0;
+#endif
+}
+
+bool replaceFile(PathString const &from, PathString const &to) {
+#ifdef _WIN32
+    return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+#ifndef _WIN32
+class MappedFileData final : public StreamingPartData {
+public:
+    MappedFileData(void *mapping, size_t size) :
+    _mapping(mapping),
+    _size(size) {
+    }
+
+    ~MappedFileData() {
+        munmap(_mapping, _size);
+    }
+
+    uint8_t const *data() const override {
+        return (uint8_t const *)_mapping;
+    }
+
+    size_t size() const override {
+        return _size;
+    }
+
+private:
+    void *_mapping = nullptr;
+    size_t _size = 0;
+};
+#endif // _WIN32
+
+std::shared_ptr<StreamingPartData> readFile(PathString const &path) {
+#ifdef _WIN32
+    FILE *file = openFile(path, false);
+    if (!file) {
+        return nullptr;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[16 * 1024];
+    while (true) {
+        size_t readBytes = fread(buffer, 1, sizeof(buffer), file);
+        if (readBytes == 0) {
+            break;
+        }
+        data.insert(data.end(), buffer, buffer + readBytes);
+    }
+    fclose(file);
+    if (data.empty()) {
+        return nullptr;
+    }
+    return std::make_shared<StreamingPartVectorData>(std::move(data));
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    size_t size = (size_t)fileStat.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed and after the file is evicted.
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    return std::make_shared<MappedFileData>(mapping, size);
+#endif
+}
+
+}
+
+bool BroadcastPartCache::Key::operator <(const Key& rhs) const {
+    if (isVideo != rhs.isVideo) {
+        return isVideo < rhs.isVideo;
+    }
+    if (timestampMilliseconds != rhs.timestampMilliseconds) {
+        return timestampMilliseconds < rhs.timestampMilliseconds;
+    }
+    if (durationMilliseconds != rhs.durationMilliseconds) {
+        return durationMilliseconds < rhs.durationMilliseconds;
+    }
+    if (channelId != rhs.channelId) {
+        return channelId < rhs.channelId;
+    }
+    return quality < rhs.quality;
+}
+
+std::string BroadcastPartCache::Key::fileName() const {
+    std::ostringstream stringStream;
+    if (isVideo) {
+        stringStream << "v_" << timestampMilliseconds << "_" << durationMilliseconds << "_" << channelId << "_" << quality << ".part";
+    } else {
+        stringStream << "a_" << timestampMilliseconds << "_" << durationMilliseconds << ".part";
+    }
+    return stringStream.str();
+}
+
+bool BroadcastPartCache::Key::parseFileName(std::string const &fileName, Key &key) {
+    long long timestamp = 0;
+    long long duration = 0;
+    int channelId = 0;
+    int quality = 0;
+    char terminator = 0;
+
+    if (sscanf(fileName.c_str(), "v_%lld_%lld_%d_%d.par%c", &timestamp, &duration, &channelId, &quality, &terminator) == 5 && terminator == 't') {
+        key.isVideo = true;
+        key.channelId = channelId;
+        key.quality = quality;
+    } else if (sscanf(fileName.c_str(), "a_%lld_%lld.par%c", &timestamp, &duration, &terminator) == 3 && terminator == 't') {
+        key.isVideo = false;
+        key.channelId = 0;
+        key.quality = 0;
+    } else {
+        return false;
+    }
+    key.timestampMilliseconds = timestamp;
+    key.durationMilliseconds = duration;
+
+    return key.fileName() == fileName;
+}
+
+BroadcastPartCache::BroadcastPartCache(FilePath const &directory, int64_t maxSizeBytes) :
+_directory(directory),
+_maxSizeBytes(maxSizeBytes) {
+    loadIndex();
+}
+
+BroadcastPartCache::~BroadcastPartCache() {
+}
+
+std::shared_ptr<StreamingPartData> BroadcastPartCache::get(Key const &key) {
+    // Files written by other instances sharing the directory are picked up here as well.
+    auto data = readFile(pathForKey(key));
+
+    webrtc::MutexLock lock(&_mutex);
+    if (data) {
+        _stats.hits++;
+        touch(key, (int64_t)data->size());
+    } else {
+        _stats.misses++;
+        const auto it = _entries.find(key);
+        if (it != _entries.end()) {
+            _sizeBytes -= it->second.size;
+            _lru.erase(it->second.lruPosition);
+            _entries.erase(it);
+        }
+    }
+
+    return data;
+}
+
+void BroadcastPartCache::put(Key const &key, std::shared_ptr<StreamingPartData> const &data) {
+    if (!data || data->size() == 0) {
+        return;
+    }
+
+    uint32_t temporaryId = 0;
+    {
+        webrtc::MutexLock lock(&_mutex);
+        temporaryId = _nextTemporaryId++;
+    }
+
+    std::ostringstream temporaryName;
+    temporaryName << key.fileName() << ".tmp" << (uint64_t)(uintptr_t)this << "_" << temporaryId;
+    const auto temporaryPath = appendPathComponent(_directory.data, temporaryName.str());
+
+    FILE *file = openFile(temporaryPath, true);
+    if (!file) {
+        RTC_LOG(LS_WARNING) << "BroadcastPartCache: could not create " << key.fileName();
+        return;
+    }
+    bool isWritten = fwrite(data->data(), 1, data->size(), file) == data->size();
+    isWritten = (fclose(file) == 0) && isWritten;
+
+    // Publishing through a rename keeps readers from seeing partially written parts.
+    if (!isWritten || !replaceFile(temporaryPath, pathForKey(key))) {
+        RTC_LOG(LS_WARNING) << "BroadcastPartCache: could not store " << key.fileName();
+        removeFile(temporaryPath);
+        return;
+    }
+
+    webrtc::MutexLock lock(&_mutex);
+    touch(key, (int64_t)data->size());
+    evictIfNeeded();
+}
+
+BroadcastPartCache::Stats BroadcastPartCache::getStats() {
+    webrtc::MutexLock lock(&_mutex);
+    Stats result = _stats;
+    result.sizeBytes = _sizeBytes;
+    return result;
+}
+
+decltype(FilePath::data) BroadcastPartCache::pathForKey(Key const &key) const {
+    return appendPathComponent(_directory.data, key.fileName());
+}
+
+void BroadcastPartCache::loadIndex() {
+    struct IndexedFile {
+        Key key;
+        int64_t size = 0;
+        int64_t modificationTime = 0;
+    };
+    std::vector<IndexedFile> files;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAW findData;
+    HANDLE findHandle = FindFirstFileW(appendPathComponent(_directory.data, "*").c_str(), &findData);
+    if (findHandle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            continue;
+        }
+        // Names of cached parts are plain ASCII, anything else is not ours.
+        std::string fileName;
+        bool isAscii = true;
+        for (const wchar_t *c = findData.cFileName; *c; c++) {
+            if (*c > 0x7f) {
+                isAscii = false;
+                break;
+            }
+            fileName.push_back((char)*c);
+        }
+        Key key;
+        if (!isAscii || !Key::parseFileName(fileName, key)) {
+            continue;
+        }
+        const auto size = ((int64_t)findData.nFileSizeHigh << 32) | (int64_t)findData.nFileSizeLow;
+        if (size <= 0) {
+            continue;
+        }
+        IndexedFile file;
+        file.key = key;
+        file.size = size;
+        file.modificationTime = ((int64_t)findData.ftLastWriteTime.dwHighDateTime << 32) | (int64_t)findData.ftLastWriteTime.dwLowDateTime;
+        files.push_back(file);
+    } while (FindNextFileW(findHandle, &findData));
+    FindClose(findHandle);
+#else // _WIN32
+    DIR *directory = opendir(_directory.data.c_str());
+    if (!directory) {
+        return;
+    }
+
+    while (struct dirent *entry = readdir(directory)) {
+        Key key;
+        if (!Key::parseFileName(entry->d_name, key)) {
+            continue;
+        }
+        struct stat fileStat;
+        if (stat(pathForKey(key).c_str(), &fileStat) != 0 || fileStat.st_size <= 0) {
+            continue;
+        }
+        IndexedFile file;
+        file.key = key;
+        file.size = (int64_t)fileStat.st_size;
+        file.modificationTime = (int64_t)fileStat.st_mtime;
+        files.push_back(file);
+    }
+    closedir(directory);
+#endif // _WIN32
+
+    std::sort(files.begin(), files.end(), [](IndexedFile const &lhs, IndexedFile const &rhs) {
+        return lhs.modificationTime < rhs.modificationTime;
+    });
+
+    webrtc::MutexLock lock(&_mutex);
+    for (const auto &file : files) {
+        touch(file.key, file.size);
+    }
+    evictIfNeeded();
+}
+
+void BroadcastPartCache::touch(Key const &key, int64_t size) {
+    const auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        _sizeBytes += size - it->second.size;
+        it->second.size = size;
+        _lru.splice(_lru.begin(), _lru, it->second.lruPosition);
+    } else {
+        _lru.push_front(key);
+        Entry entry;
+        entry.size = size;
+        entry.lruPosition = _lru.begin();
+        _entries.insert(std::make_pair(key, entry));
+        _sizeBytes += size;
+    }
+}
+
+void BroadcastPartCache::evictIfNeeded() {
+    while (_sizeBytes > _maxSizeBytes && _lru.size() > 1) {
+        Key key = _lru.back();
+        _lru.pop_back();
+
+        const auto it = _entries.find(key);
+        if (it != _entries.end()) {
+            _sizeBytes -= it->second.size;
+            _entries.erase(it);
+        }
+
+        // Parts that are still being played keep their mapping alive.
+        removeFile(pathForKey(key));
+        _stats.evictions++;
+    }
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef TGCALLS_BROADCAST_PART_CACHE_H
+#define TGCALLS_BROADCAST_PART_CACHE_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+#include "rtc_base/synchronization/mutex.h"
+
+#include "../Instance.h"
+#include "StreamingPartData.h"
+
+namespace tgcalls {
+
+// On-disk cache of broadcast parts, shared between instances (and processes)
+// that point at the same directory. Each part is stored in a file named after
+// its request parameters; hits are memory-mapped where the platform allows it.
+class BroadcastPartCache {
+public:
+    struct Key {
+        bool isVideo = false;
+        int64_t timestampMilliseconds = 0;
+        int64_t durationMilliseconds = 0;
+        int32_t channelId = 0;
+        int32_t quality = 0;
+
+        bool operator <(const Key& rhs) const;
+        std::string fileName() const;
+        static bool parseFileName(std::string const &fileName, Key &key);
+    };
+
+    struct Stats {
+        int64_t hits = 0;
+        int64_t misses = 0;
+        int64_t evictions = 0;
+        int64_t sizeBytes = 0;
+    };
+
+public:
+    BroadcastPartCache(FilePath const &directory, int64_t maxSizeBytes);
+    ~BroadcastPartCache();
+
+    BroadcastPartCache(const BroadcastPartCache&) = delete;
+    BroadcastPartCache& operator=(const BroadcastPartCache&) = delete;
+
+    std::shared_ptr<StreamingPartData> get(Key const &key);
+    void put(Key const &key, std::shared_ptr<StreamingPartData> const &data);
+
+    Stats getStats();
+
+private:
+    struct Entry {
+        int64_t size = 0;
+        std::list<Key>::iterator lruPosition;
+    };
+
+    decltype(FilePath::data) pathForKey(Key const &key) const;
+    void loadIndex();
+    void touch(Key const &key, int64_t size);
+    void evictIfNeeded();
+
+private:
+    FilePath _directory;
+    int64_t _maxSizeBytes = 0;
+
+    webrtc::Mutex _mutex;
+    std::list<Key> _lru;
+    std::map<Key, Entry> _entries;
+    int64_t _sizeBytes = 0;
+    Stats _stats;
+    uint32_t _nextTemporaryId = 0;
+};
+
+}
+
+#endif
@@ -37,6 +37,7 @@
 #include "modules/audio_device/include/audio_device_data_observer.h"
 #include "common_audio/resampler/include/resampler.h"
 #include "modules/rtp_rtcp/source/rtp_util.h"
+#include "rtc_base/synchronization/mutex.h"
 
 #include "AudioFrame.h"
 #include "ThreadLocalObject.h"
@@ -45,17 +46,25 @@
 #include "VideoCaptureInterfaceImpl.h"
 #include "platform/PlatformInterface.h"
 #include "LogSinkImpl.h"
+#include "Metrics.h"
+#include "ThreadInstrumentation.h"
+#include "ExternalAudioSource.h"
 #include "CodecSelectHelper.h"
 #include "AudioStreamingPart.h"
 #include "VideoStreamingPart.h"
 #include "AudioDeviceHelper.h"
 #include "FakeAudioDeviceModule.h"
 #include "StreamingMediaContext.h"
+#include "SharedMediaFactories.h"
+#include "IncomingPacketQueue.h"
+#include "VideoSinkDelivery.h"
 #ifdef WEBRTC_IOS
 #include "platform/darwin/iOS/tgcalls_audio_device_module_ios.h"
 #endif
+#include <atomic>
 #include <mutex>
 #include <random>
+#include <thread>
 #include <sstream>
 #include <iostream>
 
@@ -373,6 +382,48 @@ struct InternalGroupLevelValue {
     int64_t timestamp = 0;
 };
 
+// Audio levels read from the RTP header extension on the network thread are
+// folded into a flat per-SSRC table there. The media thread takes the table
+// at the levels timer cadence instead of getting a task for every packet.
+class IncomingAudioLevels {
+public:
+    struct Entry {
+        uint32_t ssrc = 0;
+        // RFC 6464 levels are in -dBov, the loudest packet has the lowest value.
+        uint8_t audioLevel = 0;
+        bool isSpeech = false;
+    };
+
+    // Network thread.
+    void add(uint32_t ssrc, uint8_t audioLevel, bool isSpeech) {
+        webrtc::MutexLock lock(&_mutex);
+        for (auto &entry : _entries) {
+            if (entry.ssrc == ssrc) {
+                entry.audioLevel = std::min(entry.audioLevel, audioLevel);
+                entry.isSpeech = entry.isSpeech || isSpeech;
+                return;
+            }
+        }
+        Entry entry;
+        entry.ssrc = ssrc;
+        entry.audioLevel = audioLevel;
+        entry.isSpeech = isSpeech;
+        _entries.push_back(entry);
+    }
+
+    // Media thread. The tables are swapped, so once both have grown to the
+    // number of speakers neither side allocates.
+    void take(std::vector<Entry> &entries) {
+        entries.clear();
+        webrtc::MutexLock lock(&_mutex);
+        _entries.swap(entries);
+    }
+
+private:
+    webrtc::Mutex _mutex;
+    std::vector<Entry> _entries;
+};
+
 struct ChannelId {
   uint32_t networkSsrc = 0;
   uint32_t actualSsrc = 0;
@@ -437,6 +488,18 @@ struct RequestedMediaChannelDescriptions {
 
 static const int kVadResultHistoryLength = 8;
 
+static const char kGroupFieldTrials[] =
+    "WebRTC-Audio-Allocation/min:32kbps,max:32kbps/"
+    "WebRTC-Audio-OpusMinPacketLossRate/Enabled-1/"
+    "WebRTC-TaskQueuePacer/Enabled/"
+    "WebRTC-VP8ConferenceTemporalLayers/1/"
+    "WebRTC-Audio-MinimizeResamplingOnMobile/Enabled/"
+    "WebRTC-BweLossExperiment/Enabled/";
+
+// Unresolved packets beyond this are dropped while the media thread catches up,
+// _missingPacketBuffer only keeps a few per SSRC anyway.
+static const size_t kMaxPendingUnresolvedPackets = 1024;
+
 class VadHistory {
 private:
     float _vadResultHistory[kVadResultHistoryLength];
@@ -618,76 +681,172 @@ private:
 
 };
 
+struct IncomingVideoSink {
+    std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink;
+    VideoSinkOptions options;
+};
+
 class VideoSinkImpl : public rtc::VideoSinkInterface<webrtc::VideoFrame> {
 public:
-    VideoSinkImpl(std::string const &endpointId) :
-    _endpointId(endpointId) {
+    VideoSinkImpl(std::string const &endpointId, std::shared_ptr<SharedMediaFactories> mediaFactories = nullptr) :
+    _endpointId(endpointId),
+    _mediaFactories(mediaFactories) {
     }
 
     virtual ~VideoSinkImpl() {
     }
 
     virtual void OnFrame(const webrtc::VideoFrame& frame) override {
-        std::unique_lock<std::mutex> lock{ _mutex };
-        int64_t timestamp = rtc::TimeMillis();
-        if (_lastFrame) {
-            if (_lastFrame->video_frame_buffer()->width() != frame.video_frame_buffer()->width()) {
-                int64_t deltaTime = std::abs(_lastFrameSizeChangeTimestamp - timestamp);
-                if (deltaTime < 200) {
-                    RTC_LOG(LS_WARNING) << "VideoSinkImpl: frequent frame size change detected for " << _endpointId << ": " << _lastFrameSizeChangeHeight << " -> " << _lastFrame->video_frame_buffer()->height() << " -> " << frame.video_frame_buffer()->height() << " in " << deltaTime << " ms";
-                }
+        std::vector<std::shared_ptr<VideoSinkDelivery>> sinks;
+        int64_t sequence = 0;
+        {
+            std::unique_lock<std::mutex> lock{ _mutex };
+            int64_t timestamp = rtc::TimeMillis();
+            if (_lastFrame) {
+                if (_lastFrame->video_frame_buffer()->width() != frame.video_frame_buffer()->width()) {
+                    int64_t deltaTime = std::abs(_lastFrameSizeChangeTimestamp - timestamp);
+                    if (deltaTime < 200) {
+                        RTC_LOG(LS_WARNING) << "VideoSinkImpl: frequent frame size change detected for " << _endpointId << ": " << _lastFrameSizeChangeHeight << " -> " << _lastFrame->video_frame_buffer()->height() << " -> " << frame.video_frame_buffer()->height() << " in " << deltaTime << " ms";
+                    }
 
-                _lastFrameSizeChangeHeight = _lastFrame->video_frame_buffer()->height();
+                    _lastFrameSizeChangeHeight = _lastFrame->video_frame_buffer()->height();
+                    _lastFrameSizeChangeTimestamp = timestamp;
+                }
+            } else {
+                _lastFrameSizeChangeHeight = 0;
                 _lastFrameSizeChangeTimestamp = timestamp;
             }
-        } else {
-            _lastFrameSizeChangeHeight = 0;
-            _lastFrameSizeChangeTimestamp = timestamp;
+            _lastFrame = frame;
+            sequence = ++_lastFrameSequence;
+            sinks = _sinks;
         }
-        _lastFrame = frame;
-        for (int i = (int)(_sinks.size()) - 1; i >= 0; i--) {
-            auto strong = _sinks[i].lock();
-            if (!strong) {
-                _sinks.erase(_sinks.begin() + i);
-            } else {
-                strong->OnFrame(frame);
+
+        // Sinks are called without the lock, a slow one must not block addSink.
+        // Each delivery keeps its sink's frames in order.
+        const auto frames = std::make_shared<ScaledVideoFrames>(frame, sequence);
+        std::vector<VideoSinkDelivery*> expired;
+        for (const auto &sink : sinks) {
+            if (!sink->deliver(frames)) {
+                expired.push_back(sink.get());
             }
         }
+        removeSinks(expired);
     }
 
     virtual void OnDiscardedFrame() override {
-        std::unique_lock<std::mutex> lock{ _mutex };
-        for (int i = (int)(_sinks.size()) - 1; i >= 0; i--) {
-            auto strong = _sinks[i].lock();
-            if (!strong) {
-                _sinks.erase(_sinks.begin() + i);
-            } else {
-                strong->OnDiscardedFrame();
+        std::vector<std::shared_ptr<VideoSinkDelivery>> sinks;
+        {
+            std::unique_lock<std::mutex> lock{ _mutex };
+            sinks = _sinks;
+        }
+
+        std::vector<VideoSinkDelivery*> expired;
+        for (const auto &sink : sinks) {
+            if (!sink->deliverDiscarded()) {
+                expired.push_back(sink.get());
             }
         }
+        removeSinks(expired);
     }
 
-    void addSink(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> impl) {
-        if (const auto strong = impl.lock()) {
+    void addSink(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> impl, VideoSinkOptions const &options = VideoSinkOptions()) {
+        if (impl.expired()) {
+            return;
+        }
+        const auto queue = (options.deliverAsync && _mediaFactories) ? _mediaFactories->videoSinkDeliveryQueues()->next() : nullptr;
+        const auto sink = std::make_shared<VideoSinkDelivery>(impl, options, queue);
+        absl::optional<webrtc::VideoFrame> lastFrame;
+        int64_t lastFrameSequence = 0;
+        {
             std::unique_lock<std::mutex> lock{ _mutex };
-            _sinks.push_back(impl);
-            if (_lastFrame) {
-                strong->OnFrame(_lastFrame.value());
+            _sinks.push_back(sink);
+            lastFrame = _lastFrame;
+            lastFrameSequence = _lastFrameSequence;
+        }
+        // Dropped by the delivery when a newer frame got to the sink first.
+        if (lastFrame) {
+            sink->deliver(std::make_shared<ScaledVideoFrames>(lastFrame.value(), lastFrameSequence));
+        }
+    }
+
+    // The largest height the live sinks display. None unless every live sink
+    // declared a size limit, including when there are no live sinks at all.
+    absl::optional<int> wantedMaxHeight() {
+        std::unique_lock<std::mutex> lock{ _mutex };
+        absl::optional<int> result;
+        for (const auto &sink : _sinks) {
+            if (sink->sink().expired()) {
+                continue;
+            }
+            const auto &options = sink->options();
+            // The picture may be shown rotated, so the shorter side of the box is what counts.
+            int height = 0;
+            if (options.maxWidth > 0 && options.maxHeight > 0) {
+                height = std::min(options.maxWidth, options.maxHeight);
+            } else {
+                height = std::max(options.maxWidth, options.maxHeight);
             }
+            if (height == 0) {
+                return absl::nullopt;
+            }
+            result = std::max(result.value_or(0), height);
+        }
+        return result;
+    }
+
+    std::vector<IncomingVideoSink> getSinks() {
+        std::unique_lock<std::mutex> lock{ _mutex };
+        std::vector<IncomingVideoSink> result;
+        for (const auto &sink : _sinks) {
+            result.push_back(IncomingVideoSink{ sink->sink(), sink->options() });
+        }
+        return result;
+    }
+
+    void getDeliveryCounters(int64_t &deliveredFrames, int64_t &droppedFrames) {
+        std::unique_lock<std::mutex> lock{ _mutex };
+        deliveredFrames = _removedDeliveredFrames;
+        droppedFrames = _removedDroppedFrames;
+        for (const auto &sink : _sinks) {
+            deliveredFrames += sink->deliveredFrames();
+            droppedFrames += sink->droppedFrames();
         }
     }
 
-    std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>> getSinks() {
-        return _sinks;
+private:
+    void removeSinks(std::vector<VideoSinkDelivery*> const &expired) {
+        if (expired.empty()) {
+            return;
+        }
+        std::vector<std::shared_ptr<VideoSinkDelivery>> removed;
+        {
+            std::unique_lock<std::mutex> lock{ _mutex };
+            for (int i = (int)(_sinks.size()) - 1; i >= 0; i--) {
+                if (std::find(expired.begin(), expired.end(), _sinks[i].get()) != expired.end()) {
+                    _removedDeliveredFrames += _sinks[i]->deliveredFrames();
+                    _removedDroppedFrames += _sinks[i]->droppedFrames();
+                    removed.push_back(std::move(_sinks[i]));
+                    _sinks.erase(_sinks.begin() + i);
+                }
+            }
+        }
+        // Released outside the lock. An async sink's frame that is still being
+        // delivered holds its own reference, so this never waits for it.
+        removed.clear();
     }
 
 private:
-    std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>> _sinks;
+    std::vector<std::shared_ptr<VideoSinkDelivery>> _sinks;
     absl::optional<webrtc::VideoFrame> _lastFrame;
+    int64_t _lastFrameSequence = 0;
     std::mutex _mutex;
     int64_t _lastFrameSizeChangeTimestamp = 0;
     int _lastFrameSizeChangeHeight = 0;
+    int64_t _removedDeliveredFrames = 0;
+    int64_t _removedDroppedFrames = 0;
     std::string _endpointId;
+    // Held so the delivery queues outlive the deliveries that post to them.
+    std::shared_ptr<SharedMediaFactories> _mediaFactories;
 
 };
 
@@ -860,9 +1019,9 @@ private:
 
 class ExternalAudioRecorder : public FakeAudioDeviceModule::Recorder {
 public:
-    ExternalAudioRecorder(std::vector<float> *externalAudioSamples, webrtc::Mutex *externalAudioSamplesMutex) :
-    _externalAudioSamples(externalAudioSamples),
-    _externalAudioSamplesMutex(externalAudioSamplesMutex) {
+    ExternalAudioRecorder(std::shared_ptr<ExternalAudioPuller> externalAudio) :
+    _externalAudio(std::move(externalAudio)) {
+        _floatSamples.resize(480);
         _samples.resize(480);
     }
 
@@ -872,20 +1031,24 @@ public:
     virtual AudioFrame Record() override {
         AudioFrame result;
 
-        _externalAudioSamplesMutex->Lock();
-        if (!_externalAudioSamples->empty() && _externalAudioSamples->size() >= 480) {
-            size_t takenSamples = std::min(_samples.size(), _externalAudioSamples->size());
-            webrtc::FloatS16ToS16(_externalAudioSamples->data(), takenSamples, _samples.data());
-
-            result.num_samples = takenSamples;
-
-            if (takenSamples != 0) {
-                _externalAudioSamples->erase(_externalAudioSamples->begin(), _externalAudioSamples->begin() + takenSamples);
-            }
+        // Chunks are taken on an absolute 10 ms schedule, a source that always
+        // has audio must not be drained faster than real time.
+        const auto nowUs = rtc::TimeMicros();
+        if (_nextChunkDueUs != 0 && nowUs < _nextChunkDueUs) {
+            result.num_samples = 0;
+        } else if (_externalAudio->pull(_floatSamples.data(), _floatSamples.size())) {
+            webrtc::FloatS16ToS16(_floatSamples.data(), _floatSamples.size(), _samples.data());
+            result.num_samples = _samples.size();
+            // After a stall the schedule starts over instead of catching up.
+            if (_nextChunkDueUs == 0 || nowUs - _nextChunkDueUs > kMaxChunkLatenessUs) {
+                _nextChunkDueUs = nowUs;
+            }
+            _nextChunkDueUs += kChunkUs;
         } else {
+            // Nothing is sent, the device asks again after WaitForUs().
             result.num_samples = 0;
+            _nextChunkDueUs = 0;
         }
-        _externalAudioSamplesMutex->Unlock();
 
         result.audio_samples = _samples.data();
         result.bytes_per_sample = 2;
@@ -898,15 +1061,20 @@ public:
     }
 
     virtual int32_t WaitForUs() override {
-        _externalAudioSamplesMutex->Lock();
-        _externalAudioSamplesMutex->Unlock();
-
-        return 1000;
+        if (_nextChunkDueUs == 0) {
+            // The source had nothing, it is asked again soon.
+            return 1000;
+        }
+        return (int32_t)std::max(int64_t(0), _nextChunkDueUs - rtc::TimeMicros());
     }
 
 private:
-    std::vector<float> *_externalAudioSamples = nullptr;
-    webrtc::Mutex *_externalAudioSamplesMutex = nullptr;
+    static constexpr int64_t kChunkUs = 10000;
+    static constexpr int64_t kMaxChunkLatenessUs = 100000;
+
+    std::shared_ptr<ExternalAudioPuller> _externalAudio;
+    int64_t _nextChunkDueUs = 0;
+    std::vector<float> _floatSamples;
     std::vector<int16_t> _samples;
 };
 
@@ -925,17 +1093,21 @@ public:
     _threads(threads),
     _ssrc(ssrc),
     _channelManager(channelManager),
-    _call(call) {
+    _call(call),
+    _workerState(std::make_shared<WorkerState>()) {
         _creationTimestamp = rtc::TimeMillis();
 
-        threads->getWorkerThread()->Invoke<void>(RTC_FROM_HERE, [this, rtpTransport, ssrc, onAudioFrame = std::move(onAudioFrame), onAudioLevelUpdated = std::move(onAudioLevelUpdated), randomIdGenerator, isRawPcm]() mutable {
+        // Commands run on the worker thread in the order they are posted, so the
+        // channel exists by the time later commands for it get there.
+        threads->getWorkerThread()->PostTask(RTC_FROM_HERE, [state = _workerState, channelManager, call, threads, rtpTransport, ssrc, onAudioFrame = std::move(onAudioFrame), onAudioLevelUpdated = std::move(onAudioLevelUpdated), randomIdGenerator, isRawPcm]() mutable {
             cricket::AudioOptions audioOptions;
             audioOptions.audio_jitter_buffer_fast_accelerate = true;
             audioOptions.audio_jitter_buffer_min_delay_ms = 50;
 
             std::string streamId = std::string("stream") + ssrc.name();
 
-            _audioChannel = _channelManager->CreateVoiceChannel(_call, cricket::MediaConfig(), rtpTransport, _threads->getWorkerThread(), std::string("audio") + uint32ToString(ssrc.networkSsrc), false, GroupNetworkManager::getDefaulCryptoOptions(), randomIdGenerator, audioOptions);
+            const auto audioChannel = channelManager->CreateVoiceChannel(call, cricket::MediaConfig(), rtpTransport, threads->getWorkerThread(), std::string("audio") + uint32ToString(ssrc.networkSsrc), false, GroupNetworkManager::getDefaulCryptoOptions(), randomIdGenerator, audioOptions);
+            state->audioChannel = audioChannel;
 
             const uint8_t opusPTimeMs = 120;
 
@@ -972,19 +1144,19 @@ public:
             streamParams.set_stream_ids({ streamId });
             incomingAudioDescription->AddStream(streamParams);
 
-            _audioChannel->SetLocalContent(outgoingAudioDescription.get(), webrtc::SdpType::kOffer, nullptr);
-            _audioChannel->SetRemoteContent(incomingAudioDescription.get(), webrtc::SdpType::kAnswer, nullptr);
-            _audioChannel->SetPayloadTypeDemuxingEnabled(false);
+            audioChannel->SetLocalContent(outgoingAudioDescription.get(), webrtc::SdpType::kOffer, nullptr);
+            audioChannel->SetRemoteContent(incomingAudioDescription.get(), webrtc::SdpType::kAnswer, nullptr);
+            audioChannel->SetPayloadTypeDemuxingEnabled(false);
 
             outgoingAudioDescription.reset();
             incomingAudioDescription.reset();
 
-            if (_ssrc.actualSsrc != 1) {
-                std::unique_ptr<AudioSinkImpl> audioLevelSink(new AudioSinkImpl(std::move(onAudioLevelUpdated), _ssrc, std::move(onAudioFrame)));
-                _audioChannel->media_channel()->SetRawAudioSink(ssrc.networkSsrc, std::move(audioLevelSink));
+            if (ssrc.actualSsrc != 1) {
+                std::unique_ptr<AudioSinkImpl> audioLevelSink(new AudioSinkImpl(std::move(onAudioLevelUpdated), ssrc, std::move(onAudioFrame)));
+                audioChannel->media_channel()->SetRawAudioSink(ssrc.networkSsrc, std::move(audioLevelSink));
             }
 
-            _audioChannel->Enable(true);
+            audioChannel->Enable(true);
         });
 
         //_audioChannel->SignalSentPacket().connect(this, &IncomingAudioChannel::OnSentPacket_w);
@@ -992,15 +1164,15 @@ public:
 
     ~IncomingAudioChannel() {
         //_audioChannel->SignalSentPacket().disconnect(this);
-        _threads->getWorkerThread()->Invoke<void>(RTC_FROM_HERE, [this]() {
-            _channelManager->DestroyVoiceChannel(_audioChannel);
-            _audioChannel = nullptr;
+        _threads->getWorkerThread()->PostTask(RTC_FROM_HERE, [state = _workerState, channelManager = _channelManager]() {
+            channelManager->DestroyVoiceChannel(state->audioChannel);
+            state->audioChannel = nullptr;
         });
     }
 
     void setVolume(double value) {
-        _threads->getWorkerThread()->Invoke<void>(RTC_FROM_HERE, [this, value]() {
-            _audioChannel->media_channel()->SetOutputVolume(_ssrc.networkSsrc, value);
+        _threads->getWorkerThread()->PostTask(RTC_FROM_HERE, [state = _workerState, ssrc = _ssrc.networkSsrc, value]() {
+            state->audioChannel->media_channel()->SetOutputVolume(ssrc, value);
         });
     }
 
@@ -1018,13 +1190,19 @@ private:
     }
 
 private:
+    // Only touched on the worker thread, outlives this object until the
+    // channel is destroyed there.
+    struct WorkerState {
+        // Memory is managed by the channel manager
+        cricket::VoiceChannel *audioChannel = nullptr;
+    };
+
     std::shared_ptr<Threads> _threads;
     ChannelId _ssrc;
-    // Memory is managed by _channelManager
-    cricket::VoiceChannel *_audioChannel = nullptr;
     // Memory is managed externally
     cricket::ChannelManager *_channelManager = nullptr;
     webrtc::Call *_call = nullptr;
+    std::shared_ptr<WorkerState> _workerState;
     int64_t _creationTimestamp = 0;
     int64_t _activityTimestamp = 0;
 };
@@ -1042,20 +1220,36 @@ public:
         VideoChannelDescription::Quality minQuality,
         VideoChannelDescription::Quality maxQuality,
         GroupParticipantVideoInformation const &description,
-        std::shared_ptr<Threads> threads) :
+        std::shared_ptr<Threads> threads,
+        std::shared_ptr<SharedMediaFactories> mediaFactories) :
     _threads(threads),
     _endpointId(description.endpointId),
     _channelManager(channelManager),
     _call(call),
     _requestedMinQuality(minQuality),
-    _requestedMaxQuality(maxQuality) {
-        _videoSink.reset(new VideoSinkImpl(_endpointId));
+    _requestedMaxQuality(maxQuality),
+    _workerState(std::make_shared<WorkerState>()) {
+        _videoSink = std::make_shared<VideoSinkImpl>(_endpointId, mediaFactories);
+
+        for (const auto &group : description.ssrcGroups) {
+            if (group.semantics == "SIM") {
+                _mainVideoSsrc = group.ssrcs[0];
+                break;
+            }
+        }
+        if (_mainVideoSsrc == 0) {
+            if (description.ssrcGroups.size() == 1) {
+                _mainVideoSsrc = description.ssrcGroups[0].ssrcs[0];
+            }
+        }
 
-        _threads->getWorkerThread()->Invoke<void>(RTC_FROM_HERE, [this, rtpTransport, &availableVideoFormats, &description, randomIdGenerator]() mutable {
+        // Commands run on the worker thread in the order they are posted, so the
+        // channel exists by the time later commands for it get there.
+        _threads->getWorkerThread()->PostTask(RTC_FROM_HERE, [state = _workerState, channelManager, call, threads, rtpTransport, availableVideoFormats, ssrcGroups = description.ssrcGroups, mainVideoSsrc = _mainVideoSsrc, videoSink = _videoSink, randomIdGenerator]() mutable {
             uint32_t mid = randomIdGenerator->GenerateId();
             std::string streamId = std::string("video") + uint32ToString(mid);
 
-            _videoBitrateAllocatorFactory = webrtc::CreateBuiltinVideoBitrateAllocatorFactory();
+            state->videoBitrateAllocatorFactory = webrtc::CreateBuiltinVideoBitrateAllocatorFactory();
 
             auto payloadTypes = assignPayloadTypes(availableVideoFormats);
             std::vector<cricket::VideoCodec> codecs;
@@ -1077,30 +1271,18 @@ public:
             cricket::StreamParams videoRecvStreamParams;
 
             std::vector<uint32_t> allSsrcs;
-            for (const auto &group : description.ssrcGroups) {
+            for (const auto &group : ssrcGroups) {
                 for (auto ssrc : group.ssrcs) {
                     if (std::find(allSsrcs.begin(), allSsrcs.end(), ssrc) == allSsrcs.end()) {
                         allSsrcs.push_back(ssrc);
                     }
                 }
 
-                if (group.semantics == "SIM") {
-                    if (_mainVideoSsrc == 0) {
-                        _mainVideoSsrc = group.ssrcs[0];
-                    }
-                }
-
                 cricket::SsrcGroup parsedGroup(group.semantics, group.ssrcs);
                 videoRecvStreamParams.ssrc_groups.push_back(parsedGroup);
             }
             videoRecvStreamParams.ssrcs = allSsrcs;
 
-            if (_mainVideoSsrc == 0) {
-                if (description.ssrcGroups.size() == 1) {
-                    _mainVideoSsrc = description.ssrcGroups[0].ssrcs[0];
-                }
-            }
-
             videoRecvStreamParams.cname = "cname";
             videoRecvStreamParams.set_stream_ids({ streamId });
 
@@ -1116,13 +1298,14 @@ public:
 
             incomingVideoDescription->AddStream(videoRecvStreamParams);
 
-            _videoChannel = _channelManager->CreateVideoChannel(_call, cricket::MediaConfig(), rtpTransport, _threads->getWorkerThread(), std::string("video") + uint32ToString(mid), false, GroupNetworkManager::getDefaulCryptoOptions(), randomIdGenerator, cricket::VideoOptions(), _videoBitrateAllocatorFactory.get());
+            const auto videoChannel = channelManager->CreateVideoChannel(call, cricket::MediaConfig(), rtpTransport, threads->getWorkerThread(), std::string("video") + uint32ToString(mid), false, GroupNetworkManager::getDefaulCryptoOptions(), randomIdGenerator, cricket::VideoOptions(), state->videoBitrateAllocatorFactory.get());
+            state->videoChannel = videoChannel;
 
-            _videoChannel->SetLocalContent(outgoingVideoDescription.get(), webrtc::SdpType::kOffer, nullptr);
-            _videoChannel->SetRemoteContent(incomingVideoDescription.get(), webrtc::SdpType::kAnswer, nullptr);
-            _videoChannel->SetPayloadTypeDemuxingEnabled(false);
-            _videoChannel->media_channel()->SetSink(_mainVideoSsrc, _videoSink.get());
-            _videoChannel->Enable(true);
+            videoChannel->SetLocalContent(outgoingVideoDescription.get(), webrtc::SdpType::kOffer, nullptr);
+            videoChannel->SetRemoteContent(incomingVideoDescription.get(), webrtc::SdpType::kAnswer, nullptr);
+            videoChannel->SetPayloadTypeDemuxingEnabled(false);
+            videoChannel->media_channel()->SetSink(mainVideoSsrc, videoSink.get());
+            videoChannel->Enable(true);
         });
 
         //_videoChannel->SignalSentPacket().connect(this, &IncomingVideoChannel::OnSentPacket_w);
@@ -1130,18 +1313,20 @@ public:
 
     ~IncomingVideoChannel() {
         //_videoChannel->SignalSentPacket().disconnect(this);
-        _threads->getWorkerThread()->Invoke<void>(RTC_FROM_HERE, [this]() {
-            _videoChannel->Enable(false);
-            _channelManager->DestroyVideoChannel(_videoChannel);
-            _videoChannel = nullptr;
+        // The sink is kept alive until the channel that feeds it is gone.
+        _threads->getWorkerThread()->PostTask(RTC_FROM_HERE, [state = _workerState, channelManager = _channelManager, videoSink = _videoSink]() {
+            state->videoChannel->Enable(false);
+            channelManager->DestroyVideoChannel(state->videoChannel);
+            state->videoChannel = nullptr;
+            state->videoBitrateAllocatorFactory.reset();
         });
     }
 
-    void addSink(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> impl) {
-        _videoSink->addSink(impl);
+    void addSink(IncomingVideoSink const &sink) {
+        _videoSink->addSink(sink.sink, sink.options);
     }
 
-    std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>> getSinks() {
+    std::vector<IncomingVideoSink> getSinks() {
         return _videoSink->getSinks();
     }
 
@@ -1165,12 +1350,37 @@ public:
         _requestedMaxQuality = quality;
     }
 
+    // The requested qualities, lowered to what the sinks of this channel display.
+    VideoChannelDescription::Quality effectiveMinQuality() {
+        return std::min(_requestedMinQuality, effectiveMaxQuality());
+    }
+
+    // Sinks only lower the request when they declared how large they display,
+    // a channel whose sinks were not attached yet keeps what was asked for.
+    VideoChannelDescription::Quality effectiveMaxQuality() {
+        const auto wantedHeight = _videoSink->wantedMaxHeight();
+        if (!wantedHeight) {
+            return _requestedMaxQuality;
+        }
+        auto quality = VideoChannelDescription::Quality::Full;
+        if (wantedHeight.value() <= 180) {
+            quality = VideoChannelDescription::Quality::Thumbnail;
+        } else if (wantedHeight.value() <= 360) {
+            quality = VideoChannelDescription::Quality::Medium;
+        }
+        return std::min(_requestedMaxQuality, quality);
+    }
+
     void setStats(absl::optional<GroupInstanceStats::IncomingVideoStats> stats) {
         _stats = stats;
     }
 
     absl::optional<GroupInstanceStats::IncomingVideoStats> getStats() {
-        return _stats;
+        auto result = _stats;
+        if (result) {
+            _videoSink->getDeliveryCounters(result->deliveredFrames, result->droppedFrames);
+        }
+        return result;
     }
 
 private:
@@ -1179,17 +1389,23 @@ private:
     }
 
 private:
+    // Only touched on the worker thread, outlives this object until the
+    // channel is destroyed there.
+    struct WorkerState {
+        std::unique_ptr<webrtc::VideoBitrateAllocatorFactory> videoBitrateAllocatorFactory;
+        // Memory is managed by the channel manager
+        cricket::VideoChannel *videoChannel = nullptr;
+    };
+
     std::shared_ptr<Threads> _threads;
     uint32_t _mainVideoSsrc = 0;
     std::string _endpointId;
-    std::unique_ptr<VideoSinkImpl> _videoSink;
+    std::shared_ptr<VideoSinkImpl> _videoSink;
     std::vector<GroupJoinPayloadVideoSourceGroup> _ssrcGroups;
-    std::unique_ptr<webrtc::VideoBitrateAllocatorFactory> _videoBitrateAllocatorFactory;
-    // Memory is managed by _channelManager
-    cricket::VideoChannel *_videoChannel;
     // Memory is managed externally
     cricket::ChannelManager *_channelManager = nullptr;
     webrtc::Call *_call = nullptr;
+    std::shared_ptr<WorkerState> _workerState;
 
     VideoChannelDescription::Quality _requestedMinQuality = VideoChannelDescription::Quality::Thumbnail;
     VideoChannelDescription::Quality _requestedMaxQuality = VideoChannelDescription::Quality::Thumbnail;
@@ -1263,56 +1479,119 @@ std::function<webrtc::VideoTrackSourceInterface*()> videoCaptureToGetVideoSource
   };
 }
 
+// Copies mono samples to every channel of an interleaved buffer. The one and
+// two channel cases are the ones devices use, and are kept simple enough for
+// the compiler to vectorize.
+static void upmixMonoAudio(const int16_t *mono, size_t numSamples, int16_t *interleaved, size_t numChannels) {
+    if (numChannels == 1) {
+        memcpy(interleaved, mono, numSamples * sizeof(int16_t));
+    } else if (numChannels == 2) {
+        for (size_t i = 0; i < numSamples; i++) {
+            interleaved[2 * i] = mono[i];
+            interleaved[2 * i + 1] = mono[i];
+        }
+    } else {
+        for (size_t i = 0; i < numSamples; i++) {
+            std::fill(interleaved + i * numChannels, interleaved + (i + 1) * numChannels, mono[i]);
+        }
+    }
+}
+
 class AudioDeviceDataObserverShared {
 public:
     AudioDeviceDataObserverShared() {
+        _samplesToResample.resize(480);
+        // Enough for 96 kHz, larger rates grow it once.
+        _resampledSamples.resize(960);
     }
 
     ~AudioDeviceDataObserverShared() {
     }
 
+    // Media thread. Waits for a running mixAudio to let go of the previous
+    // context before releasing it, which is at most one render tick.
     void setStreamingContext(std::shared_ptr<StreamingMediaContext> streamingContext) {
-        _mutex.Lock();
-        _streamingContext = streamingContext;
-        _mutex.Unlock();
+        const auto previous = std::move(_streamingContext);
+        _streamingContext = std::move(streamingContext);
+        _currentStreamingContext.store(_streamingContext.get());
+        while (_mixingCount.load() != 0) {
+            std::this_thread::yield();
+        }
     }
 
+    // Audio render thread. Broadcast audio is mono, so it is resampled once and
+    // copied to the device channels afterwards. Allocates only the first time a
+    // rate is seen.
     void mixAudio(int16_t *audio_samples, const size_t num_samples, const size_t num_channels, const uint32_t samples_per_sec) {
-        _mutex.Lock();
-        const auto context = _streamingContext;
-        _mutex.Unlock();
+        // Counted before the context is loaded, so setStreamingContext either
+        // sees this tick running or this tick sees the new context.
+        _mixingCount.fetch_add(1);
+        const auto context = _currentStreamingContext.load();
+        if (!context) {
+            _mixingCount.fetch_sub(1);
+            return;
+        }
 
-        if (context) {
-            if (_samplesToResample.size() < 480 * num_channels) {
-                _samplesToResample.resize(480 * num_channels);
+        // Zero-fills whatever the ring buffer does not have.
+        context->getAudio(_samplesToResample.data(), 480, 1, 48000);
+        _mixingCount.fetch_sub(1);
+
+        const int16_t *mono = _samplesToResample.data();
+        if (samples_per_sec != 48000) {
+            const auto resampler = resamplerForRate(samples_per_sec);
+            if (!resampler) {
+                return;
+            }
+            if (_resampledSamples.size() < num_samples) {
+                _resampledSamples.resize(num_samples);
+            }
+            size_t outLen = 0;
+            if (resampler->Push(_samplesToResample.data(), _samplesToResample.size(), _resampledSamples.data(), num_samples, outLen) == -1 || outLen != num_samples) {
+                return;
             }
-            memset(_samplesToResample.data(), 0, _samplesToResample.size() * sizeof(int16_t));
+            mono = _resampledSamples.data();
+        } else if (num_samples != 480) {
+            return;
+        }
 
-            context->getAudio(_samplesToResample.data(), 480, num_channels, 48000);
+        upmixMonoAudio(mono, num_samples, audio_samples, num_channels);
+    }
 
-            if (_resamplerFrequency != samples_per_sec || _resamplerNumChannels != num_channels) {
-                _resamplerFrequency = samples_per_sec;
-                _resamplerNumChannels = num_channels;
-                _resampler = std::make_unique<webrtc::Resampler>();
-                if (_resampler->Reset(48000, samples_per_sec, num_channels) == -1) {
-                    _resampler = nullptr;
-                }
-            }
+private:
+    struct CachedResampler {
+        uint32_t rate = 0;
+        std::unique_ptr<webrtc::Resampler> resampler;
+    };
 
-            if (_resampler) {
-                size_t outLen = 0;
-                _resampler->Push(_samplesToResample.data(), _samplesToResample.size(), (int16_t *)audio_samples, num_samples * num_channels, outLen);
+    webrtc::Resampler *resamplerForRate(uint32_t rate) {
+        for (auto &cached : _resamplers) {
+            if (cached.rate == rate) {
+                return cached.resampler.get();
             }
         }
+
+        auto resampler = std::make_unique<webrtc::Resampler>();
+        if (resampler->Reset(48000, rate, 1) == -1) {
+            resampler = nullptr;
+        }
+        // Devices rarely switch between more than a couple of rates; the
+        // oldest entry makes room when they do.
+        if (_resamplers.size() >= kMaxCachedResamplers) {
+            _resamplers.erase(_resamplers.begin());
+        }
+        _resamplers.push_back(CachedResampler{ rate, std::move(resampler) });
+        return _resamplers.back().resampler.get();
     }
 
-private:
-    webrtc::Mutex _mutex;
-    std::unique_ptr<webrtc::Resampler> _resampler;
-    uint32_t _resamplerFrequency = 0;
-    size_t _resamplerNumChannels = 0;
+    static constexpr size_t kMaxCachedResamplers = 4;
+
+    std::vector<CachedResampler> _resamplers;
     std::vector<int16_t> _samplesToResample;
+    std::vector<int16_t> _resampledSamples;
+    // Owned on the media thread, the render thread only sees the raw pointer.
     std::shared_ptr<StreamingMediaContext> _streamingContext;
+    std::atomic<StreamingMediaContext*> _currentStreamingContext{ nullptr };
+    std::atomic<int> _mixingCount{ 0 };
 };
 
 class AudioDeviceDataObserverImpl : public webrtc::AudioDeviceDataObserver {
@@ -1355,24 +1634,6 @@ private:
     std::shared_ptr<AudioDeviceDataObserverShared> _shared;
 };
 
-class CustomNetEqFactory: public webrtc::NetEqFactory {
-public:
-    virtual ~CustomNetEqFactory() = default;
-    
-    std::unique_ptr<webrtc::NetEq> CreateNetEq(
-        const webrtc::NetEq::Config& config,
-        const rtc::scoped_refptr<webrtc::AudioDecoderFactory>& decoder_factory, webrtc::Clock* clock
-    ) const override {
-        webrtc::NetEq::Config updatedConfig = config;
-        updatedConfig.sample_rate_hz = 48000;
-        return webrtc::DefaultNetEqFactory().CreateNetEq(updatedConfig, decoder_factory, clock);
-    }
-};
-
-std::unique_ptr<webrtc::NetEqFactory> createNetEqFactory() {
-    return std::make_unique<CustomNetEqFactory>();
-}
-
 class CustomEchoDetector : public webrtc::EchoDetector {
 public:
     // (Re-)Initializes the submodule.
@@ -1401,8 +1662,13 @@ public:
 
 class GroupInstanceCustomInternal : public sigslot::has_slots<>, public std::enable_shared_from_this<GroupInstanceCustomInternal> {
 public:
-    GroupInstanceCustomInternal(GroupInstanceDescriptor &&descriptor, std::shared_ptr<Threads> threads) :
+    GroupInstanceCustomInternal(GroupInstanceDescriptor &&descriptor, std::shared_ptr<Threads> threads, std::shared_ptr<MetricsRegistry> metrics) :
     _threads(std::move(threads)),
+    _metrics(std::move(metrics)),
+    _packetsReceivedMetric(_metrics->counter("group.packets_received")),
+    _unknownSsrcPacketsMetric(_metrics->counter("group.unknown_ssrc_packets")),
+    _unresolvedBatchSizeMetric(_metrics->histogram("group.unresolved_batch_size")),
+    _unresolvedDroppedPacketsMetric(_metrics->counter("group.unresolved_dropped_packets")),
     _networkStateUpdated(descriptor.networkStateUpdated),
     _audioLevelsUpdated(descriptor.audioLevelsUpdated),
     _onAudioFrame(descriptor.onAudioFrame),
@@ -1410,6 +1676,7 @@ public:
     _requestCurrentTime(descriptor.requestCurrentTime),
     _requestAudioBroadcastPart(descriptor.requestAudioBroadcastPart),
     _requestVideoBroadcastPart(descriptor.requestVideoBroadcastPart),
+    _broadcastPartCache(descriptor.broadcastPartCache),
     _videoCapture(descriptor.videoCapture),
     _videoCaptureSink(new VideoSinkImpl("VideoCapture")),
     _getVideoSource(descriptor.getVideoSource),
@@ -1421,9 +1688,7 @@ public:
     _minOutgoingVideoBitrateKbit(descriptor.minOutgoingVideoBitrateKbit),
     _videoContentType(descriptor.videoContentType),
     _videoCodecPreferences(std::move(descriptor.videoCodecPreferences)),
-    _eventLog(std::make_unique<webrtc::RtcEventLogNull>()),
-    _taskQueueFactory(webrtc::CreateDefaultTaskQueueFactory()),
-    _netEqFactory(createNetEqFactory()),
+    _mediaFactories(descriptor.sharedMediaFactories ? descriptor.sharedMediaFactories : SharedMediaFactories::create()),
     _createAudioDeviceModule(descriptor.createAudioDeviceModule),
     _initialInputDeviceId(std::move(descriptor.initialInputDeviceId)),
     _initialOutputDeviceId(std::move(descriptor.initialOutputDeviceId)),
@@ -1445,7 +1710,10 @@ public:
 
         _noiseSuppressionConfiguration = std::make_shared<NoiseSuppressionConfiguration>(descriptor.initialEnableNoiseSuppression);
 
-        _externalAudioRecorder.reset(new ExternalAudioRecorder(&_externalAudioSamples, &_externalAudioSamplesMutex));
+        _bufferedExternalAudioSource = std::make_shared<BufferedExternalAudioSource>();
+        _externalAudioPuller = std::make_shared<ExternalAudioPuller>();
+        _externalAudioPuller->setSource(_bufferedExternalAudioSource);
+        _externalAudioRecorder.reset(new ExternalAudioRecorder(_externalAudioPuller));
     }
 
     ~GroupInstanceCustomInternal() {
@@ -1461,6 +1729,8 @@ public:
             _rtpTransport->SignalRtcpPacketReceived.disconnect(this);
         });
 
+        // Runs after the channel destruction and packet delivery tasks posted above,
+        // so none of them outlive _call and _channelManager.
         _threads->getWorkerThread()->Invoke<void>(RTC_FROM_HERE, [this]() {
             _channelManager = nullptr;
             if (_audioDeviceModule) {
@@ -1474,16 +1744,22 @@ public:
     void start() {
         const auto weak = std::weak_ptr<GroupInstanceCustomInternal>(shared_from_this());
 
-        webrtc::field_trial::InitFieldTrialsFromString(
-            "WebRTC-Audio-Allocation/min:32kbps,max:32kbps/"
-            "WebRTC-Audio-OpusMinPacketLossRate/Enabled-1/"
-            "WebRTC-TaskQueuePacer/Enabled/"
-            "WebRTC-VP8ConferenceTemporalLayers/1/"
-            "WebRTC-Audio-MinimizeResamplingOnMobile/Enabled/"
-            "WebRTC-BweLossExperiment/Enabled/"
-        );
+        // Field trials are process-wide and may have been replaced by another
+        // kind of call, they are only parsed again when that happened. WebRTC
+        // keeps the pointer it was given rather than a copy, so comparing the
+        // pointers is intended: it tells whether our string is still installed.
+        if (webrtc::field_trial::GetFieldTrialString() != kGroupFieldTrials) {
+            webrtc::field_trial::InitFieldTrialsFromString(kGroupFieldTrials);
+        }
+
+        _unresolvedPackets = std::make_shared<IncomingPacketQueue>(_threads->getMediaThread(), kMaxPendingUnresolvedPackets);
+        _unresolvedPackets->setConsumer([weak](std::vector<IncomingPacketQueue::Packet> &packets) {
+            if (const auto strong = weak.lock()) {
+                strong->receiveUnresolvedPackets(packets);
+            }
+        });
 
-        _networkManager.reset(new ThreadLocalObject<GroupNetworkManager>(_threads->getNetworkThread(), [weak, threads = _threads] () mutable {
+        _networkManager.reset(new ThreadLocalObject<GroupNetworkManager>(_threads->getNetworkThread(), [weak, threads = _threads, incomingAudioLevels = _incomingAudioLevels, unresolvedPackets = _unresolvedPackets] () mutable {
             return new GroupNetworkManager(
                 [=](const GroupNetworkManager::State &state) {
                     threads->getMediaThread()->PostTask(RTC_FROM_HERE, [=] {
@@ -1498,11 +1774,8 @@ public:
                     if (!isUnresolved) {
                         return;
                     }
-                    threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, message, isUnresolved]() mutable {
-                        if (const auto strong = weak.lock()) {
-                            strong->receivePacket(message, isUnresolved);
-                        }
-                    });
+                    rtc::CopyOnWriteBuffer packet(message);
+                    unresolvedPackets->push(false, std::move(packet));
                 },
                 [=](bool isDataChannelOpen) {
                     threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, isDataChannelOpen]() mutable {
@@ -1518,12 +1791,8 @@ public:
                         }
                     });
                 },
-                [=](uint32_t ssrc, uint8_t audioLevel, bool isSpeech) {
-                    threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, ssrc, audioLevel, isSpeech]() {
-                        if (const auto strong = weak.lock()) {
-                            strong->updateSsrcAudioLevel(ssrc, audioLevel, isSpeech);
-                        }
-                    });
+                [incomingAudioLevels](uint32_t ssrc, uint8_t audioLevel, bool isSpeech) {
+                    incomingAudioLevels->add(ssrc, audioLevel, isSpeech);
                 }, threads);
         }));
 
@@ -1552,9 +1821,9 @@ public:
     #endif
           ]() mutable {
             cricket::MediaEngineDependencies mediaDeps;
-            mediaDeps.task_queue_factory = _taskQueueFactory.get();
-            mediaDeps.audio_encoder_factory = webrtc::CreateAudioEncoderFactory<webrtc::AudioEncoderOpus, webrtc::AudioEncoderL16>();
-            mediaDeps.audio_decoder_factory = webrtc::CreateAudioDecoderFactory<webrtc::AudioDecoderOpus, webrtc::AudioDecoderL16>();
+            mediaDeps.task_queue_factory = _mediaFactories->taskQueueFactory();
+            mediaDeps.audio_encoder_factory = _mediaFactories->audioEncoderFactory();
+            mediaDeps.audio_decoder_factory = _mediaFactories->audioDecoderFactory();
 
             mediaDeps.video_encoder_factory = PlatformInterface::SharedInstance()->makeVideoEncoderFactory(false, _videoContentType == VideoContentType::Screencast);
             mediaDeps.video_decoder_factory = PlatformInterface::SharedInstance()->makeVideoDecoderFactory();
@@ -1594,9 +1863,9 @@ public:
         setAudioOutputDevice(_initialOutputDeviceId);
 
         _threads->getWorkerThread()->Invoke<void>(RTC_FROM_HERE, [this]() {
-            webrtc::Call::Config callConfig(_eventLog.get(), _threads->getNetworkThread());
-            callConfig.neteq_factory = _netEqFactory.get();
-            callConfig.task_queue_factory = _taskQueueFactory.get();
+            webrtc::Call::Config callConfig(_mediaFactories->eventLog(), _threads->getNetworkThread());
+            callConfig.neteq_factory = _mediaFactories->netEqFactory();
+            callConfig.task_queue_factory = _mediaFactories->taskQueueFactory();
             callConfig.trials = &_fieldTrials;
             callConfig.audio_state = _channelManager->media_engine()->voice().GetAudioState();
             _call.reset(webrtc::Call::Create(callConfig, webrtc::Clock::GetRealTimeClock(), _threads->getSharedModuleThread(), webrtc::ProcessThread::Create("PacerThread")));
@@ -1935,6 +2204,13 @@ public:
     void stop() {
     }
 
+    void collectIncomingAudioLevels() {
+        _incomingAudioLevels->take(_incomingAudioLevelEntries);
+        for (const auto &entry : _incomingAudioLevelEntries) {
+            updateSsrcAudioLevel(entry.ssrc, entry.audioLevel, entry.isSpeech);
+        }
+    }
+
     void updateSsrcAudioLevel(uint32_t ssrc, uint8_t audioLevel, bool isSpeech) {
         float mappedLevelDb = ((float)audioLevel) / (float)(0x7f);
 
@@ -1974,6 +2250,8 @@ public:
                 return;
             }
 
+            strong->collectIncomingAudioLevels();
+
             //int64_t timestamp = rtc::TimeMillis();
             //int64_t maxSampleTimeout = 400;
 
@@ -2035,6 +2313,10 @@ public:
                 return;
             }
 
+            // Levels also mark channels as active, they may not have been
+            // collected yet if nobody listens to them.
+            strong->collectIncomingAudioLevels();
+
             auto timestamp = rtc::TimeMillis();
 
             std::vector<ChannelId> removeChannels;
@@ -2331,7 +2613,22 @@ public:
         }
     }
 
+    void receiveUnresolvedPackets(std::vector<IncomingPacketQueue::Packet> &packets) {
+        _unresolvedBatchSizeMetric->record((int64_t)packets.size());
+        const auto droppedPackets = _unresolvedPackets->getStats().droppedPackets;
+        if (droppedPackets != _reportedUnresolvedDroppedPackets) {
+            _unresolvedDroppedPacketsMetric->add(droppedPackets - _reportedUnresolvedDroppedPackets);
+            _reportedUnresolvedDroppedPackets = droppedPackets;
+        }
+
+        for (const auto &packet : packets) {
+            receivePacket(packet.data, true);
+        }
+    }
+
     void receivePacket(rtc::CopyOnWriteBuffer const &packet, bool isUnresolved) {
+        _packetsReceivedMetric->add();
+
       if (packet.size() >= 4) {
             if (packet.data()[0] == 0x13 && packet.data()[1] == 0x88 && packet.data()[2] == 0x13 && packet.data()[3] == 0x88) {
                 // SCTP packet header (source port 5000, destination port 5000)
@@ -2340,7 +2637,7 @@ public:
         }
 
         if (webrtc::IsRtcpPacket(packet)) {
-            _threads->getWorkerThread()->Invoke<void>(RTC_FROM_HERE, [this, packet]() {
+            _threads->getWorkerThread()->PostTask(RTC_FROM_HERE, [this, packet]() {
                 _call->Receiver()->DeliverPacket(webrtc::MediaType::ANY, packet, -1);
             });
         } else {
@@ -2355,6 +2652,7 @@ public:
             if (ssrcInfo == _channelBySsrc.end()) {
                 // opus
                 if (payloadType == 111) {
+                    _unknownSsrcPacketsMetric->add();
                     maybeRequestUnknownSsrc(ssrc);
                     _missingPacketBuffer.add(ssrc, packet);
                 }
@@ -2583,7 +2881,7 @@ public:
         for (const auto &incomingVideoChannel : _incomingVideoChannels) {
             json11::Json::object selectedConstraint;
 
-            switch (incomingVideoChannel.second->requestedMinQuality()) {
+            switch (incomingVideoChannel.second->effectiveMinQuality()) {
                 case VideoChannelDescription::Quality::Full: {
                     selectedConstraint.insert(std::make_pair("minHeight", json11::Json(720)));
                     break;
@@ -2600,7 +2898,7 @@ public:
                     break;
                 }
             }
-            switch (incomingVideoChannel.second->requestedMaxQuality()) {
+            switch (incomingVideoChannel.second->effectiveMaxQuality()) {
                 case VideoChannelDescription::Quality::Full: {
                     onStageEndpoints.push_back(json11::Json(incomingVideoChannel.first.endpointId));
                     selectedConstraint.insert(std::make_pair("maxHeight", json11::Json(720)));
@@ -2692,6 +2990,8 @@ public:
                     arguments.requestCurrentTime = _requestCurrentTime;
                     arguments.requestAudioBroadcastPart = _requestAudioBroadcastPart;
                     arguments.requestVideoBroadcastPart = _requestVideoBroadcastPart;
+                    arguments.partCache = _broadcastPartCache;
+                    arguments.metrics = _metrics;
                     arguments.updateAudioLevel = [weak, threads = _threads](uint32_t ssrc, float level, bool isSpeech) {
                         assert(threads->getMediaThread()->IsCurrent());
 
@@ -2710,7 +3010,7 @@ public:
 
                     for (const auto &it : _pendingVideoSinks) {
                         for (const auto &sink : it.second) {
-                            _streamingContext->addVideoSink(it.first.endpointId, sink);
+                            _streamingContext->addVideoSink(it.first.endpointId, sink.sink);
                         }
                     }
 
@@ -2856,17 +3156,15 @@ public:
         if (samples.size() % 2 != 0) {
             return;
         }
-        _externalAudioSamplesMutex.Lock();
-
-        size_t previousSize = _externalAudioSamples.size();
-        _externalAudioSamples.resize(_externalAudioSamples.size() + samples.size() / 2);
-        webrtc::S16ToFloatS16((const int16_t *)samples.data(), samples.size() / 2, _externalAudioSamples.data() + previousSize);
+        _bufferedExternalAudioSource->push((const int16_t *)samples.data(), samples.size() / 2);
+    }
 
-        if (_externalAudioSamples.size() > 2 * 48000) {
-            _externalAudioSamples.erase(_externalAudioSamples.begin(), _externalAudioSamples.begin() + (_externalAudioSamples.size() - 2 * 48000));
+    void setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source) {
+        if (source) {
+            _externalAudioPuller->setSource(std::move(source));
+        } else {
+            _externalAudioPuller->setSource(_bufferedExternalAudioSource);
         }
-
-        _externalAudioSamplesMutex.Unlock();
     }
 
     void setJoinResponsePayload(std::string const &payload) {
@@ -2956,7 +3254,8 @@ public:
             VideoChannelDescription::Quality::Thumbnail,
             VideoChannelDescription::Quality::Thumbnail,
             videoInformation,
-            _threads
+            _threads,
+            _mediaFactories
         ));
 
         ChannelSsrcInfo mapping;
@@ -3005,7 +3304,7 @@ public:
         }
     }
 
-    void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
+    void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
         if (_sharedVideoInformation && endpointId == _sharedVideoInformation->endpointId) {
             if (_videoCapture) {
                 _videoCaptureSink->addSink(sink);
@@ -3014,9 +3313,11 @@ public:
         } else {
             auto it = _incomingVideoChannels.find(VideoChannelId(endpointId));
             if (it != _incomingVideoChannels.end()) {
-                it->second->addSink(sink);
+                it->second->addSink(IncomingVideoSink{ sink, options });
+                // A new sink may display more than the ones before it.
+                maybeUpdateRemoteVideoConstraints();
             } else {
-                _pendingVideoSinks[VideoChannelId(endpointId)].push_back(sink);
+                _pendingVideoSinks[VideoChannelId(endpointId)].push_back(IncomingVideoSink{ sink, options });
             }
 
             if (_streamingContext) {
@@ -3167,7 +3468,8 @@ public:
             minQuality,
             maxQuality,
             videoInformation,
-            _threads
+            _threads,
+            _mediaFactories
         ));
 
         const auto pendingSinks = _pendingVideoSinks.find(VideoChannelId(videoInformation.endpointId));
@@ -3320,7 +3622,7 @@ private:
 #else
             return webrtc::AudioDeviceModule::Create(
                 layer,
-                _taskQueueFactory.get());
+                _mediaFactories->taskQueueFactory());
 #endif
         };
         const auto check = [&](const rtc::scoped_refptr<webrtc::AudioDeviceModule> &result) -> rtc::scoped_refptr<WrappedAudioDeviceModule> {
@@ -3338,19 +3640,26 @@ private:
             }
         };
         if (_createAudioDeviceModule) {
-            if (const auto result = check(_createAudioDeviceModule(_taskQueueFactory.get()))) {
+            if (const auto result = check(_createAudioDeviceModule(_mediaFactories->taskQueueFactory()))) {
                 return result;
             }
         } else if (_videoContentType == VideoContentType::Screencast) {
             FakeAudioDeviceModule::Options options;
             options.num_channels = 1;
-            return check(FakeAudioDeviceModule::Creator(nullptr, _externalAudioRecorder, options)(_taskQueueFactory.get()));
+            return check(FakeAudioDeviceModule::Creator(nullptr, _externalAudioRecorder, options)(_mediaFactories->taskQueueFactory()));
         }
         return check(create(webrtc::AudioDeviceModule::kPlatformDefaultAudio));
     }
 
 private:
     std::shared_ptr<Threads> _threads;
+    std::shared_ptr<MetricsRegistry> _metrics;
+    MetricsCounter *_packetsReceivedMetric = nullptr;
+    MetricsCounter *_unknownSsrcPacketsMetric = nullptr;
+    MetricsHistogram *_unresolvedBatchSizeMetric = nullptr;
+    MetricsCounter *_unresolvedDroppedPacketsMetric = nullptr;
+    std::shared_ptr<IncomingPacketQueue> _unresolvedPackets;
+    int64_t _reportedUnresolvedDroppedPackets = 0;
     GroupConnectionMode _connectionMode = GroupConnectionMode::GroupConnectionModeNone;
     bool _isUnifiedBroadcast = false;
 
@@ -3361,6 +3670,7 @@ private:
     std::function<std::shared_ptr<BroadcastPartTask>(std::function<void(int64_t)>)> _requestCurrentTime;
     std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, std::function<void(BroadcastPart &&)>)> _requestAudioBroadcastPart;
     std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, int32_t, VideoChannelDescription::Quality, std::function<void(BroadcastPart &&)>)> _requestVideoBroadcastPart;
+    std::shared_ptr<BroadcastPartCache> _broadcastPartCache;
     std::shared_ptr<VideoCaptureInterface> _videoCapture;
     std::shared_ptr<VideoSinkImpl> _videoCaptureSink;
     std::function<webrtc::VideoTrackSourceInterface*()> _getVideoSource;
@@ -3378,9 +3688,7 @@ private:
 
     std::unique_ptr<ThreadLocalObject<GroupNetworkManager>> _networkManager;
 
-    std::unique_ptr<webrtc::RtcEventLogNull> _eventLog;
-    std::unique_ptr<webrtc::TaskQueueFactory> _taskQueueFactory;
-    std::unique_ptr<webrtc::NetEqFactory> _netEqFactory;
+    std::shared_ptr<SharedMediaFactories> _mediaFactories;
     std::unique_ptr<cricket::MediaEngineInterface> _mediaEngine;
     std::unique_ptr<webrtc::Call> _call;
     webrtc::FieldTrialBasedConfig _fieldTrials;
@@ -3416,6 +3724,8 @@ private:
     int _pendingOutgoingVideoConstraintRequestId = 0;
 
     std::map<ChannelId, InternalGroupLevelValue> _audioLevels;
+    std::shared_ptr<IncomingAudioLevels> _incomingAudioLevels = std::make_shared<IncomingAudioLevels>();
+    std::vector<IncomingAudioLevels::Entry> _incomingAudioLevelEntries;
     GroupLevelValue _myAudioLevel;
 
     bool _isMuted = true;
@@ -3427,15 +3737,15 @@ private:
     std::map<ChannelId, std::unique_ptr<IncomingAudioChannel>> _incomingAudioChannels;
     std::map<VideoChannelId, std::unique_ptr<IncomingVideoChannel>> _incomingVideoChannels;
 
-    std::map<VideoChannelId, std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>>> _pendingVideoSinks;
+    std::map<VideoChannelId, std::vector<IncomingVideoSink>> _pendingVideoSinks;
     std::vector<VideoChannelDescription> _pendingRequestedVideo;
 
     std::unique_ptr<IncomingVideoChannel> _serverBandwidthProbingVideoSsrc;
 
     absl::optional<GroupJoinVideoInformation> _sharedVideoInformation;
 
-    std::vector<float> _externalAudioSamples;
-    webrtc::Mutex _externalAudioSamplesMutex;
+    std::shared_ptr<BufferedExternalAudioSource> _bufferedExternalAudioSource;
+    std::shared_ptr<ExternalAudioPuller> _externalAudioPuller;
     std::shared_ptr<ExternalAudioRecorder> _externalAudioRecorder;
 
     bool _isRtcConnected = false;
@@ -3463,8 +3773,10 @@ GroupInstanceCustomImpl::GroupInstanceCustomImpl(GroupInstanceDescriptor &&descr
     }
 
     _threads = descriptor.threads;
-    _internal.reset(new ThreadLocalObject<GroupInstanceCustomInternal>(_threads->getMediaThread(), [descriptor = std::move(descriptor), threads = _threads]() mutable {
-        return new GroupInstanceCustomInternal(std::move(descriptor), threads);
+    _metrics = std::make_shared<MetricsRegistry>();
+    ThreadInstrumentation::addQueueDepthMetrics(_metrics);
+    _internal.reset(new ThreadLocalObject<GroupInstanceCustomInternal>(_threads->getMediaThread(), [descriptor = std::move(descriptor), threads = _threads, metrics = _metrics]() mutable {
+        return new GroupInstanceCustomInternal(std::move(descriptor), threads, metrics);
     }));
     _internal->perform(RTC_FROM_HERE, [](GroupInstanceCustomInternal *internal) {
         internal->start();
@@ -3559,6 +3871,12 @@ void GroupInstanceCustomImpl::addExternalAudioSamples(std::vector<uint8_t> &&sam
     });
 }
 
+void GroupInstanceCustomImpl::setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source) {
+    _internal->perform(RTC_FROM_HERE, [source](GroupInstanceCustomInternal *internal) {
+        internal->setExternalAudioSource(source);
+    });
+}
+
 void GroupInstanceCustomImpl::addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
     _internal->perform(RTC_FROM_HERE, [sink](GroupInstanceCustomInternal *internal) mutable {
         internal->addOutgoingVideoOutput(sink);
@@ -3566,8 +3884,12 @@ void GroupInstanceCustomImpl::addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSin
 }
 
 void GroupInstanceCustomImpl::addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
-    _internal->perform(RTC_FROM_HERE, [endpointId, sink](GroupInstanceCustomInternal *internal) mutable {
-        internal->addIncomingVideoOutput(endpointId, sink);
+    addIncomingVideoOutput(endpointId, sink, VideoSinkOptions());
+}
+
+void GroupInstanceCustomImpl::addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+    _internal->perform(RTC_FROM_HERE, [endpointId, sink, options](GroupInstanceCustomInternal *internal) mutable {
+        internal->addIncomingVideoOutput(endpointId, sink, options);
     });
 }
 
@@ -3589,6 +3911,10 @@ void GroupInstanceCustomImpl::getStats(std::function<void(GroupInstanceStats)> c
     });
 }
 
+std::shared_ptr<MetricsRegistry> GroupInstanceCustomImpl::getMetrics() {
+    return _metrics;
+}
+
 std::vector<GroupInstanceInterface::AudioDevice> GroupInstanceInterface::getAudioDevices(AudioDevice::Type type) {
   auto result = std::vector<AudioDevice>();
 #ifdef WEBRTC_LINUX //Not needed for ios, and some crl::sync stuff is needed for windows
@@ -37,17 +37,21 @@ public:
     void setAudioOutputDevice(std::string id);
     void setAudioInputDevice(std::string id);
     void addExternalAudioSamples(std::vector<uint8_t> &&samples);
+    void setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source);
     
     void addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink);
     void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink);
+    void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options);
     
     void setVolume(uint32_t ssrc, double volume);
     void setRequestedVideoChannels(std::vector<VideoChannelDescription> &&requestedVideoChannels);
 
     void getStats(std::function<void(GroupInstanceStats)> completion);
+    std::shared_ptr<MetricsRegistry> getMetrics();
 
 private:
     std::shared_ptr<Threads> _threads;
+    std::shared_ptr<MetricsRegistry> _metrics;
     std::unique_ptr<ThreadLocalObject<GroupInstanceCustomInternal>> _internal;
     std::unique_ptr<LogSinkImpl> _logSink;
 
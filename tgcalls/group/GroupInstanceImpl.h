@@ -27,6 +27,8 @@ namespace tgcalls {
 
 class LogSinkImpl;
 class GroupInstanceManager;
+class BroadcastPartCache;
+class SharedMediaFactories;
 struct AudioFrame;
 
 struct GroupConfig {
@@ -131,10 +133,28 @@ struct VideoChannelDescription {
     Quality maxQuality = Quality::Thumbnail;
 };
 
+// What a sink wants to get, in the spirit of rtc::VideoSinkWants.
+struct VideoSinkOptions {
+    // Frames go through a single-slot mailbox drained on a delivery queue
+    // shared between async sinks, see SharedMediaFactories. A slow sink then
+    // misses frames instead of stalling decoding.
+    bool deliverAsync = false;
+    // Larger frames are downscaled for this sink keeping the aspect ratio, 0 is unconstrained.
+    // The endpoint's requested quality is also lowered to what its sinks can display.
+    int maxWidth = 0;
+    int maxHeight = 0;
+    // Frames beyond this rate are skipped, 0 is unconstrained.
+    int maxFramerate = 0;
+};
+
 struct GroupInstanceStats {
     struct IncomingVideoStats {
         int receivingQuality = 0;
         int availableQuality = 0;
+        // Summed over the endpoint's sinks. Dropped frames were replaced in an
+        // async sink's mailbox before the sink got to them.
+        int64_t deliveredFrames = 0;
+        int64_t droppedFrames = 0;
     };
 
     std::vector<std::pair<std::string, IncomingVideoStats>> incomingVideoStats;
@@ -156,6 +176,7 @@ struct GroupInstanceDescriptor {
     std::function<std::shared_ptr<BroadcastPartTask>(std::function<void(int64_t)>)> requestCurrentTime;
     std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, std::function<void(BroadcastPart &&)>)> requestAudioBroadcastPart;
     std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, int32_t, VideoChannelDescription::Quality, std::function<void(BroadcastPart &&)>)> requestVideoBroadcastPart;
+    std::shared_ptr<BroadcastPartCache> broadcastPartCache;
     int outgoingAudioBitrateKbit{32};
     bool disableOutgoingAudioProcessing{false};
     bool disableAudioInput{false};
@@ -164,11 +185,16 @@ struct GroupInstanceDescriptor {
     std::vector<VideoCodecName> videoCodecPreferences;
     std::function<std::shared_ptr<RequestMediaChannelDescriptionTask>(std::vector<uint32_t> const &, std::function<void(std::vector<MediaChannelDescription> &&)>)> requestMediaChannelDescriptions;
     int minOutgoingVideoBitrateKbit{100};
+    // The stateless factories and sink delivery queues, see SharedMediaFactories.
+    // Each call makes its own when empty.
+    std::shared_ptr<SharedMediaFactories> sharedMediaFactories;
 };
 
 template <typename T>
 class ThreadLocalObject;
 
+class MetricsRegistry;
+
 class GroupInstanceInterface {
 protected:
     GroupInstanceInterface() = default;
@@ -192,14 +218,18 @@ public:
     virtual void setAudioOutputDevice(std::string id) = 0;
     virtual void setAudioInputDevice(std::string id) = 0;
     virtual void addExternalAudioSamples(std::vector<uint8_t> &&samples) = 0;
+    // Screencasts send this instead of the pushed samples, nullptr goes back to them.
+    virtual void setExternalAudioSource(std::shared_ptr<ExternalAudioSource> source) = 0;
 
     virtual void addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) = 0;
     virtual void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) = 0;
+    virtual void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) = 0;
 
     virtual void setVolume(uint32_t ssrc, double volume) = 0;
     virtual void setRequestedVideoChannels(std::vector<VideoChannelDescription> &&requestedVideoChannels) = 0;
 
     virtual void getStats(std::function<void(GroupInstanceStats)> completion) = 0;
+    virtual std::shared_ptr<MetricsRegistry> getMetrics() = 0;
 
     struct AudioDevice {
       enum class Type {Input, Output};
@@ -31,7 +31,8 @@ enum {
     kRtpMinParseLength = 12
 };
 
-static void updateHeaderWithVoiceActivity(rtc::CopyOnWriteBuffer *packet, const uint8_t* ptrRTPDataExtensionEnd, const uint8_t* ptr, bool voiceActivity) {
+// Returns the offset of the audio level byte in the one-byte header extension block, 0 if there is none.
+static size_t findHeaderAudioLevelOffset(const uint8_t *packetData, const uint8_t* ptrRTPDataExtensionEnd, const uint8_t* ptr) {
     while (ptrRTPDataExtensionEnd - ptr > 0) {
         //  0
         //  0 1 2 3 4 5 6 7
@@ -53,31 +54,23 @@ static void updateHeaderWithVoiceActivity(rtc::CopyOnWriteBuffer *packet, const
         if (id == 15) {
             RTC_LOG(LS_VERBOSE)
             << "RTP extension header 15 encountered. Terminate parsing.";
-            return;
+            return 0;
         }
 
         if (ptrRTPDataExtensionEnd - ptr < (len + 1)) {
             RTC_LOG(LS_WARNING) << "Incorrect one-byte extension len: " << (len + 1)
             << ", bytes left in buffer: "
             << (ptrRTPDataExtensionEnd - ptr);
-            return;
+            return 0;
         }
 
         if (id == 1) { // kAudioLevelUri
-            uint8_t audioLevel = ptr[0] & 0x7f;
-            bool parsedVoiceActivity = (ptr[0] & 0x80) != 0;
-
-            if (parsedVoiceActivity != voiceActivity) {
-                ptrdiff_t byteOffset = ptr - packet->data();
-                uint8_t *mutableBytes = packet->MutableData();
-                uint8_t audioActivityBit = voiceActivity ? 0x80 : 0;
-                mutableBytes[byteOffset] = audioLevel | audioActivityBit;
-            }
-            return;
+            return (size_t)(ptr - packetData);
         }
 
         ptr += (len + 1);
     }
+    return 0;
 }
 
 static void readHeaderVoiceActivity(const uint8_t* ptrRTPDataExtensionEnd, const uint8_t* ptr, bool &didRead, uint8_t &audioLevel, bool &voiceActivity) {
@@ -125,13 +118,14 @@ static void readHeaderVoiceActivity(const uint8_t* ptrRTPDataExtensionEnd, const
 }
 
 
-static void maybeUpdateRtpVoiceActivity(rtc::CopyOnWriteBuffer *packet, bool voiceActivity) {
+// Returns the offset of the audio level byte of an outgoing Opus packet, 0 if it has none.
+static size_t findRtpAudioLevelOffset(rtc::CopyOnWriteBuffer const *packet) {
     const uint8_t *_ptrRTPDataBegin = packet->data();
     const uint8_t *_ptrRTPDataEnd = packet->data() + packet->size();
 
     const ptrdiff_t length = _ptrRTPDataEnd - _ptrRTPDataBegin;
     if (length < kRtpMinParseLength) {
-        return;
+        return 0;
     }
 
     // Version
@@ -149,17 +143,17 @@ static void maybeUpdateRtpVoiceActivity(rtc::CopyOnWriteBuffer *packet, bool voi
     ptr += 4;
 
     if (V != kRtpExpectedVersion) {
-        return;
+        return 0;
     }
 
     const size_t CSRCocts = CC * 4;
 
     if ((ptr + CSRCocts) > _ptrRTPDataEnd) {
-        return;
+        return 0;
     }
 
     if (PT != 111) {
-        return;
+        return 0;
     }
 
     for (uint8_t i = 0; i < CC; ++i) {
@@ -178,7 +172,7 @@ static void maybeUpdateRtpVoiceActivity(rtc::CopyOnWriteBuffer *packet, bool voi
       */
       const ptrdiff_t remain = _ptrRTPDataEnd - ptr;
       if (remain < 4) {
-          return;
+          return 0;
       }
 
       uint16_t definedByProfile = webrtc::ByteReader<uint16_t>::ReadBigEndian(ptr);
@@ -190,14 +184,15 @@ static void maybeUpdateRtpVoiceActivity(rtc::CopyOnWriteBuffer *packet, bool voi
       XLen *= 4;  // in bytes
 
       if (static_cast<size_t>(remain) < (4 + XLen)) {
-          return;
+          return 0;
       }
       static constexpr uint16_t kRtpOneByteHeaderExtensionId = 0xBEDE;
       if (definedByProfile == kRtpOneByteHeaderExtensionId) {
           const uint8_t* ptrRTPDataExtensionEnd = ptr + XLen;
-          updateHeaderWithVoiceActivity(packet, ptrRTPDataExtensionEnd, ptr, voiceActivity);
+          return findHeaderAudioLevelOffset(_ptrRTPDataBegin, ptrRTPDataExtensionEnd, ptr);
       }
     }
+    return 0;
 }
 
 static void maybeReadRtpVoiceActivity(rtc::CopyOnWriteBuffer *packet, bool &didRead, uint32_t &ssrc, uint8_t &audioLevel, bool &voiceActivity) {
@@ -290,9 +285,26 @@ public:
     }
 
     bool SendRtpPacket(rtc::CopyOnWriteBuffer *packet, const rtc::PacketOptions& options, int flags) override {
-        maybeUpdateRtpVoiceActivity(packet, _voiceActivity);
+        updateVoiceActivity(packet);
         return webrtc::DtlsSrtpTransport::SendRtpPacket(packet, options, flags);
     }
+
+private:
+    void updateVoiceActivity(rtc::CopyOnWriteBuffer *packet) {
+        // The extensions are walked for every packet, their set and order
+        // change while the call negotiates them.
+        const auto offset = findRtpAudioLevelOffset(packet);
+        if (offset == 0) {
+            return;
+        }
+
+        const uint8_t current = packet->cdata()[offset];
+        const uint8_t updated = (current & 0x7f) | (_voiceActivity ? 0x80 : 0);
+        if (current != updated) {
+            // The packet was just serialized for this send, so this doesn't copy it.
+            packet->MutableData()[offset] = updated;
+        }
+    }
 };
 
 webrtc::CryptoOptions GroupNetworkManager::getDefaulCryptoOptions() {
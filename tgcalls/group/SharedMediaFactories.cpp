@@ -0,0 +1,59 @@
+#include "SharedMediaFactories.h"
+
+#include "api/audio_codecs/audio_decoder_factory_template.h"
+#include "api/audio_codecs/audio_encoder_factory_template.h"
+#include "api/audio_codecs/opus/audio_decoder_opus.h"
+#include "api/audio_codecs/opus/audio_encoder_opus.h"
+#include "api/audio_codecs/L16/audio_decoder_L16.h"
+#include "api/audio_codecs/L16/audio_encoder_L16.h"
+#include "api/rtc_event_log/rtc_event_log.h"
+#include "api/task_queue/default_task_queue_factory.h"
+#include "modules/audio_coding/neteq/default_neteq_factory.h"
+
+#include "VideoSinkDelivery.h"
+
+namespace tgcalls {
+
+namespace {
+
+class CustomNetEqFactory: public webrtc::NetEqFactory {
+public:
+    virtual ~CustomNetEqFactory() = default;
+
+    std::unique_ptr<webrtc::NetEq> CreateNetEq(
+        const webrtc::NetEq::Config& config,
+        const rtc::scoped_refptr<webrtc::AudioDecoderFactory>& decoder_factory, webrtc::Clock* clock
+    ) const override {
+        webrtc::NetEq::Config updatedConfig = config;
+        updatedConfig.sample_rate_hz = 48000;
+        return webrtc::DefaultNetEqFactory().CreateNetEq(updatedConfig, decoder_factory, clock);
+    }
+};
+
+} // namespace
+
+std::shared_ptr<SharedMediaFactories> SharedMediaFactories::create() {
+    return std::shared_ptr<SharedMediaFactories>(new SharedMediaFactories());
+}
+
+SharedMediaFactories::SharedMediaFactories() :
+_taskQueueFactory(webrtc::CreateDefaultTaskQueueFactory()),
+_netEqFactory(std::make_unique<CustomNetEqFactory>()),
+_eventLog(std::make_unique<webrtc::RtcEventLogNull>()),
+_audioEncoderFactory(webrtc::CreateAudioEncoderFactory<webrtc::AudioEncoderOpus, webrtc::AudioEncoderL16>()),
+_audioDecoderFactory(webrtc::CreateAudioDecoderFactory<webrtc::AudioDecoderOpus, webrtc::AudioDecoderL16>()),
+_videoSinkDeliveryQueues(std::make_unique<VideoSinkDeliveryQueues>(_taskQueueFactory.get())) {
+}
+
+SharedMediaFactories::~SharedMediaFactories() {
+}
+
+rtc::scoped_refptr<webrtc::AudioEncoderFactory> SharedMediaFactories::audioEncoderFactory() const {
+    return _audioEncoderFactory;
+}
+
+rtc::scoped_refptr<webrtc::AudioDecoderFactory> SharedMediaFactories::audioDecoderFactory() const {
+    return _audioDecoderFactory;
+}
+
+} // namespace tgcalls
@@ -0,0 +1,74 @@
+#ifndef TGCALLS_SHARED_MEDIA_FACTORIES_H
+#define TGCALLS_SHARED_MEDIA_FACTORIES_H
+
+#include "api/scoped_refptr.h"
+
+#include <memory>
+
+namespace webrtc {
+class AudioDecoderFactory;
+class AudioEncoderFactory;
+class NetEqFactory;
+class RtcEventLog;
+class TaskQueueFactory;
+}
+
+namespace tgcalls {
+
+class VideoSinkDeliveryQueues;
+
+// The stateless factories a group call builds its media engine and Call from,
+// and the task queues its async video sinks are drained on. Every call makes its
+// own unless GroupInstanceDescriptor::sharedMediaFactories is set.
+//
+// This is not a shared media engine. Each call still creates its own audio
+// processing, video codec factories, channel manager, media engine and Call,
+// and every task queue made through the shared factory is still a thread of
+// its own. Sharing saves building the factories again and lets the calls use
+// the same two sink delivery queues, nothing more.
+// Keeps no per-call state, so it is fine to share across threads.
+class SharedMediaFactories {
+public:
+    static std::shared_ptr<SharedMediaFactories> create();
+
+    ~SharedMediaFactories();
+
+    SharedMediaFactories(const SharedMediaFactories&) = delete;
+    SharedMediaFactories& operator=(const SharedMediaFactories&) = delete;
+
+    webrtc::TaskQueueFactory *taskQueueFactory() const {
+        return _taskQueueFactory.get();
+    }
+
+    webrtc::NetEqFactory *netEqFactory() const {
+        return _netEqFactory.get();
+    }
+
+    webrtc::RtcEventLog *eventLog() const {
+        return _eventLog.get();
+    }
+
+    rtc::scoped_refptr<webrtc::AudioEncoderFactory> audioEncoderFactory() const;
+    rtc::scoped_refptr<webrtc::AudioDecoderFactory> audioDecoderFactory() const;
+
+    // Lives as long as this object.
+    VideoSinkDeliveryQueues *videoSinkDeliveryQueues() const {
+        return _videoSinkDeliveryQueues.get();
+    }
+
+private:
+    SharedMediaFactories();
+
+    std::unique_ptr<webrtc::TaskQueueFactory> _taskQueueFactory;
+    std::unique_ptr<webrtc::NetEqFactory> _netEqFactory;
+    // A null log, which ignores everything it gets.
+    std::unique_ptr<webrtc::RtcEventLog> _eventLog;
+    rtc::scoped_refptr<webrtc::AudioEncoderFactory> _audioEncoderFactory;
+    rtc::scoped_refptr<webrtc::AudioDecoderFactory> _audioDecoderFactory;
+    // Declared after the task queue factory it creates its queues with.
+    std::unique_ptr<VideoSinkDeliveryQueues> _videoSinkDeliveryQueues;
+};
+
+} // namespace tgcalls
+
+#endif
@@ -2,19 +2,27 @@
 
 #include "AudioStreamingPart.h"
 #include "VideoStreamingPart.h"
+#include "StreamingVideoDecoder.h"
+#include "BroadcastPartCache.h"
+#include "../Metrics.h"
 
 #include "absl/types/optional.h"
 #include "rtc_base/thread.h"
 #include "rtc_base/time_utils.h"
 #include "absl/types/variant.h"
 #include "rtc_base/logging.h"
-#include "rtc_base/synchronization/mutex.h"
-#include "common_audio/ring_buffer.h"
 #include "modules/audio_mixer/frame_combiner.h"
 #include "modules/audio_processing/agc2/vad_wrapper.h"
 #include "modules/audio_processing/audio_buffer.h"
 #include "api/video/video_sink_interface.h"
 #include "audio/utility/audio_frame_operations.h"
+#include "api/task_queue/default_task_queue_factory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <thread>
 
 namespace tgcalls {
 
@@ -37,9 +45,9 @@ struct PendingVideoSegmentData {
 };
 
 struct PendingMediaSegmentPartResult {
-    std::vector<uint8_t> data;
+    std::shared_ptr<StreamingPartData> data;
 
-    explicit PendingMediaSegmentPartResult(std::vector<uint8_t> &&data_) :
+    explicit PendingMediaSegmentPartResult(std::shared_ptr<StreamingPartData> data_) :
     data(std::move(data_)) {
     }
 };
@@ -58,18 +66,46 @@ struct PendingMediaSegment {
     std::vector<std::shared_ptr<PendingMediaSegmentPart>> parts;
 };
 
+// A part being looked up in the part cache, followed by its request when the
+// cache does not have it. The request is started and cancelled on the media
+// thread; the lookup only reads the flag.
+class CachedBroadcastPartTask final : public BroadcastPartTask {
+public:
+    void cancel() override {
+        _isCancelled = true;
+        if (_requestTask) {
+            _requestTask->cancel();
+            _requestTask.reset();
+        }
+    }
+
+    bool isCancelled() const {
+        return _isCancelled;
+    }
+
+    void setRequestTask(std::shared_ptr<BroadcastPartTask> requestTask) {
+        _requestTask = std::move(requestTask);
+    }
+
+private:
+    std::atomic<bool> _isCancelled{false};
+    std::shared_ptr<BroadcastPartTask> _requestTask;
+};
+
 struct VideoSegment {
     VideoChannelDescription::Quality quality;
-    std::shared_ptr<VideoStreamingPart> part;
+    std::shared_ptr<StreamingVideoDecoder> decoder;
     double lastFramePts = -1.0;
+    int64_t lastFrameDeliveredAtUs = 0;
     int _displayedFrames = 0;
     bool isPlaying = false;
     std::shared_ptr<PendingMediaSegmentPart> pendingVideoQualityUpdatePart;
 };
 
 struct UnifiedSegment {
-    std::shared_ptr<VideoStreamingPart> videoPart;
+    std::shared_ptr<StreamingVideoDecoder> decoder;
     double lastFramePts = -1.0;
+    int64_t lastFrameDeliveredAtUs = 0;
     int _displayedFrames = 0;
     bool isPlaying = false;
 };
@@ -81,34 +117,69 @@ struct MediaSegment {
     std::shared_ptr<VideoStreamingPart> unifiedAudio;
     std::vector<std::shared_ptr<VideoSegment>> video;
     std::vector<std::shared_ptr<UnifiedSegment>> unified;
+    // Samples of this segment already handed to the ring buffer.
+    int64_t writtenAudioSamples = 0;
+};
+
+// Where in the broadcast a sample written to the ring buffer belongs.
+struct AudioClockMark {
+    int64_t samplePosition = 0;
+    int64_t mediaTimeUs = 0;
 };
 
+// Decoded broadcast audio on its way from the media thread, the only writer,
+// to the audio render thread, the only reader. Neither side ever waits for the
+// other. Positions count every sample that went through the buffer.
 class SampleRingBuffer {
 public:
-    SampleRingBuffer(size_t size) {
-        _buffer = WebRtc_CreateBuffer(size, sizeof(int16_t));
+    SampleRingBuffer(size_t size) :
+    _samples(size) {
     }
 
-    ~SampleRingBuffer() {
-        if (_buffer) {
-            WebRtc_FreeBuffer(_buffer);
-        }
+    // Writer.
+    int64_t writePosition() const {
+        return _writePosition.load(std::memory_order_relaxed);
     }
 
-    size_t availableForWriting() {
-        return WebRtc_available_write(_buffer);
+    // Writer.
+    size_t availableForWriting() const {
+        const auto used = _writePosition.load(std::memory_order_relaxed) - _readPosition.load(std::memory_order_acquire);
+        return _samples.size() - (size_t)used;
     }
 
+    // Writer. Writes as much as fits and returns how much that was.
     size_t write(int16_t const *samples, size_t count) {
-        return WebRtc_WriteBuffer(_buffer, samples, count);
+        const auto position = _writePosition.load(std::memory_order_relaxed);
+        count = std::min(count, availableForWriting());
+        const auto offset = (size_t)(position % (int64_t)_samples.size());
+        const auto first = std::min(count, _samples.size() - offset);
+        std::copy(samples, samples + first, _samples.begin() + offset);
+        std::copy(samples + first, samples + count, _samples.begin());
+        _writePosition.store(position + count, std::memory_order_release);
+        return count;
+    }
+
+    // Reader.
+    int64_t readPosition() const {
+        return _readPosition.load(std::memory_order_relaxed);
     }
 
+    // Reader. Reads as much as there is and returns how much that was.
     size_t read(int16_t *samples, size_t count) {
-        return WebRtc_ReadBuffer(_buffer, nullptr, samples, count);
+        const auto position = _readPosition.load(std::memory_order_relaxed);
+        count = std::min(count, (size_t)(_writePosition.load(std::memory_order_acquire) - position));
+        const auto offset = (size_t)(position % (int64_t)_samples.size());
+        const auto first = std::min(count, _samples.size() - offset);
+        std::copy(_samples.begin() + offset, _samples.begin() + offset + first, samples);
+        std::copy(_samples.begin(), _samples.begin() + (count - first), samples + first);
+        _readPosition.store(position + count, std::memory_order_release);
+        return count;
     }
 
 private:
-    RingBuffer *_buffer = nullptr;
+    std::vector<int16_t> _samples;
+    std::atomic<int64_t> _writePosition{ 0 };
+    std::atomic<int64_t> _readPosition{ 0 };
 };
 
 static const int kVadResultHistoryLength = 8;
@@ -243,11 +314,24 @@ public:
     _requestAudioBroadcastPart(arguments.requestAudioBroadcastPart),
     _requestVideoBroadcastPart(arguments.requestVideoBroadcastPart),
     _updateAudioLevel(arguments.updateAudioLevel),
+    _partCache(arguments.partCache),
+    _metrics(arguments.metrics ? arguments.metrics : std::make_shared<MetricsRegistry>()),
+    _renderLatenessMetric(_metrics->histogram("streaming.render_lateness_ms")),
+    _frameDecodeTimeMetric(_metrics->histogram("streaming.frame_decode_us")),
+    _renderedFramesMetric(_metrics->counter("streaming.rendered_frames")),
+    _lateVideoFramesMetric(_metrics->counter("streaming.late_video_frames")),
+    _avOffsetMetric(_metrics->histogram("streaming.av_offset_us")),
+    _frameJitterMetric(_metrics->histogram("streaming.frame_jitter_us")),
+    _taskQueueFactory(webrtc::CreateDefaultTaskQueueFactory()),
     _audioRingBuffer(_audioDataRingBufferMaxSize),
     _audioFrameCombiner(false) {
     }
 
     ~StreamingMediaContextPrivate() {
+        // Stopping a worker waits for the frame it is decoding, which uses the
+        // metrics, and drops the decode tasks still queued. This has to happen
+        // before the segments with their decoders and the metrics go away.
+        _videoDecodeWorkers.clear();
     }
 
     void start() {
@@ -256,20 +340,202 @@ public:
 
     void beginRenderTimer(int timeoutMs) {
         const auto weak = std::weak_ptr<StreamingMediaContextPrivate>(shared_from_this());
-        _threads->getMediaThread()->PostDelayedTask(RTC_FROM_HERE, [weak]() {
+        const auto deadline = rtc::TimeMillis() + timeoutMs;
+        _threads->getMediaThread()->PostDelayedTask(RTC_FROM_HERE, [weak, deadline]() {
             auto strong = weak.lock();
             if (!strong) {
                 return;
             }
 
+            strong->_renderLatenessMetric->record(rtc::TimeMillis() - deadline);
             strong->render();
 
-            strong->beginRenderTimer((int)(1.0 * 1000.0 / 120.0));
+            strong->beginRenderTimer(strong->nextRenderTimeoutMs());
         }, timeoutMs);
     }
 
+    // Wakes up when the earliest next video frame is due, and often enough
+    // in between to keep the audio ring buffer filled.
+    int nextRenderTimeoutMs() const {
+        auto timeoutUs = kMaxRenderIntervalUs;
+        if (_nextVideoFrameDueUs != 0) {
+            timeoutUs = std::min(timeoutUs, _nextVideoFrameDueUs - rtc::TimeMicros());
+        }
+        // Delayed tasks have millisecond resolution, rounding up keeps the
+        // wakeup from coming before the frame is due.
+        return (int)std::max(int64_t(1), (timeoutUs + 999) / 1000);
+    }
+
+    // Video follows the audio the device is playing. Until the device has
+    // played any, or once it stops pulling, the wall clock stands in.
+    double videoRelativeTimestamp(int64_t segmentTimestamp, double wallRelativeTimestamp, double segmentDuration) {
+        updateAudioClock();
+        auto mediaTimeUs = _audioClockMediaTimeUs;
+        const auto updatedAtUs = _audioClockUpdatedAtUs;
+        const auto nowUs = rtc::TimeMicros();
+        if (updatedAtUs == 0 || nowUs - updatedAtUs > kAudioClockTimeoutUs) {
+            return wallRelativeTimestamp;
+        }
+        // The device pulls every 10 ms, in between the clock runs on.
+        mediaTimeUs += std::min(nowUs - updatedAtUs, kAudioClockExtrapolationUs);
+        const auto audioRelativeTimestamp = ((double)(mediaTimeUs - segmentTimestamp * 1000)) / 1000000.0;
+        if (audioRelativeTimestamp < -segmentDuration || audioRelativeTimestamp > 2.0 * segmentDuration) {
+            return wallRelativeTimestamp;
+        }
+        if (audioRelativeTimestamp < 0.0) {
+            // Still playing the end of the previous segment's audio.
+            _nextVideoFrameDueUs = nowUs + (int64_t)(-audioRelativeTimestamp * 1000000.0);
+        }
+        return audioRelativeTimestamp;
+    }
+
+    void recordVideoFrameTiming(StreamingVideoDecoder const &decoder, VideoStreamingPartFrame const &frame, double videoTimestamp, double lastFramePts, int64_t &lastFrameDeliveredAtUs) {
+        const auto nowUs = rtc::TimeMicros();
+        _avOffsetMetric->record((int64_t)((videoTimestamp - decoder.currentFrameStartTimestamp()) * 1000000.0));
+        if (lastFrameDeliveredAtUs != 0 && lastFramePts >= 0.0 && frame.pts > lastFramePts) {
+            const auto expectedUs = (int64_t)((frame.pts - lastFramePts) * 1000000.0);
+            _frameJitterMetric->record(std::abs((nowUs - lastFrameDeliveredAtUs) - expectedUs));
+        }
+        lastFrameDeliveredAtUs = nowUs;
+    }
+
+    void noteNextVideoFrameDue(StreamingVideoDecoder const &decoder, double videoTimestamp) {
+        const auto next = decoder.nextFrameTimestamp();
+        if (!next) {
+            return;
+        }
+        const auto dueUs = rtc::TimeMicros() + (int64_t)((next.value() - videoTimestamp) * 1000000.0);
+        if (_nextVideoFrameDueUs == 0 || dueUs < _nextVideoFrameDueUs) {
+            _nextVideoFrameDueUs = dueUs;
+        }
+    }
+
+    void writeAudio(MediaSegment &segment, int16_t const *samples, size_t count) {
+        // Also drops the marks the device has played past.
+        updateAudioClock();
+
+        AudioClockMark mark;
+        mark.mediaTimeUs = segment.timestamp * 1000 + segment.writtenAudioSamples * 1000000 / 48000;
+        segment.writtenAudioSamples += count;
+
+        mark.samplePosition = _audioRingBuffer.writePosition();
+        _audioRingBuffer.write(samples, count);
+        _audioClockMarks.push_back(mark);
+    }
+
+    // Audio render thread, after the device read samples from `position` on.
+    void publishAudioRead(int64_t position) {
+        // A sequence lock with a single writer: the count is odd while the
+        // pair is being replaced.
+        const auto sequence = _audioReadSequence.load(std::memory_order_relaxed);
+        _audioReadSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _audioReadPosition.store(position, std::memory_order_relaxed);
+        _audioReadAtUs.store(rtc::TimeMicros(), std::memory_order_relaxed);
+        _audioReadSequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Media thread. False when the render thread was publishing a read just
+    // then, the clock keeps running on the previous one.
+    bool loadAudioRead(int64_t &position, int64_t &readAtUs) const {
+        const auto sequence = _audioReadSequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            return false;
+        }
+        position = _audioReadPosition.load(std::memory_order_relaxed);
+        readAtUs = _audioReadAtUs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _audioReadSequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+    // Media thread.
+    void updateAudioClock() {
+        int64_t position = 0;
+        int64_t readAtUs = 0;
+        if (!loadAudioRead(position, readAtUs) || readAtUs == 0 || readAtUs == _audioClockUpdatedAtUs) {
+            return;
+        }
+
+        while (_audioClockMarks.size() > 1 && _audioClockMarks[1].samplePosition <= position) {
+            _audioClockMarks.pop_front();
+        }
+        if (_audioClockMarks.empty() || _audioClockMarks.front().samplePosition > position) {
+            return;
+        }
+        const auto &mark = _audioClockMarks.front();
+        _audioClockMediaTimeUs = mark.mediaTimeUs + (position - mark.samplePosition) * 1000000 / 48000;
+        _audioClockUpdatedAtUs = readAtUs;
+    }
+
+    // Shows whatever frames of the segment's videos are due at `videoTimestamp`.
+    void presentVideo(MediaSegment &segment, double videoTimestamp) {
+        for (auto &videoSegment : segment.video) {
+            videoSegment->isPlaying = true;
+            cancelPendingVideoQualityUpdate(videoSegment);
+
+            auto frame = videoSegment->decoder->getFrameAtRelativeTimestamp(videoTimestamp);
+            if (frame) {
+                if (videoSegment->lastFramePts != frame->pts) {
+                    recordVideoFrameTiming(*videoSegment->decoder, frame.value(), videoTimestamp, videoSegment->lastFramePts, videoSegment->lastFrameDeliveredAtUs);
+                    videoSegment->lastFramePts = frame->pts;
+                    videoSegment->_displayedFrames += 1;
+                    _renderedFramesMetric->add();
+
+                    auto sinkList = _videoSinks.find(frame->endpointId);
+                    if (sinkList != _videoSinks.end()) {
+                        for (const auto &weakSink : sinkList->second) {
+                            auto sink = weakSink.lock();
+                            if (sink) {
+                                sink->OnFrame(frame->frame);
+                            }
+                        }
+                    }
+                }
+            }
+            noteNextVideoFrameDue(*videoSegment->decoder, videoTimestamp);
+        }
+
+        for (auto &videoSegment : segment.unified) {
+            videoSegment->isPlaying = true;
+
+            auto frame = videoSegment->decoder->getFrameAtRelativeTimestamp(videoTimestamp);
+            if (frame) {
+                if (videoSegment->lastFramePts != frame->pts) {
+                    recordVideoFrameTiming(*videoSegment->decoder, frame.value(), videoTimestamp, videoSegment->lastFramePts, videoSegment->lastFrameDeliveredAtUs);
+                    videoSegment->lastFramePts = frame->pts;
+                    videoSegment->_displayedFrames += 1;
+                    _renderedFramesMetric->add();
+
+                    auto sinkList = _videoSinks.find("unified");
+                    if (sinkList != _videoSinks.end()) {
+                        for (const auto &weakSink : sinkList->second) {
+                            auto sink = weakSink.lock();
+                            if (sink) {
+                                sink->OnFrame(frame->frame);
+                            }
+                        }
+                    }
+                }
+            }
+            noteNextVideoFrameDue(*videoSegment->decoder, videoTimestamp);
+        }
+    }
+
+    void dropPreviousSegment() {
+        if (!_previousSegment) {
+            return;
+        }
+        if (!_previousSegment->video.empty()) {
+            if (!_previousSegment->video[0]->decoder->isFinished()) {
+                RTC_LOG(LS_INFO) << "render: discarding video frames at the end of a segment (displayed " << _previousSegment->video[0]->_displayedFrames << " frames)";
+            }
+        }
+        _previousSegment.reset();
+    }
+
     void render() {
         int64_t absoluteTimestamp = rtc::TimeMillis();
+        _nextVideoFrameDueUs = 0;
 
         while (true) {
             if (_waitForBufferredMillisecondsBeforeRendering) {
@@ -282,6 +548,7 @@ public:
 
             if (_availableSegments.empty()) {
                 _playbackReferenceTimestamp = 0;
+                dropPreviousSegment();
 
                 _waitForBufferredMillisecondsBeforeRendering = _segmentBufferDuration + _segmentDuration;
 
@@ -296,70 +563,44 @@ public:
 
             auto segment = _availableSegments[0];
             double segmentDuration = ((double)segment->duration) / 1000.0;
-
-            for (auto &videoSegment : segment->video) {
-                videoSegment->isPlaying = true;
-                cancelPendingVideoQualityUpdate(videoSegment);
-
-                auto frame = videoSegment->part->getFrameAtRelativeTimestamp(relativeTimestamp);
-                if (frame) {
-                    if (videoSegment->lastFramePts != frame->pts) {
-                        videoSegment->lastFramePts = frame->pts;
-                        videoSegment->_displayedFrames += 1;
-
-                        auto sinkList = _videoSinks.find(frame->endpointId);
-                        if (sinkList != _videoSinks.end()) {
-                            for (const auto &weakSink : sinkList->second) {
-                                auto sink = weakSink.lock();
-                                if (sink) {
-                                    sink->OnFrame(frame->frame);
-                                }
-                            }
-                        }
-                    }
+            const auto videoTimestamp = videoRelativeTimestamp(segment->timestamp, relativeTimestamp, segmentDuration);
+
+            // The previous segment's video stays up until the audio clock, which
+            // lags the wall clock by what the ring buffer holds, has played past
+            // its end. Until then the new segment's frames are not due yet.
+            bool isPreviousSegmentPlaying = false;
+            if (_previousSegment) {
+                const auto previousDuration = ((double)_previousSegment->duration) / 1000.0;
+                const auto previousTimestamp = videoRelativeTimestamp(_previousSegment->timestamp, relativeTimestamp + previousDuration, previousDuration);
+                if (previousTimestamp < previousDuration) {
+                    presentVideo(*_previousSegment, previousTimestamp);
+                    isPreviousSegmentPlaying = true;
+                } else {
+                    dropPreviousSegment();
                 }
             }
-
-            for (auto &videoSegment : segment->unified) {
-                videoSegment->isPlaying = true;
-
-                auto frame = videoSegment->videoPart->getFrameAtRelativeTimestamp(relativeTimestamp);
-                if (frame) {
-                    if (videoSegment->lastFramePts != frame->pts) {
-                        videoSegment->lastFramePts = frame->pts;
-                        videoSegment->_displayedFrames += 1;
-
-                        auto sinkList = _videoSinks.find("unified");
-                        if (sinkList != _videoSinks.end()) {
-                            for (const auto &weakSink : sinkList->second) {
-                                auto sink = weakSink.lock();
-                                if (sink) {
-                                    sink->OnFrame(frame->frame);
-                                }
-                            }
-                        }
-                    }
-                }
+            if (!isPreviousSegmentPlaying) {
+                presentVideo(*segment, videoTimestamp);
             }
 
             if (segment->audio) {
                 const auto available = [&] {
-                    _audioDataMutex.Lock();
-                    const auto result = (_audioRingBuffer.availableForWriting() >= 480);
-                    _audioDataMutex.Unlock();
-
-                    return result;
+                    return _audioRingBuffer.availableForWriting() >= 480;
                 };
                 while (available()) {
-                    auto audioChannels = segment->audio->get10msPerChannel(_persistentAudioDecoder);
-                    if (audioChannels.empty()) {
+                    if (!segment->audio->get10msPerChannel(_persistentAudioDecoder, _audioChannels)) {
                         break;
                     }
 
-                    std::vector<webrtc::AudioFrame *> audioFrames;
+                    // The frames are reused from chunk to chunk, the pool only
+                    // grows when a chunk has more channels than any before.
+                    while (_audioFramePool.size() < _audioChannels.size()) {
+                        _audioFramePool.push_back(std::make_unique<webrtc::AudioFrame>());
+                    }
+                    _audioFrames.clear();
 
-                    for (const auto &audioChannel : audioChannels) {
-                        webrtc::AudioFrame *frame = new webrtc::AudioFrame();
+                    for (const auto &audioChannel : _audioChannels) {
+                        webrtc::AudioFrame *frame = _audioFramePool[_audioFrames.size()].get();
                         frame->UpdateFrame(0, audioChannel.pcmData.data(), audioChannel.pcmData.size(), 48000, webrtc::AudioFrame::SpeechType::kNormalSpeech, webrtc::AudioFrame::VADActivity::kVadActive);
 
                         auto volumeIt = _volumeBySsrc.find(audioChannel.ssrc);
@@ -370,28 +611,17 @@ public:
                             }
                         }
 
-                        audioFrames.push_back(frame);
+                        _audioFrames.push_back(frame);
                         processAudioLevel(audioChannel.ssrc, audioChannel.pcmData);
                     }
 
-                    webrtc::AudioFrame frameOut;
-                    _audioFrameCombiner.Combine(audioFrames, 1, 48000, audioFrames.size(), &frameOut);
+                    _audioFrameCombiner.Combine(_audioFrames, 1, 48000, _audioFrames.size(), &_audioFrameOut);
 
-                    for (webrtc::AudioFrame *frame : audioFrames) {
-                        delete frame;
-                    }
-
-                    _audioDataMutex.Lock();
-                    _audioRingBuffer.write(frameOut.data(), frameOut.samples_per_channel());
-                    _audioDataMutex.Unlock();
+                    writeAudio(*segment, _audioFrameOut.data(), _audioFrameOut.samples_per_channel());
                 }
             } else if (segment->unifiedAudio) {
                 const auto available = [&] {
-                    _audioDataMutex.Lock();
-                    const auto result = (_audioRingBuffer.availableForWriting() >= 480);
-                    _audioDataMutex.Unlock();
-
-                    return result;
+                    return _audioRingBuffer.availableForWriting() >= 480;
                 };
                 while (available()) {
                     auto audioChannels = segment->unifiedAudio->getAudio10msPerChannel(_persistentAudioDecoder);
@@ -414,9 +644,7 @@ public:
                         }
                     }
 
-                    _audioDataMutex.Lock();
-                    _audioRingBuffer.write(frameOut.data(), frameOut.samples_per_channel());
-                    _audioDataMutex.Unlock();
+                    writeAudio(*segment, frameOut.data(), frameOut.samples_per_channel());
                 }
             }
 
@@ -426,12 +654,10 @@ public:
                 if (segment->audio && segment->audio->getRemainingMilliseconds() > 0) {
                     RTC_LOG(LS_INFO) << "render: discarding " << segment->audio->getRemainingMilliseconds() << " ms of audio at the end of a segment";
                 }
-                if (!segment->video.empty()) {
-                    if (segment->video[0]->part->getActiveEndpointId()) {
-                        RTC_LOG(LS_INFO) << "render: discarding video frames at the end of a segment (displayed " << segment->video[0]->_displayedFrames << " frames)";
-                    }
-                }
 
+                // Its audio is all written, its video plays out with the audio.
+                dropPreviousSegment();
+                _previousSegment = segment;
                 _availableSegments.erase(_availableSegments.begin());
             }
 
@@ -447,18 +673,21 @@ public:
             return;
         }
 
-        webrtc::AudioBuffer buffer(48000, 1, 48000, 1, 48000, 1);
+        // One buffer serves every channel, each copy overwrites all of it.
+        if (!_audioLevelBuffer) {
+            _audioLevelBuffer = std::make_unique<webrtc::AudioBuffer>(48000, 1, 48000, 1, 48000, 1);
+        }
         webrtc::StreamConfig config(48000, 1);
-        buffer.CopyFrom(samples.data(), config);
+        _audioLevelBuffer->CopyFrom(samples.data(), config);
 
         std::pair<float, bool> vadResult = std::make_pair(0.0f, false);
         auto vad = _audioVadMap.find(ssrc);
         if (vad == _audioVadMap.end()) {
             auto newVad = std::make_unique<SparseVad>();
-            vadResult = newVad->update(&buffer);
+            vadResult = newVad->update(_audioLevelBuffer.get());
             _audioVadMap.insert(std::make_pair(ssrc, std::move(newVad)));
         } else {
-            vadResult = vad->second->update(&buffer);
+            vadResult = vad->second->update(_audioLevelBuffer.get());
         }
 
         _updateAudioLevel(ssrc, vadResult.first, vadResult.second);
@@ -476,9 +705,11 @@ public:
             buffer = _tempAudioBuffer.data();
         }
 
-        _audioDataMutex.Lock();
+        const auto readPosition = _audioRingBuffer.readPosition();
         size_t readSamples = _audioRingBuffer.read(buffer, num_samples);
-        _audioDataMutex.Unlock();
+        if (readSamples != 0) {
+            publishAudioRead(readPosition);
+        }
 
         if (num_channels != 1) {
             for (size_t sampleIndex = 0; sampleIndex < readSamples; sampleIndex++) {
@@ -606,7 +837,7 @@ public:
         if (segment->isPlaying) {
             return;
         }
-        auto segmentEndpointId = segment->part->getActiveEndpointId();
+        auto segmentEndpointId = segment->decoder->endpointId();
         if (!segmentEndpointId) {
             return;
         }
@@ -661,7 +892,7 @@ public:
 
                 auto result = strongSegment->pendingVideoQualityUpdatePart->result;
                 if (result) {
-                    strongSegment->part = std::make_shared<VideoStreamingPart>(std::move(result->data), VideoStreamingPart::ContentType::Video);
+                    strongSegment->decoder = strong->makeVideoDecoder(result->data);
                 }
 
                 strongSegment->pendingVideoQualityUpdatePart.reset();
@@ -669,6 +900,35 @@ public:
         }
     }
 
+    std::shared_ptr<StreamingVideoDecoder> makeVideoDecoder(std::shared_ptr<StreamingPartData> data) {
+        auto part = std::make_shared<VideoStreamingPart>(std::move(data), VideoStreamingPart::ContentType::Video);
+        const auto endpointId = part->getActiveEndpointId();
+        return std::make_shared<StreamingVideoDecoder>(std::move(part), videoDecodeWorker(endpointId.value_or(std::string())), _frameDecodeTimeMetric, _lateVideoFramesMetric);
+    }
+
+    // Each endpoint keeps decoding on the same worker, so its parts are
+    // decoded in order. The number of workers is capped to leave the other
+    // cores to the rest of the call; endpoints past the cap share them.
+    rtc::TaskQueue *videoDecodeWorker(std::string const &endpointId) {
+        const auto it = _videoDecodeWorkerByEndpoint.find(endpointId);
+        if (it != _videoDecodeWorkerByEndpoint.end()) {
+            return _videoDecodeWorkers[it->second].get();
+        }
+
+        const auto maxWorkers = (size_t)std::max(1, std::min(kMaxVideoDecodeWorkers, (int)std::thread::hardware_concurrency() - 1));
+        if (_videoDecodeWorkers.size() < maxWorkers) {
+            _videoDecodeWorkers.push_back(std::make_unique<rtc::TaskQueue>(_taskQueueFactory->CreateTaskQueue("StreamingVideoDecode", webrtc::TaskQueueFactory::Priority::NORMAL)));
+        }
+        // Endpoints that left free their worker, so the one with the fewest is taken.
+        std::vector<size_t> endpointCounts(_videoDecodeWorkers.size(), 0);
+        for (const auto &it : _videoDecodeWorkerByEndpoint) {
+            endpointCounts[it.second]++;
+        }
+        const auto index = (size_t)(std::min_element(endpointCounts.begin(), endpointCounts.end()) - endpointCounts.begin());
+        _videoDecodeWorkerByEndpoint.insert(std::make_pair(endpointId, index));
+        return _videoDecodeWorkers[index].get();
+    }
+
     void cancelPendingVideoQualityUpdate(std::shared_ptr<VideoSegment> segment) {
         if (!segment->pendingVideoQualityUpdatePart) {
             return;
@@ -693,13 +953,7 @@ public:
             auto pendingSegment = _pendingSegments[i];
             auto segmentTimestamp = pendingSegment->timestamp;
 
-            bool allPartsDone = true;
-
             for (auto &part : pendingSegment->parts) {
-                if (!part->result) {
-                    allPartsDone = false;
-                }
-
                 if (!part->result && !part->task) {
                     if (part->minRequestTimestamp != 0) {
                         if (part->minRequestTimestamp > absoluteTimestamp) {
@@ -712,80 +966,83 @@ public:
                     const auto weakSegment = std::weak_ptr<PendingMediaSegment>(pendingSegment);
                     const auto weakPart = std::weak_ptr<PendingMediaSegmentPart>(part);
 
-                    std::function<void(BroadcastPart &&)> handleResult = [weak, weakSegment, weakPart, threads = _threads, segmentTimestamp](BroadcastPart &&part) {
-                        threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, weakSegment, weakPart, part = std::move(part), segmentTimestamp]() mutable {
-                            auto strong = weak.lock();
-                            if (!strong) {
-                                return;
-                            }
-                            auto strongSegment = weakSegment.lock();
-                            if (!strongSegment) {
-                                return;
-                            }
+                    const auto handlePart = [weak, weakSegment, weakPart, segmentTimestamp](BroadcastPart::Status status, int64_t timestampMilliseconds, double responseTimestamp, std::shared_ptr<StreamingPartData> data) {
+                        auto strong = weak.lock();
+                        if (!strong) {
+                            return;
+                        }
+                        auto strongSegment = weakSegment.lock();
+                        if (!strongSegment) {
+                            return;
+                        }
 
-                            auto pendingPart = weakPart.lock();
-                            if (!pendingPart) {
-                                return;
-                            }
+                        auto pendingPart = weakPart.lock();
+                        if (!pendingPart) {
+                            return;
+                        }
 
-                            pendingPart->task.reset();
+                        pendingPart->task.reset();
 
-                            switch (part.status) {
-                                case BroadcastPart::Status::Success: {
-                                    pendingPart->result = std::make_shared<PendingMediaSegmentPartResult>(std::move(part.data));
-                                    if (strong->_nextSegmentTimestamp == -1) {
-                                        strong->_nextSegmentTimestamp = part.timestampMilliseconds + strong->_segmentDuration;
-                                    }
-                                    strong->checkPendingSegments();
-                                    break;
-                                }
-                                case BroadcastPart::Status::NotReady: {
-                                    if (segmentTimestamp == 0 && !strong->_isUnifiedBroadcast) {
-                                        int64_t responseTimestampMilliseconds = (int64_t)(part.responseTimestamp * 1000.0);
-                                        int64_t responseTimestampBoundary = (responseTimestampMilliseconds / strong->_segmentDuration) * strong->_segmentDuration;
-
-                                        strong->_nextSegmentTimestamp = responseTimestampBoundary;
-                                        strong->discardAllPendingSegments();
-                                        strong->requestSegmentsIfNeeded();
-                                        strong->checkPendingSegments();
-                                    } else {
-                                        pendingPart->minRequestTimestamp = rtc::TimeMillis() + 100;
-                                        strong->checkPendingSegments();
-                                    }
-                                    break;
+                        switch (status) {
+                            case BroadcastPart::Status::Success: {
+                                pendingPart->result = std::make_shared<PendingMediaSegmentPartResult>(std::move(data));
+                                if (strong->_nextSegmentTimestamp == -1) {
+                                    strong->_nextSegmentTimestamp = timestampMilliseconds + strong->_segmentDuration;
                                 }
-                                case BroadcastPart::Status::ResyncNeeded: {
-                                    if (strong->_isUnifiedBroadcast) {
-                                        strong->_nextSegmentTimestamp = -1;
-                                    } else {
-                                        int64_t responseTimestampMilliseconds = (int64_t)(part.responseTimestamp * 1000.0);
-                                        int64_t responseTimestampBoundary = (responseTimestampMilliseconds / strong->_segmentDuration) * strong->_segmentDuration;
-
-                                        strong->_nextSegmentTimestamp = responseTimestampBoundary;
-                                    }
-                                    
+                                strong->checkPendingSegments();
+                                break;
+                            }
+                            case BroadcastPart::Status::NotReady: {
+                                if (segmentTimestamp == 0 && !strong->_isUnifiedBroadcast) {
+                                    int64_t responseTimestampMilliseconds = (int64_t)(responseTimestamp * 1000.0);
+                                    int64_t responseTimestampBoundary = (responseTimestampMilliseconds / strong->_segmentDuration) * strong->_segmentDuration;
+
+                                    strong->_nextSegmentTimestamp = responseTimestampBoundary;
                                     strong->discardAllPendingSegments();
                                     strong->requestSegmentsIfNeeded();
                                     strong->checkPendingSegments();
-
-                                    break;
+                                } else {
+                                    pendingPart->minRequestTimestamp = rtc::TimeMillis() + 100;
+                                    strong->checkPendingSegments();
                                 }
-                                default: {
-                                    RTC_FATAL() << "Unknown part.status";
-                                    break;
+                                break;
+                            }
+                            case BroadcastPart::Status::ResyncNeeded: {
+                                if (strong->_isUnifiedBroadcast) {
+                                    strong->_nextSegmentTimestamp = -1;
+                                } else {
+                                    int64_t responseTimestampMilliseconds = (int64_t)(responseTimestamp * 1000.0);
+                                    int64_t responseTimestampBoundary = (responseTimestampMilliseconds / strong->_segmentDuration) * strong->_segmentDuration;
+
+                                    strong->_nextSegmentTimestamp = responseTimestampBoundary;
                                 }
+                                
+                                strong->discardAllPendingSegments();
+                                strong->requestSegmentsIfNeeded();
+                                strong->checkPendingSegments();
+
+                                break;
                             }
-                        });
+                            default: {
+                                RTC_FATAL() << "Unknown part.status";
+                                break;
+                            }
+                        }
                     };
 
-                    const auto typeData = &part->typeData;
-                    if (const auto audioData = absl::get_if<PendingAudioSegmentData>(typeData)) {
-                        part->task = _requestAudioBroadcastPart(segmentTimestamp, _segmentDuration, handleResult);
-                    } else if (const auto videoData = absl::get_if<PendingVideoSegmentData>(typeData)) {
-                        part->task = _requestVideoBroadcastPart(segmentTimestamp, _segmentDuration, videoData->channelId, videoData->quality, handleResult);
-                    } else if (const auto unifiedData = absl::get_if<PendingUnifiedSegmentData>(typeData)) {
-                        part->task = _requestVideoBroadcastPart(segmentTimestamp, _segmentDuration, 1, VideoChannelDescription::Quality::Full, handleResult);
-                    }
+                    part->task = requestPart(part, segmentTimestamp, [handlePart, segmentTimestamp](std::shared_ptr<StreamingPartData> data) {
+                        handlePart(BroadcastPart::Status::Success, segmentTimestamp, 0.0, std::move(data));
+                    }, [handlePart](BroadcastPart::Status status, int64_t timestampMilliseconds, double responseTimestamp, std::shared_ptr<StreamingPartData> data) {
+                        handlePart(status, timestampMilliseconds, responseTimestamp, std::move(data));
+                    });
+                }
+            }
+
+            bool allPartsDone = true;
+            for (const auto &part : pendingSegment->parts) {
+                if (!part->result) {
+                    allPartsDone = false;
+                    break;
                 }
             }
 
@@ -796,25 +1053,26 @@ public:
                 for (auto &part : pendingSegment->parts) {
                     const auto typeData = &part->typeData;
                     if (const auto audioData = absl::get_if<PendingAudioSegmentData>(typeData)) {
-                        segment->audio = std::make_shared<AudioStreamingPart>(std::move(part->result->data), "ogg", false);
+                        const auto &data = part->result->data;
+                        segment->audio = std::make_shared<AudioStreamingPart>(data, 0, data->size(), "ogg", false);
                         _currentEndpointMapping = segment->audio->getEndpointMapping();
                     } else if (const auto videoData = absl::get_if<PendingVideoSegmentData>(typeData)) {
                         auto videoSegment = std::make_shared<VideoSegment>();
                         videoSegment->quality = videoData->quality;
-                        if (part->result->data.empty()) {
+                        if (part->result->data->size() == 0) {
                             RTC_LOG(LS_INFO) << "Video part " << segment->timestamp << " is empty";
                         }
-                        videoSegment->part = std::make_shared<VideoStreamingPart>(std::move(part->result->data), VideoStreamingPart::ContentType::Video);
+                        videoSegment->decoder = makeVideoDecoder(part->result->data);
                         segment->video.push_back(videoSegment);
                     } else if (const auto videoData = absl::get_if<PendingUnifiedSegmentData>(typeData)) {
                         auto unifiedSegment = std::make_shared<UnifiedSegment>();
-                        if (part->result->data.empty()) {
+                        if (part->result->data->size() == 0) {
                             RTC_LOG(LS_INFO) << "Unified part " << segment->timestamp << " is empty";
                         }
-                        std::vector<uint8_t> dataCopy = part->result->data;
-                        unifiedSegment->videoPart = std::make_shared<VideoStreamingPart>(std::move(part->result->data), VideoStreamingPart::ContentType::Video);
+                        // Both parts read from the same immutable buffer.
+                        unifiedSegment->decoder = makeVideoDecoder(part->result->data);
                         segment->unified.push_back(unifiedSegment);
-                        segment->unifiedAudio = std::make_shared<VideoStreamingPart>(std::move(dataCopy), VideoStreamingPart::ContentType::Audio);
+                        segment->unifiedAudio = std::make_shared<VideoStreamingPart>(part->result->data, VideoStreamingPart::ContentType::Audio);
                     }
                 }
                 _availableSegments.push_back(segment);
@@ -846,49 +1104,138 @@ public:
         const auto weak = std::weak_ptr<StreamingMediaContextPrivate>(shared_from_this());
         const auto weakPart = std::weak_ptr<PendingMediaSegmentPart>(part);
 
-        std::function<void(BroadcastPart &&)> handleResult = [weak, weakPart, threads = _threads, completion](BroadcastPart &&part) {
-            threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, weakPart, part = std::move(part), completion]() mutable {
+        const auto handlePart = [weak, weakPart, completion](BroadcastPart::Status status, std::shared_ptr<StreamingPartData> data) {
+            auto strong = weak.lock();
+            if (!strong) {
+                return;
+            }
+
+            auto pendingPart = weakPart.lock();
+            if (!pendingPart) {
+                return;
+            }
+
+            pendingPart->task.reset();
+
+            switch (status) {
+                case BroadcastPart::Status::Success: {
+                    pendingPart->result = std::make_shared<PendingMediaSegmentPartResult>(std::move(data));
+                    break;
+                }
+                case BroadcastPart::Status::NotReady: {
+                    break;
+                }
+                case BroadcastPart::Status::ResyncNeeded: {
+                    break;
+                }
+                default: {
+                    RTC_FATAL() << "Unknown part.status";
+                    break;
+                }
+            }
+
+            completion();
+        };
+
+        part->task = requestPart(part, segmentTimestamp, [handlePart](std::shared_ptr<StreamingPartData> data) {
+            handlePart(BroadcastPart::Status::Success, std::move(data));
+        }, [handlePart](BroadcastPart::Status status, int64_t, double, std::shared_ptr<StreamingPartData> data) {
+            handlePart(status, std::move(data));
+        });
+    }
+
+    // Media thread. Looks the part up in the part cache on the cache queue, so
+    // that opening and mapping files stays off the media thread, and requests it
+    // when it is not there. Both callbacks run on the media thread.
+    std::shared_ptr<BroadcastPartTask> requestPart(std::shared_ptr<PendingMediaSegmentPart> const &part, int64_t segmentTimestamp, std::function<void(std::shared_ptr<StreamingPartData>)> onCached, std::function<void(BroadcastPart::Status, int64_t, double, std::shared_ptr<StreamingPartData>)> onRequested) {
+        const auto cacheKey = partCacheKey(part, segmentTimestamp);
+        if (!cacheKey) {
+            return startPartRequest(part, segmentTimestamp, cacheKey, std::move(onRequested));
+        }
+
+        if (!_partCacheQueue) {
+            _partCacheQueue = std::make_unique<rtc::TaskQueue>(_taskQueueFactory->CreateTaskQueue("BroadcastPartCache", webrtc::TaskQueueFactory::Priority::NORMAL));
+        }
+
+        const auto weak = std::weak_ptr<StreamingMediaContextPrivate>(shared_from_this());
+        const auto weakPart = std::weak_ptr<PendingMediaSegmentPart>(part);
+        auto task = std::make_shared<CachedBroadcastPartTask>();
+        _partCacheQueue->PostTask([weak, weakPart, task, threads = _threads, partCache = _partCache, cacheKey, segmentTimestamp, onCached = std::move(onCached), onRequested = std::move(onRequested)]() mutable {
+            if (task->isCancelled()) {
+                return;
+            }
+            auto data = partCache->get(cacheKey.value());
+            threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, weakPart, task, cacheKey, segmentTimestamp, data = std::move(data), onCached = std::move(onCached), onRequested = std::move(onRequested)]() mutable {
                 auto strong = weak.lock();
                 if (!strong) {
                     return;
                 }
-
-                auto pendingPart = weakPart.lock();
-                if (!pendingPart) {
+                auto part = weakPart.lock();
+                if (!part || task->isCancelled()) {
                     return;
                 }
-
-                pendingPart->task.reset();
-
-                switch (part.status) {
-                    case BroadcastPart::Status::Success: {
-                        pendingPart->result = std::make_shared<PendingMediaSegmentPartResult>(std::move(part.data));
-                        break;
-                    }
-                    case BroadcastPart::Status::NotReady: {
-                        break;
-                    }
-                    case BroadcastPart::Status::ResyncNeeded: {
-                        break;
-                    }
-                    default: {
-                        RTC_FATAL() << "Unknown part.status";
-                        break;
-                    }
+                if (data) {
+                    onCached(std::move(data));
+                } else {
+                    task->setRequestTask(strong->startPartRequest(part, segmentTimestamp, cacheKey, std::move(onRequested)));
                 }
+            });
+        });
+        return task;
+    }
 
-                completion();
+    std::shared_ptr<BroadcastPartTask> startPartRequest(std::shared_ptr<PendingMediaSegmentPart> const &part, int64_t segmentTimestamp, absl::optional<BroadcastPartCache::Key> const &cacheKey, std::function<void(BroadcastPart::Status, int64_t, double, std::shared_ptr<StreamingPartData>)> onRequested) {
+        std::function<void(BroadcastPart &&)> handleResult = [threads = _threads, partCache = _partCache, cacheKey, onRequested = std::move(onRequested)](BroadcastPart &&part) {
+            auto data = storePartData(part, partCache, cacheKey);
+            threads->getMediaThread()->PostTask(RTC_FROM_HERE, [onRequested, status = part.status, timestampMilliseconds = part.timestampMilliseconds, responseTimestamp = part.responseTimestamp, data = std::move(data)]() mutable {
+                onRequested(status, timestampMilliseconds, responseTimestamp, std::move(data));
             });
         };
 
         const auto typeData = &part->typeData;
         if (const auto audioData = absl::get_if<PendingAudioSegmentData>(typeData)) {
-            part->task = _requestAudioBroadcastPart(segmentTimestamp, _segmentDuration, handleResult);
+            return _requestAudioBroadcastPart(segmentTimestamp, _segmentDuration, handleResult);
         } else if (const auto videoData = absl::get_if<PendingVideoSegmentData>(typeData)) {
-            part->task = _requestVideoBroadcastPart(segmentTimestamp, _segmentDuration, videoData->channelId, videoData->quality, handleResult);
+            return _requestVideoBroadcastPart(segmentTimestamp, _segmentDuration, videoData->channelId, videoData->quality, handleResult);
         } else if (const auto unifiedData = absl::get_if<PendingUnifiedSegmentData>(typeData)) {
-            part->task = _requestVideoBroadcastPart(segmentTimestamp, _segmentDuration, 1, VideoChannelDescription::Quality::Full, handleResult);
+            return _requestVideoBroadcastPart(segmentTimestamp, _segmentDuration, 1, VideoChannelDescription::Quality::Full, handleResult);
+        }
+        return nullptr;
+    }
+
+    absl::optional<BroadcastPartCache::Key> partCacheKey(std::shared_ptr<PendingMediaSegmentPart> const &part, int64_t segmentTimestamp) const {
+        if (!_partCache || segmentTimestamp <= 0) {
+            return absl::nullopt;
+        }
+
+        BroadcastPartCache::Key key;
+        key.timestampMilliseconds = segmentTimestamp;
+        key.durationMilliseconds = _segmentDuration;
+
+        const auto typeData = &part->typeData;
+        if (const auto videoData = absl::get_if<PendingVideoSegmentData>(typeData)) {
+            key.isVideo = true;
+            key.channelId = videoData->channelId;
+            key.quality = (int32_t)videoData->quality;
+        } else if (absl::get_if<PendingUnifiedSegmentData>(typeData)) {
+            key.isVideo = true;
+            key.channelId = 1;
+            key.quality = (int32_t)VideoChannelDescription::Quality::Full;
+        }
+
+        return key;
+    }
+
+    // Called on the thread that delivered the part, so that cache writes stay off the media thread.
+    static std::shared_ptr<StreamingPartData> storePartData(BroadcastPart &part, std::shared_ptr<BroadcastPartCache> const &partCache, absl::optional<BroadcastPartCache::Key> const &cacheKey) {
+        if (part.status != BroadcastPart::Status::Success) {
+            return nullptr;
         }
+        std::shared_ptr<StreamingPartData> data = std::make_shared<StreamingPartVectorData>(std::move(part.data));
+        if (partCache && cacheKey && data->size() != 0) {
+            partCache->put(cacheKey.value(), data);
+        }
+        return data;
     }
 
     void setVolume(uint32_t ssrc, double volume) {
@@ -901,10 +1248,22 @@ public:
         }
         _activeVideoChannels = videoChannels;
 
+        // The workers stay, only the assignments of the endpoints that left go.
+        for (auto it = _videoDecodeWorkerByEndpoint.begin(); it != _videoDecodeWorkerByEndpoint.end(); ) {
+            const auto isActive = std::any_of(_activeVideoChannels.begin(), _activeVideoChannels.end(), [&](StreamingMediaContext::VideoChannel const &channel) {
+                return channel.endpoint == it->first;
+            });
+            if (isActive) {
+                ++it;
+            } else {
+                it = _videoDecodeWorkerByEndpoint.erase(it);
+            }
+        }
+
         for (const auto &updatedVideoChannel : _activeVideoChannels) {
             for (const auto &segment : _availableSegments) {
                 for (const auto &video : segment->video) {
-                    if (video->part->getActiveEndpointId() == updatedVideoChannel.endpoint) {
+                    if (video->decoder->endpointId() == updatedVideoChannel.endpoint) {
                         if (video->quality != updatedVideoChannel.quality) {
                             requestPendingVideoQualityUpdate(video, segment->timestamp);
                         }
@@ -922,6 +1281,10 @@ public:
         _videoSinks[endpointId].push_back(sink);
     }
 
+    std::shared_ptr<MetricsRegistry> getMetrics() const {
+        return _metrics;
+    }
+
 private:
     std::shared_ptr<Threads> _threads;
     bool _isUnifiedBroadcast = false;
@@ -929,6 +1292,25 @@ private:
     std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, std::function<void(BroadcastPart &&)>)> _requestAudioBroadcastPart;
     std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, int32_t, VideoChannelDescription::Quality, std::function<void(BroadcastPart &&)>)> _requestVideoBroadcastPart;
     std::function<void(uint32_t, float, bool)> _updateAudioLevel;
+    std::shared_ptr<BroadcastPartCache> _partCache;
+    std::shared_ptr<MetricsRegistry> _metrics;
+    MetricsHistogram *_renderLatenessMetric = nullptr;
+    MetricsHistogram *_frameDecodeTimeMetric = nullptr;
+    MetricsCounter *_renderedFramesMetric = nullptr;
+    MetricsCounter *_lateVideoFramesMetric = nullptr;
+    // How far behind the audio clock a frame was shown, and how much the
+    // spacing of shown frames differs from that of their pts.
+    MetricsHistogram *_avOffsetMetric = nullptr;
+    MetricsHistogram *_frameJitterMetric = nullptr;
+
+    static constexpr int64_t kMaxRenderIntervalUs = 8000;
+    static constexpr int64_t kAudioClockTimeoutUs = 50000;
+    static constexpr int64_t kAudioClockExtrapolationUs = 20000;
+    int64_t _nextVideoFrameDueUs = 0;
+
+    static constexpr int kMaxVideoDecodeWorkers = 4;
+    std::unique_ptr<webrtc::TaskQueueFactory> _taskQueueFactory;
+    std::map<std::string, size_t> _videoDecodeWorkerByEndpoint;
 
     const int _segmentDuration = 1000;
     const int _segmentBufferDuration = 2000;
@@ -937,7 +1319,10 @@ private:
 
     absl::optional<int> _waitForBufferredMillisecondsBeforeRendering;
     std::vector<std::shared_ptr<MediaSegment>> _availableSegments;
+    // Retired by the wall clock, but its video still plays, see render().
+    std::shared_ptr<MediaSegment> _previousSegment;
     AudioStreamingPartPersistentDecoder _persistentAudioDecoder;
+    std::vector<AudioStreamingPart::StreamingPartChannel> _audioChannels;
 
     std::shared_ptr<BroadcastPartTask> _pendingRequestTimeTask;
     int _pendingRequestTimeDelayTaskId = 0;
@@ -948,10 +1333,21 @@ private:
     int64_t _playbackReferenceTimestamp = 0;
 
     const size_t _audioDataRingBufferMaxSize = 4800;
-    webrtc::Mutex _audioDataMutex;
     SampleRingBuffer _audioRingBuffer;
+    // The last read of the device, see publishAudioRead.
+    std::atomic<uint32_t> _audioReadSequence{ 0 };
+    std::atomic<int64_t> _audioReadPosition{ 0 };
+    std::atomic<int64_t> _audioReadAtUs{ 0 };
+    // The audio clock, media thread only: positions are those of the ring buffer.
+    std::deque<AudioClockMark> _audioClockMarks;
+    int64_t _audioClockMediaTimeUs = 0;
+    int64_t _audioClockUpdatedAtUs = 0;
     std::vector<int16_t> _tempAudioBuffer;
     webrtc::FrameCombiner _audioFrameCombiner;
+    std::vector<std::unique_ptr<webrtc::AudioFrame>> _audioFramePool;
+    std::vector<webrtc::AudioFrame *> _audioFrames;
+    webrtc::AudioFrame _audioFrameOut;
+    std::unique_ptr<webrtc::AudioBuffer> _audioLevelBuffer;
     std::map<uint32_t, std::unique_ptr<SparseVad>> _audioVadMap;
 
     std::map<uint32_t, double> _volumeBySsrc;
@@ -959,6 +1355,12 @@ private:
     std::map<std::string, std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>>> _videoSinks;
 
     std::map<std::string, int32_t> _currentEndpointMapping;
+
+    // Only this object owns them, decoders keep plain pointers. Stopped at the
+    // start of the destructor, see there.
+    std::vector<std::unique_ptr<rtc::TaskQueue>> _videoDecodeWorkers;
+    // Created with the first cache lookup, the lookups hold the cache themselves.
+    std::unique_ptr<rtc::TaskQueue> _partCacheQueue;
 };
 
 StreamingMediaContext::StreamingMediaContext(StreamingMediaContextArguments &&arguments) {
@@ -985,4 +1387,8 @@ void StreamingMediaContext::getAudio(int16_t *audio_samples, const size_t num_sa
     _private->getAudio(audio_samples, num_samples, num_channels, samples_per_sec);
 }
 
+std::shared_ptr<MetricsRegistry> StreamingMediaContext::getMetrics() const {
+    return _private->getMetrics();
+}
+
 }
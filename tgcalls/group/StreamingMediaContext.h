@@ -8,6 +8,7 @@
 namespace tgcalls {
 
 class StreamingMediaContextPrivate;
+class MetricsRegistry;
 
 class StreamingMediaContext {
 public:
@@ -29,6 +30,9 @@ public:
         std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, std::function<void(BroadcastPart &&)>)> requestAudioBroadcastPart;
         std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, int32_t, VideoChannelDescription::Quality, std::function<void(BroadcastPart &&)>)> requestVideoBroadcastPart;
         std::function<void(uint32_t, float, bool)> updateAudioLevel;
+        std::shared_ptr<BroadcastPartCache> partCache;
+        // Optional, the context uses a registry of its own when not set.
+        std::shared_ptr<MetricsRegistry> metrics;
     };
 
 public:
@@ -42,7 +46,10 @@ public:
     void setVolume(uint32_t ssrc, double volume);
     void addVideoSink(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink);
 
+    // Audio render thread. Never waits for the media thread.
     void getAudio(int16_t *audio_samples, const size_t num_samples, const size_t num_channels, const uint32_t samples_per_sec);
+
+    std::shared_ptr<MetricsRegistry> getMetrics() const;
     
 private:
     std::shared_ptr<StreamingMediaContextPrivate> _private;
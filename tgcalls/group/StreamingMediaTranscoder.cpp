@@ -0,0 +1,600 @@
+#include "StreamingMediaTranscoder.h"
+
+#include "AudioStreamingPart.h"
+#include "VideoStreamingPart.h"
+#include "BroadcastPartCache.h"
+
+#include "absl/types/optional.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+#include "rtc_base/logging.h"
+#include "modules/audio_mixer/frame_combiner.h"
+#include "api/video/video_frame.h"
+
+#include <algorithm>
+
+namespace tgcalls {
+
+namespace {
+
+struct TranscodeSegmentPart {
+    bool isVideo = false;
+    int32_t channelId = 0;
+    VideoChannelDescription::Quality quality = VideoChannelDescription::Quality::Full;
+
+    std::shared_ptr<BroadcastPartTask> task;
+    std::shared_ptr<StreamingPartData> data;
+    bool isDone = false;
+};
+
+struct DecodedVideoFrame {
+    std::string endpointId;
+    webrtc::VideoFrame frame;
+
+    DecodedVideoFrame(std::string const &endpointId_, webrtc::VideoFrame const &frame_) :
+    endpointId(endpointId_),
+    frame(frame_) {
+    }
+};
+
+struct TranscodeSegment {
+    int64_t timestamp = 0;
+    std::vector<std::shared_ptr<TranscodeSegmentPart>> parts;
+    std::shared_ptr<AudioStreamingPart> audioPart;
+
+    bool isDecoding = false;
+    bool isAudioDecoding = false;
+    std::shared_ptr<std::vector<StreamingMediaTranscoder::AudioChunk>> decodedAudio;
+    std::shared_ptr<std::vector<DecodedVideoFrame>> decodedVideo;
+};
+
+void appendAudioChunk(int64_t timestampMilliseconds, int16_t const *samples, size_t numSamples, std::vector<StreamingMediaTranscoder::AudioChunk> &audio) {
+    StreamingMediaTranscoder::AudioChunk chunk;
+    chunk.timestampMilliseconds = timestampMilliseconds;
+    chunk.samples.assign(samples, samples + numSamples);
+    audio.push_back(std::move(chunk));
+}
+
+void appendVideoFrames(VideoStreamingPart &part, int64_t segmentTimestamp, absl::optional<std::string> const &endpointId, std::vector<DecodedVideoFrame> &video) {
+    double relativeTimestamp = 0.0;
+    while (true) {
+        auto frame = part.getNextFrame();
+        if (!frame) {
+            break;
+        }
+
+        // Frames are shown from the end of the previous frame, same as in StreamingMediaContext::render.
+        webrtc::VideoFrame videoFrame = frame->frame;
+        videoFrame.set_timestamp_us(segmentTimestamp * 1000 + (int64_t)(relativeTimestamp * 1000000.0));
+        relativeTimestamp += frame->duration;
+
+        video.emplace_back(endpointId ? endpointId.value() : frame->endpointId, videoFrame);
+    }
+}
+
+class TranscodeDecodeWorker {
+public:
+    explicit TranscodeDecodeWorker(std::string const &name) :
+    _audioFrameCombiner(false) {
+        _thread = rtc::Thread::Create();
+        _thread->SetName(name, nullptr);
+        _thread->Start();
+    }
+
+    ~TranscodeDecodeWorker() {
+        _thread->Stop();
+    }
+
+    rtc::Thread *thread() const {
+        return _thread.get();
+    }
+
+    // Must be called on the worker thread. Video parts start at a key frame,
+    // so segments can be decoded on any worker in any order.
+    std::shared_ptr<std::vector<DecodedVideoFrame>> decodeVideo(TranscodeSegment const &segment, bool isUnifiedBroadcast) {
+        auto result = std::make_shared<std::vector<DecodedVideoFrame>>();
+
+        if (isUnifiedBroadcast) {
+            const auto &data = segment.parts[0]->data;
+            if (!data || data->size() == 0) {
+                return result;
+            }
+
+            VideoStreamingPart videoPart(data, VideoStreamingPart::ContentType::Video);
+            appendVideoFrames(videoPart, segment.timestamp, std::string("unified"), *result);
+        } else {
+            for (const auto &part : segment.parts) {
+                if (!part->isVideo || !part->data || part->data->size() == 0) {
+                    continue;
+                }
+                VideoStreamingPart videoPart(part->data, VideoStreamingPart::ContentType::Video);
+                appendVideoFrames(videoPart, segment.timestamp, absl::nullopt, *result);
+            }
+
+            std::stable_sort(result->begin(), result->end(), [](DecodedVideoFrame const &lhs, DecodedVideoFrame const &rhs) {
+                return lhs.frame.timestamp_us() < rhs.frame.timestamp_us();
+            });
+        }
+
+        return result;
+    }
+
+    // Must be called on the worker thread, for one segment after another. Opus
+    // and the frame combiner carry state across segment boundaries, the same
+    // decoder and combiner have to see every segment in order for the output
+    // to match playback.
+    std::shared_ptr<std::vector<StreamingMediaTranscoder::AudioChunk>> decodeAudio(TranscodeSegment const &segment, bool isUnifiedBroadcast) {
+        auto result = std::make_shared<std::vector<StreamingMediaTranscoder::AudioChunk>>();
+
+        if (isUnifiedBroadcast) {
+            const auto &data = segment.parts[0]->data;
+            if (!data || data->size() == 0) {
+                return result;
+            }
+
+            VideoStreamingPart audioPart(data, VideoStreamingPart::ContentType::Audio);
+            int64_t audioTimestamp = segment.timestamp;
+            while (true) {
+                auto audioChannels = audioPart.getAudio10msPerChannel(_persistentAudioDecoder);
+                if (audioChannels.size() != 1) {
+                    break;
+                }
+                appendAudioChunk(audioTimestamp, audioChannels[0].pcmData.data(), audioChannels[0].pcmData.size(), *result);
+                audioTimestamp += 10;
+            }
+        } else if (segment.audioPart) {
+            int64_t audioTimestamp = segment.timestamp;
+            while (segment.audioPart->get10msPerChannel(_persistentAudioDecoder, _audioChannels)) {
+                std::vector<std::unique_ptr<webrtc::AudioFrame>> frames;
+                std::vector<webrtc::AudioFrame *> audioFrames;
+                for (const auto &audioChannel : _audioChannels) {
+                    auto frame = std::make_unique<webrtc::AudioFrame>();
+                    frame->UpdateFrame(0, audioChannel.pcmData.data(), audioChannel.pcmData.size(), 48000, webrtc::AudioFrame::SpeechType::kNormalSpeech, webrtc::AudioFrame::VADActivity::kVadActive);
+                    audioFrames.push_back(frame.get());
+                    frames.push_back(std::move(frame));
+                }
+
+                webrtc::AudioFrame frameOut;
+                _audioFrameCombiner.Combine(audioFrames, 1, 48000, audioFrames.size(), &frameOut);
+
+                appendAudioChunk(audioTimestamp, frameOut.data(), frameOut.samples_per_channel(), *result);
+                audioTimestamp += 10;
+            }
+        }
+
+        return result;
+    }
+
+private:
+    std::unique_ptr<rtc::Thread> _thread;
+    // Only used on the audio worker.
+    AudioStreamingPartPersistentDecoder _persistentAudioDecoder;
+    webrtc::FrameCombiner _audioFrameCombiner;
+    std::vector<AudioStreamingPart::StreamingPartChannel> _audioChannels;
+};
+
+}
+
+class StreamingMediaTranscoderPrivate : public std::enable_shared_from_this<StreamingMediaTranscoderPrivate> {
+public:
+    StreamingMediaTranscoderPrivate(StreamingMediaTranscoder::StreamingMediaTranscoderArguments &&arguments) :
+    _threads(arguments.threads),
+    _isUnifiedBroadcast(arguments.isUnifiedBroadcast),
+    _startTimestamp(arguments.startTimestampMilliseconds),
+    _endTimestamp(arguments.endTimestampMilliseconds),
+    _videoChannels(arguments.videoChannels),
+    _maxSegmentsInFlight(std::max(arguments.maxSegmentsInFlight, 1)),
+    _requestAudioBroadcastPart(arguments.requestAudioBroadcastPart),
+    _requestVideoBroadcastPart(arguments.requestVideoBroadcastPart),
+    _partCache(arguments.partCache),
+    _onAudio(arguments.onAudio),
+    _onVideoFrame(arguments.onVideoFrame),
+    _onProgress(arguments.onProgress),
+    _onFinished(arguments.onFinished) {
+        _audioWorker = std::make_unique<TranscodeDecodeWorker>("tgc-transcode-audio");
+        int decodeThreadCount = std::max(arguments.decodeThreadCount, 1);
+        for (int i = 0; i < decodeThreadCount; i++) {
+            _workers.push_back(std::make_unique<TranscodeDecodeWorker>("tgc-transcode#" + std::to_string(i)));
+        }
+    }
+
+    ~StreamingMediaTranscoderPrivate() {
+        // Joins the worker threads; pending decode tasks are dropped.
+        _workers.clear();
+        _audioWorker.reset();
+    }
+
+    void start() {
+        _startTimeMilliseconds = rtc::TimeMillis();
+        _nextSegmentTimestamp = (_startTimestamp / _segmentDuration) * _segmentDuration;
+
+        requestSegmentsIfNeeded();
+    }
+
+    void stop() {
+        if (_isStopped) {
+            return;
+        }
+        _isStopped = true;
+
+        for (const auto &segment : _segments) {
+            cancelSegment(segment);
+        }
+        _segments.clear();
+    }
+
+private:
+    void requestSegmentsIfNeeded() {
+        if (_isStopped || _isFinished) {
+            return;
+        }
+
+        while (!_isEndReached && (int)_segments.size() < _maxSegmentsInFlight) {
+            if (_endTimestamp > 0 && _nextSegmentTimestamp >= _endTimestamp) {
+                _isEndReached = true;
+                break;
+            }
+
+            auto segment = std::make_shared<TranscodeSegment>();
+            segment->timestamp = _nextSegmentTimestamp;
+            _nextSegmentTimestamp += _segmentDuration;
+
+            auto part = std::make_shared<TranscodeSegmentPart>();
+            if (_isUnifiedBroadcast) {
+                part->isVideo = true;
+                part->channelId = 1;
+                part->quality = VideoChannelDescription::Quality::Full;
+            }
+            segment->parts.push_back(part);
+
+            _segments.push_back(segment);
+
+            requestPart(segment, part);
+        }
+
+        if (_isEndReached && _segments.empty()) {
+            finish();
+        }
+    }
+
+    absl::optional<BroadcastPartCache::Key> partCacheKey(TranscodeSegment const &segment, TranscodeSegmentPart const &part) const {
+        if (!_partCache || segment.timestamp <= 0) {
+            return absl::nullopt;
+        }
+
+        BroadcastPartCache::Key key;
+        key.isVideo = part.isVideo;
+        key.timestampMilliseconds = segment.timestamp;
+        key.durationMilliseconds = _segmentDuration;
+        if (part.isVideo) {
+            key.channelId = part.channelId;
+            key.quality = (int32_t)part.quality;
+        }
+        return key;
+    }
+
+    void requestPart(std::shared_ptr<TranscodeSegment> segment, std::shared_ptr<TranscodeSegmentPart> part) {
+        const auto cacheKey = partCacheKey(*segment, *part);
+        if (cacheKey) {
+            if (const auto cachedData = _partCache->get(cacheKey.value())) {
+                onPartReady(segment, part, cachedData);
+                return;
+            }
+        }
+
+        const auto weak = std::weak_ptr<StreamingMediaTranscoderPrivate>(shared_from_this());
+        const auto weakSegment = std::weak_ptr<TranscodeSegment>(segment);
+        const auto weakPart = std::weak_ptr<TranscodeSegmentPart>(part);
+
+        std::function<void(BroadcastPart &&)> handleResult = [weak, weakSegment, weakPart, threads = _threads, partCache = _partCache, cacheKey](BroadcastPart &&result) {
+            std::shared_ptr<StreamingPartData> data;
+            if (result.status == BroadcastPart::Status::Success) {
+                data = std::make_shared<StreamingPartVectorData>(std::move(result.data));
+                if (partCache && cacheKey && data->size() != 0) {
+                    partCache->put(cacheKey.value(), data);
+                }
+            }
+
+            threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, weakSegment, weakPart, status = result.status, data]() {
+                auto strong = weak.lock();
+                if (!strong) {
+                    return;
+                }
+                auto segment = weakSegment.lock();
+                if (!segment) {
+                    return;
+                }
+                auto part = weakPart.lock();
+                if (!part) {
+                    return;
+                }
+
+                part->task.reset();
+
+                switch (status) {
+                    case BroadcastPart::Status::Success: {
+                        strong->onPartReady(segment, part, data);
+                        break;
+                    }
+                    case BroadcastPart::Status::NotReady: {
+                        strong->retryPartLater(segment, part);
+                        break;
+                    }
+                    case BroadcastPart::Status::ResyncNeeded: {
+                        RTC_LOG(LS_INFO) << "StreamingMediaTranscoder: resync needed at " << segment->timestamp << ", stopping";
+                        strong->endAtSegment(segment);
+                        break;
+                    }
+                    default: {
+                        RTC_FATAL() << "Unknown part.status";
+                        break;
+                    }
+                }
+            });
+        };
+
+        if (part->isVideo) {
+            part->task = _requestVideoBroadcastPart(segment->timestamp, _segmentDuration, part->channelId, part->quality, handleResult);
+        } else {
+            part->task = _requestAudioBroadcastPart(segment->timestamp, _segmentDuration, handleResult);
+        }
+    }
+
+    void retryPartLater(std::shared_ptr<TranscodeSegment> segment, std::shared_ptr<TranscodeSegmentPart> part) {
+        const auto weak = std::weak_ptr<StreamingMediaTranscoderPrivate>(shared_from_this());
+        const auto weakSegment = std::weak_ptr<TranscodeSegment>(segment);
+        const auto weakPart = std::weak_ptr<TranscodeSegmentPart>(part);
+        _threads->getMediaThread()->PostDelayedTask(RTC_FROM_HERE, [weak, weakSegment, weakPart]() {
+            auto strong = weak.lock();
+            if (!strong || strong->_isStopped) {
+                return;
+            }
+            auto segment = weakSegment.lock();
+            auto part = weakPart.lock();
+            if (!segment || !part) {
+                return;
+            }
+            strong->requestPart(segment, part);
+        }, 100);
+    }
+
+    void onPartReady(std::shared_ptr<TranscodeSegment> segment, std::shared_ptr<TranscodeSegmentPart> part, std::shared_ptr<StreamingPartData> data) {
+        part->data = std::move(data);
+        part->isDone = true;
+
+        if (!_isUnifiedBroadcast && !part->isVideo) {
+            segment->audioPart = std::make_shared<AudioStreamingPart>(part->data, 0, part->data->size(), "ogg", false);
+
+            // Video channel ids are only known once the audio part of the same segment is parsed.
+            const auto endpointMapping = segment->audioPart->getEndpointMapping();
+            std::vector<std::shared_ptr<TranscodeSegmentPart>> videoParts;
+            for (const auto &videoChannel : _videoChannels) {
+                auto channelIdIt = endpointMapping.find(videoChannel.endpoint);
+                if (channelIdIt == endpointMapping.end()) {
+                    continue;
+                }
+
+                auto video = std::make_shared<TranscodeSegmentPart>();
+                video->isVideo = true;
+                video->channelId = channelIdIt->second + 1;
+                video->quality = videoChannel.quality;
+                videoParts.push_back(video);
+            }
+
+            // All parts have to be registered before any of them can complete synchronously from the cache.
+            segment->parts.insert(segment->parts.end(), videoParts.begin(), videoParts.end());
+            for (const auto &video : videoParts) {
+                requestPart(segment, video);
+            }
+        }
+
+        beginDecodingIfReady(segment);
+    }
+
+    void beginDecodingIfReady(std::shared_ptr<TranscodeSegment> segment) {
+        if (segment->isDecoding) {
+            return;
+        }
+        for (const auto &part : segment->parts) {
+            if (!part->isDone) {
+                return;
+            }
+        }
+        segment->isDecoding = true;
+
+        TranscodeDecodeWorker *worker = _workers[_nextWorkerIndex % _workers.size()].get();
+        _nextWorkerIndex++;
+
+        const auto weak = std::weak_ptr<StreamingMediaTranscoderPrivate>(shared_from_this());
+        worker->thread()->PostTask(RTC_FROM_HERE, [weak, threads = _threads, worker, segment, isUnifiedBroadcast = _isUnifiedBroadcast]() {
+            auto decoded = worker->decodeVideo(*segment, isUnifiedBroadcast);
+
+            threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, segment, decoded]() {
+                auto strong = weak.lock();
+                if (!strong) {
+                    return;
+                }
+                segment->decodedVideo = decoded;
+                strong->emitReadySegments();
+            });
+        });
+
+        beginDecodingAudioInOrder();
+    }
+
+    // Audio of a segment is handed to the audio worker only after that of every
+    // earlier segment, the worker then decodes them in timestamp order.
+    void beginDecodingAudioInOrder() {
+        const auto weak = std::weak_ptr<StreamingMediaTranscoderPrivate>(shared_from_this());
+        for (const auto &segment : _segments) {
+            if (!segment->isDecoding) {
+                break;
+            }
+            if (segment->isAudioDecoding) {
+                continue;
+            }
+            segment->isAudioDecoding = true;
+
+            TranscodeDecodeWorker *worker = _audioWorker.get();
+            worker->thread()->PostTask(RTC_FROM_HERE, [weak, threads = _threads, worker, segment, isUnifiedBroadcast = _isUnifiedBroadcast]() {
+                auto decoded = worker->decodeAudio(*segment, isUnifiedBroadcast);
+
+                threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak, segment, decoded]() {
+                    auto strong = weak.lock();
+                    if (!strong) {
+                        return;
+                    }
+                    segment->decodedAudio = decoded;
+                    strong->emitReadySegments();
+                });
+            });
+        }
+    }
+
+    void emitReadySegments() {
+        while (!_isStopped && !_segments.empty() && _segments[0]->decodedAudio && _segments[0]->decodedVideo) {
+            auto segment = _segments[0];
+            _segments.erase(_segments.begin());
+
+            emitSegment(*segment->decodedAudio, *segment->decodedVideo);
+
+            _stats.segmentCount++;
+            _stats.processedMilliseconds += _segmentDuration;
+            updateStats();
+
+            if (_onProgress) {
+                _onProgress(_stats);
+            }
+        }
+
+        requestSegmentsIfNeeded();
+    }
+
+    void emitSegment(std::vector<StreamingMediaTranscoder::AudioChunk> const &audio, std::vector<DecodedVideoFrame> const &video) {
+        size_t audioIndex = 0;
+        size_t videoIndex = 0;
+        while (audioIndex < audio.size() || videoIndex < video.size()) {
+            bool isAudioNext = false;
+            if (videoIndex == video.size()) {
+                isAudioNext = true;
+            } else if (audioIndex < audio.size()) {
+                isAudioNext = audio[audioIndex].timestampMilliseconds * 1000 <= video[videoIndex].frame.timestamp_us();
+            }
+
+            if (isAudioNext) {
+                if (_onAudio) {
+                    _onAudio(audio[audioIndex]);
+                }
+                audioIndex++;
+            } else {
+                if (_onVideoFrame) {
+                    _onVideoFrame(video[videoIndex].endpointId, video[videoIndex].frame);
+                }
+                videoIndex++;
+            }
+        }
+    }
+
+    void endAtSegment(std::shared_ptr<TranscodeSegment> segment) {
+        _isEndReached = true;
+
+        auto it = std::find(_segments.begin(), _segments.end(), segment);
+        for (auto dropIt = it; dropIt != _segments.end(); dropIt++) {
+            cancelSegment(*dropIt);
+        }
+        _segments.erase(it, _segments.end());
+
+        emitReadySegments();
+    }
+
+    void cancelSegment(std::shared_ptr<TranscodeSegment> const &segment) {
+        for (const auto &part : segment->parts) {
+            if (part->task) {
+                part->task->cancel();
+                part->task.reset();
+            }
+        }
+    }
+
+    void updateStats() {
+        _stats.elapsedMilliseconds = rtc::TimeMillis() - _startTimeMilliseconds;
+        if (_stats.elapsedMilliseconds > 0) {
+            _stats.speedFactor = ((double)_stats.processedMilliseconds) / ((double)_stats.elapsedMilliseconds);
+        } else {
+            _stats.speedFactor = 0.0;
+        }
+    }
+
+    void finish() {
+        if (_isFinished) {
+            return;
+        }
+        _isFinished = true;
+
+        updateStats();
+        _stats.isCompleted = true;
+
+        RTC_LOG(LS_INFO) << "StreamingMediaTranscoder: processed " << _stats.processedMilliseconds << " ms in " << _stats.elapsedMilliseconds << " ms (" << _stats.speedFactor << "x)";
+
+        if (_onFinished) {
+            _onFinished(_stats);
+        }
+    }
+
+private:
+    std::shared_ptr<Threads> _threads;
+    bool _isUnifiedBroadcast = false;
+    int64_t _startTimestamp = 0;
+    int64_t _endTimestamp = 0;
+    std::vector<StreamingMediaContext::VideoChannel> _videoChannels;
+    int _maxSegmentsInFlight = 1;
+    std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, std::function<void(BroadcastPart &&)>)> _requestAudioBroadcastPart;
+    std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, int32_t, VideoChannelDescription::Quality, std::function<void(BroadcastPart &&)>)> _requestVideoBroadcastPart;
+    std::shared_ptr<BroadcastPartCache> _partCache;
+    std::function<void(StreamingMediaTranscoder::AudioChunk const &)> _onAudio;
+    std::function<void(std::string const &, webrtc::VideoFrame const &)> _onVideoFrame;
+    std::function<void(StreamingMediaTranscoder::Stats const &)> _onProgress;
+    std::function<void(StreamingMediaTranscoder::Stats const &)> _onFinished;
+
+    const int _segmentDuration = 1000;
+
+    std::unique_ptr<TranscodeDecodeWorker> _audioWorker;
+    std::vector<std::unique_ptr<TranscodeDecodeWorker>> _workers;
+    size_t _nextWorkerIndex = 0;
+
+    int64_t _nextSegmentTimestamp = 0;
+    std::vector<std::shared_ptr<TranscodeSegment>> _segments;
+
+    int64_t _startTimeMilliseconds = 0;
+    StreamingMediaTranscoder::Stats _stats;
+    bool _isEndReached = false;
+    bool _isStopped = false;
+    bool _isFinished = false;
+};
+
+StreamingMediaTranscoder::StreamingMediaTranscoder(StreamingMediaTranscoderArguments &&arguments) :
+_threads(arguments.threads) {
+    _private = std::make_shared<StreamingMediaTranscoderPrivate>(std::move(arguments));
+    _threads->getMediaThread()->PostTask(RTC_FROM_HERE, [strong = _private]() {
+        strong->start();
+    });
+}
+
+StreamingMediaTranscoder::~StreamingMediaTranscoder() {
+    _threads->getMediaThread()->PostTask(RTC_FROM_HERE, [strong = std::move(_private)]() {
+        strong->stop();
+    });
+}
+
+void StreamingMediaTranscoder::stop() {
+    const auto weak = std::weak_ptr<StreamingMediaTranscoderPrivate>(_private);
+    _threads->getMediaThread()->PostTask(RTC_FROM_HERE, [weak]() {
+        auto strong = weak.lock();
+        if (!strong) {
+            return;
+        }
+        strong->stop();
+    });
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef TGCALLS_STREAMING_MEDIA_TRANSCODER_H
+#define TGCALLS_STREAMING_MEDIA_TRANSCODER_H
+
+#include "GroupInstanceImpl.h"
+#include "StreamingMediaContext.h"
+#include <stdint.h>
+#include "../StaticThreads.h"
+
+namespace webrtc {
+class VideoFrame;
+}
+
+namespace tgcalls {
+
+class StreamingMediaTranscoderPrivate;
+
+// Pull-mode counterpart of StreamingMediaContext: walks broadcast segments as fast
+// as they can be fetched and decoded instead of following the wall clock.
+// Video of different segments is decoded in parallel; audio is decoded on one
+// more thread, one segment after another, so that it comes out the same as in
+// playback. Segments are emitted strictly in timestamp order.
+class StreamingMediaTranscoder {
+public:
+    struct AudioChunk {
+        int64_t timestampMilliseconds = 0;
+        // 10 ms of mixed 48 kHz mono audio.
+        std::vector<int16_t> samples;
+    };
+
+    struct Stats {
+        int segmentCount = 0;
+        int64_t processedMilliseconds = 0;
+        int64_t elapsedMilliseconds = 0;
+        // Processed media duration relative to wall-clock time.
+        double speedFactor = 0.0;
+        bool isCompleted = false;
+    };
+
+    struct StreamingMediaTranscoderArguments {
+        std::shared_ptr<Threads> threads;
+        bool isUnifiedBroadcast = false;
+        int64_t startTimestampMilliseconds = 0;
+        // Exclusive; 0 keeps following the broadcast until a resync is requested.
+        int64_t endTimestampMilliseconds = 0;
+        std::vector<StreamingMediaContext::VideoChannel> videoChannels;
+        // Threads decoding video.
+        int decodeThreadCount = 2;
+        int maxSegmentsInFlight = 8;
+        std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, std::function<void(BroadcastPart &&)>)> requestAudioBroadcastPart;
+        std::function<std::shared_ptr<BroadcastPartTask>(int64_t, int64_t, int32_t, VideoChannelDescription::Quality, std::function<void(BroadcastPart &&)>)> requestVideoBroadcastPart;
+        std::shared_ptr<BroadcastPartCache> partCache;
+
+        // All callbacks are invoked on the media thread.
+        std::function<void(AudioChunk const &)> onAudio;
+        // The frame timestamp (timestamp_us) is the absolute broadcast time.
+        std::function<void(std::string const &, webrtc::VideoFrame const &)> onVideoFrame;
+        std::function<void(Stats const &)> onProgress;
+        std::function<void(Stats const &)> onFinished;
+    };
+
+public:
+    StreamingMediaTranscoder(StreamingMediaTranscoderArguments &&arguments);
+    ~StreamingMediaTranscoder();
+
+    StreamingMediaTranscoder& operator=(const StreamingMediaTranscoder&) = delete;
+    StreamingMediaTranscoder& operator=(StreamingMediaTranscoder&&) = delete;
+
+    void stop();
+
+private:
+    std::shared_ptr<Threads> _threads;
+    std::shared_ptr<StreamingMediaTranscoderPrivate> _private;
+};
+
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TGCALLS_STREAMING_PART_DATA_H
+#define TGCALLS_STREAMING_PART_DATA_H
+
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+namespace tgcalls {
+
+// Immutable bytes of a broadcast part. Parts may be backed by a downloaded
+// buffer or by a memory-mapped cache file; decoders read slices of it in place.
+class StreamingPartData {
+public:
+    virtual ~StreamingPartData() = default;
+
+    virtual uint8_t const *data() const = 0;
+    virtual size_t size() const = 0;
+};
+
+class StreamingPartVectorData final : public StreamingPartData {
+public:
+    explicit StreamingPartVectorData(std::vector<uint8_t> &&data) :
+    _data(std::move(data)) {
+    }
+
+    uint8_t const *data() const override {
+        return _data.data();
+    }
+
+    size_t size() const override {
+        return _data.size();
+    }
+
+private:
+    std::vector<uint8_t> _data;
+};
+
+}
+
+#endif
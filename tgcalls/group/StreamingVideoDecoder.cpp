@@ -0,0 +1,140 @@
+#include "StreamingVideoDecoder.h"
+
+#include "../Metrics.h"
+
+#include "rtc_base/time_utils.h"
+
+namespace tgcalls {
+
+struct StreamingVideoDecoder::State {
+    // Only used on the worker once decoding started.
+    std::shared_ptr<VideoStreamingPart> part;
+    MetricsHistogram *decodeTimeMetric = nullptr;
+
+    webrtc::Mutex mutex;
+    std::deque<VideoStreamingPartFrame> frames;
+    bool isDecodeScheduled = false;
+    bool isDecodingFinished = false;
+    bool isBehind = false;
+    bool isCancelled = false;
+};
+
+StreamingVideoDecoder::StreamingVideoDecoder(std::shared_ptr<VideoStreamingPart> part, rtc::TaskQueue *worker, MetricsHistogram *decodeTimeMetric, MetricsCounter *lateFramesMetric) :
+_state(std::make_shared<State>()),
+_worker(worker),
+_lateFramesMetric(lateFramesMetric) {
+    _endpointId = part->getActiveEndpointId();
+    _state->part = std::move(part);
+    _state->decodeTimeMetric = decodeTimeMetric;
+
+    scheduleDecodeIfNeeded();
+}
+
+StreamingVideoDecoder::~StreamingVideoDecoder() {
+    webrtc::MutexLock lock(&_state->mutex);
+    _state->isCancelled = true;
+}
+
+absl::optional<VideoStreamingPartFrame> StreamingVideoDecoder::getFrameAtRelativeTimestamp(double timestamp) {
+    absl::optional<VideoStreamingPartFrame> result;
+    if (timestamp < 0.0) {
+        return result;
+    }
+    {
+        webrtc::MutexLock lock(&_state->mutex);
+        while (true) {
+            if (!_currentFrame) {
+                if (_state->frames.empty()) {
+                    if (!_state->isDecodingFinished) {
+                        _state->isBehind = true;
+                    }
+                    break;
+                }
+                _currentFrame = std::move(_state->frames.front());
+                _state->frames.pop_front();
+                _isCurrentFrameReturned = false;
+
+                // Skipped frames leave a hole in the pts, which still has to be played out.
+                auto span = _currentFrame->duration;
+                if (_currentFrame->index != 0 && _previousFrameEndPts >= 0.0 && _currentFrame->pts > _previousFrameEndPts) {
+                    span += _currentFrame->pts - _previousFrameEndPts;
+                }
+                _previousFrameEndPts = _currentFrame->pts + _currentFrame->duration;
+                _relativeTimestamp += span;
+                _currentFrameStartTimestamp = _relativeTimestamp - _currentFrame->duration;
+            }
+
+            if (timestamp <= _relativeTimestamp) {
+                _isCurrentFrameReturned = true;
+                result = _currentFrame;
+                break;
+            }
+
+            if (!_isCurrentFrameReturned) {
+                _state->isBehind = true;
+                if (_lateFramesMetric) {
+                    _lateFramesMetric->add();
+                }
+            }
+            _currentFrame = absl::nullopt;
+        }
+    }
+
+    scheduleDecodeIfNeeded();
+    return result;
+}
+
+bool StreamingVideoDecoder::isFinished() {
+    webrtc::MutexLock lock(&_state->mutex);
+    return _state->isDecodingFinished && _state->frames.empty();
+}
+
+void StreamingVideoDecoder::scheduleDecodeIfNeeded() {
+    {
+        webrtc::MutexLock lock(&_state->mutex);
+        if (_state->isDecodeScheduled || _state->isDecodingFinished || _state->frames.size() >= kLookaheadFrames) {
+            return;
+        }
+        _state->isDecodeScheduled = true;
+    }
+    _worker->PostTask([state = _state]() {
+        decode(state);
+    });
+}
+
+void StreamingVideoDecoder::decode(std::shared_ptr<State> state) {
+    while (true) {
+        bool skipsNonReferenceFrames = false;
+        {
+            webrtc::MutexLock lock(&state->mutex);
+            if (state->isCancelled) {
+                state->isDecodeScheduled = false;
+                return;
+            }
+            if (state->frames.size() >= kLookaheadFrames) {
+                // Caught up, decode everything again.
+                state->isBehind = false;
+                state->isDecodeScheduled = false;
+                return;
+            }
+            skipsNonReferenceFrames = state->isBehind;
+        }
+
+        state->part->setSkipsNonReferenceFrames(skipsNonReferenceFrames);
+        const auto decodeStartUs = rtc::TimeMicros();
+        auto frame = state->part->getNextFrame();
+        if (state->decodeTimeMetric) {
+            state->decodeTimeMetric->record(rtc::TimeMicros() - decodeStartUs);
+        }
+
+        webrtc::MutexLock lock(&state->mutex);
+        if (!frame) {
+            state->isDecodingFinished = true;
+            state->isDecodeScheduled = false;
+            return;
+        }
+        state->frames.push_back(std::move(frame.value()));
+    }
+}
+
+} // namespace tgcalls
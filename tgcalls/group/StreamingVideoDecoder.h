@@ -0,0 +1,81 @@
+#ifndef TGCALLS_STREAMING_VIDEO_DECODER_H
+#define TGCALLS_STREAMING_VIDEO_DECODER_H
+
+#include "absl/types/optional.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/task_queue.h"
+
+#include "VideoStreamingPart.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace tgcalls {
+
+class MetricsCounter;
+class MetricsHistogram;
+
+// Decodes one broadcast video part ahead of playback on a decode worker, so
+// that the parts of different participants are decoded side by side instead
+// of one after another on the media thread.
+//
+// At most kLookaheadFrames decoded frames wait for playback. When playback
+// finds the worker behind, the decoder starts skipping frames that nothing
+// else references until the worker has caught up again.
+class StreamingVideoDecoder {
+public:
+    static constexpr size_t kLookaheadFrames = 4;
+
+    // Starts decoding right away. The metrics may be null. The worker belongs to
+    // whoever creates the decoder, who stops it before the metrics go away and
+    // calls nothing on the decoder after that.
+    StreamingVideoDecoder(std::shared_ptr<VideoStreamingPart> part, rtc::TaskQueue *worker, MetricsHistogram *decodeTimeMetric, MetricsCounter *lateFramesMetric);
+    ~StreamingVideoDecoder();
+
+    StreamingVideoDecoder(const StreamingVideoDecoder&) = delete;
+    StreamingVideoDecoder& operator=(const StreamingVideoDecoder&) = delete;
+
+    // Media thread. Like VideoStreamingPart::getFrameAtRelativeTimestamp, but
+    // never waits for the worker: nothing is returned while it is behind, or
+    // before the part starts.
+    absl::optional<VideoStreamingPartFrame> getFrameAtRelativeTimestamp(double timestamp);
+
+    // Media thread. Where on the part's timeline the last returned frame
+    // starts, and where the one after it is due.
+    double currentFrameStartTimestamp() const {
+        return _currentFrameStartTimestamp;
+    }
+    absl::optional<double> nextFrameTimestamp() const {
+        return _currentFrame ? absl::optional<double>(_relativeTimestamp) : absl::nullopt;
+    }
+
+    // The endpoint of the first event in the part.
+    absl::optional<std::string> const &endpointId() const {
+        return _endpointId;
+    }
+
+    // Whether playback has taken every frame of the part.
+    bool isFinished();
+
+private:
+    struct State;
+
+    static void decode(std::shared_ptr<State> state);
+    void scheduleDecodeIfNeeded();
+
+    std::shared_ptr<State> _state;
+    rtc::TaskQueue *_worker = nullptr;
+    MetricsCounter *_lateFramesMetric = nullptr;
+    absl::optional<std::string> _endpointId;
+
+    absl::optional<VideoStreamingPartFrame> _currentFrame;
+    bool _isCurrentFrameReturned = false;
+    double _relativeTimestamp = 0.0;
+    double _currentFrameStartTimestamp = 0.0;
+    double _previousFrameEndPts = -1.0;
+};
+
+} // namespace tgcalls
+
+#endif
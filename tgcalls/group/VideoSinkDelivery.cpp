@@ -0,0 +1,232 @@
+#include "VideoSinkDelivery.h"
+
+#include "api/task_queue/task_queue_factory.h"
+#include "api/video/i420_buffer.h"
+#include "rtc_base/time_utils.h"
+
+#include <algorithm>
+
+namespace tgcalls {
+
+ScaledVideoFrames::ScaledVideoFrames(webrtc::VideoFrame const &frame, int64_t sequence) :
+_frame(frame),
+_sequence(sequence) {
+}
+
+webrtc::VideoFrame ScaledVideoFrames::get(int maxWidth, int maxHeight) {
+    if (maxWidth <= 0 && maxHeight <= 0) {
+        return _frame;
+    }
+
+    const auto buffer = _frame.video_frame_buffer();
+    // The limits are for the displayed picture, the buffer is stored unrotated.
+    if (_frame.rotation() == webrtc::kVideoRotation_90 || _frame.rotation() == webrtc::kVideoRotation_270) {
+        std::swap(maxWidth, maxHeight);
+    }
+
+    auto scale = 1.0;
+    if (maxWidth > 0 && buffer->width() > maxWidth) {
+        scale = std::min(scale, (double)maxWidth / buffer->width());
+    }
+    if (maxHeight > 0 && buffer->height() > maxHeight) {
+        scale = std::min(scale, (double)maxHeight / buffer->height());
+    }
+    if (scale >= 1.0) {
+        return _frame;
+    }
+
+    // I420 chroma planes need even dimensions.
+    const auto width = std::max(2, (int)(buffer->width() * scale) & ~1);
+    const auto height = std::max(2, (int)(buffer->height() * scale) & ~1);
+
+    webrtc::MutexLock lock(&_mutex);
+    for (const auto &scaled : _scaled) {
+        if (scaled.width == width && scaled.height == height) {
+            return scaled.frame;
+        }
+    }
+
+    const auto scaledBuffer = webrtc::I420Buffer::Create(width, height);
+    scaledBuffer->ScaleFrom(*buffer->ToI420());
+
+    Scaled scaled;
+    scaled.width = width;
+    scaled.height = height;
+    scaled.frame = webrtc::VideoFrame::Builder()
+        .set_video_frame_buffer(scaledBuffer)
+        .set_rotation(_frame.rotation())
+        .set_timestamp_us(_frame.timestamp_us())
+        .set_timestamp_rtp(_frame.timestamp())
+        .set_ntp_time_ms(_frame.ntp_time_ms())
+        .set_id(_frame.id())
+        .build();
+    _scaled.push_back(scaled);
+    return scaled.frame;
+}
+
+VideoSinkDeliveryQueues::VideoSinkDeliveryQueues(webrtc::TaskQueueFactory *taskQueueFactory) :
+_taskQueueFactory(taskQueueFactory) {
+}
+
+VideoSinkDeliveryQueues::~VideoSinkDeliveryQueues() {
+}
+
+rtc::TaskQueue *VideoSinkDeliveryQueues::next() {
+    webrtc::MutexLock lock(&_mutex);
+    const auto index = _nextQueue;
+    _nextQueue = (_nextQueue + 1) % kQueueCount;
+    if (index == _queues.size()) {
+        _queues.push_back(std::make_unique<rtc::TaskQueue>(_taskQueueFactory->CreateTaskQueue("VideoSinkDelivery", webrtc::TaskQueueFactory::Priority::NORMAL)));
+    }
+    return _queues[index].get();
+}
+
+struct VideoSinkDelivery::State {
+    std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink;
+    VideoSinkOptions options;
+
+    std::atomic<int64_t> deliveredFrames{ 0 };
+    std::atomic<int64_t> droppedFrames{ 0 };
+
+    webrtc::Mutex mutex;
+    int64_t lastFrameTimeUs = 0;
+    // The latest frame accepted for the sink.
+    int64_t lastSequence = -1;
+    std::shared_ptr<ScaledVideoFrames> pendingFrames;
+    bool isDrainScheduled = false;
+
+    // Held while a synchronous sink takes a frame, taken before the mutex.
+    webrtc::Mutex syncMutex;
+};
+
+VideoSinkDelivery::VideoSinkDelivery(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options, rtc::TaskQueue *queue) :
+_state(std::make_shared<State>()) {
+    _state->sink = sink;
+    _state->options = options;
+    if (options.deliverAsync) {
+        _queue = queue;
+    }
+}
+
+VideoSinkDelivery::~VideoSinkDelivery() {
+}
+
+std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> const &VideoSinkDelivery::sink() const {
+    return _state->sink;
+}
+
+VideoSinkOptions const &VideoSinkDelivery::options() const {
+    return _state->options;
+}
+
+int64_t VideoSinkDelivery::deliveredFrames() const {
+    return _state->deliveredFrames.load(std::memory_order_relaxed);
+}
+
+int64_t VideoSinkDelivery::droppedFrames() const {
+    return _state->droppedFrames.load(std::memory_order_relaxed);
+}
+
+bool VideoSinkDelivery::deliver(std::shared_ptr<ScaledVideoFrames> const &frames) {
+    if (_state->sink.expired()) {
+        return false;
+    }
+
+    if (!_queue) {
+        // Frames come from the decoding thread and from addSink, the sink
+        // gets them one at a time and in order.
+        webrtc::MutexLock syncLock(&_state->syncMutex);
+        {
+            webrtc::MutexLock lock(&_state->mutex);
+            if (!acceptFrame(frames->sequence())) {
+                return true;
+            }
+        }
+        if (const auto strong = _state->sink.lock()) {
+            strong->OnFrame(frames->get(_state->options.maxWidth, _state->options.maxHeight));
+            _state->deliveredFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    bool scheduleDrain = false;
+    {
+        webrtc::MutexLock lock(&_state->mutex);
+        if (!acceptFrame(frames->sequence())) {
+            return true;
+        }
+        if (_state->pendingFrames) {
+            _state->droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+        _state->pendingFrames = frames;
+        if (!_state->isDrainScheduled) {
+            _state->isDrainScheduled = true;
+            scheduleDrain = true;
+        }
+    }
+    if (scheduleDrain) {
+        _queue->PostTask([state = _state]() {
+            drain(state);
+        });
+    }
+    return true;
+}
+
+bool VideoSinkDelivery::deliverDiscarded() {
+    if (!_queue) {
+        const auto strong = _state->sink.lock();
+        if (!strong) {
+            return false;
+        }
+        webrtc::MutexLock syncLock(&_state->syncMutex);
+        strong->OnDiscardedFrame();
+        return true;
+    }
+
+    if (_state->sink.expired()) {
+        return false;
+    }
+    _queue->PostTask([sink = _state->sink]() {
+        if (const auto strong = sink.lock()) {
+            strong->OnDiscardedFrame();
+        }
+    });
+    return true;
+}
+
+bool VideoSinkDelivery::acceptFrame(int64_t sequence) {
+    if (sequence <= _state->lastSequence) {
+        return false;
+    }
+    if (_state->options.maxFramerate > 0) {
+        const auto timeUs = rtc::TimeMicros();
+        const auto intervalUs = rtc::kNumMicrosecsPerSec / _state->options.maxFramerate;
+        // A quarter of the interval is tolerated, frames don't arrive evenly spaced.
+        if (_state->lastFrameTimeUs != 0 && timeUs - _state->lastFrameTimeUs < intervalUs * 3 / 4) {
+            return false;
+        }
+        _state->lastFrameTimeUs = timeUs;
+    }
+    _state->lastSequence = sequence;
+    return true;
+}
+
+void VideoSinkDelivery::drain(std::shared_ptr<State> state) {
+    std::shared_ptr<ScaledVideoFrames> frames;
+    {
+        webrtc::MutexLock lock(&state->mutex);
+        frames = std::move(state->pendingFrames);
+        state->pendingFrames.reset();
+        state->isDrainScheduled = false;
+    }
+    if (!frames) {
+        return;
+    }
+    if (const auto strong = state->sink.lock()) {
+        // Scaling happens here rather than on the decoding thread.
+        strong->OnFrame(frames->get(state->options.maxWidth, state->options.maxHeight));
+        state->deliveredFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace tgcalls
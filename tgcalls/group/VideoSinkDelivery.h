@@ -0,0 +1,118 @@
+#ifndef TGCALLS_VIDEO_SINK_DELIVERY_H
+#define TGCALLS_VIDEO_SINK_DELIVERY_H
+
+#include "api/video/video_frame.h"
+#include "api/video/video_sink_interface.h"
+#include "absl/types/optional.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/task_queue.h"
+
+#include "GroupInstanceImpl.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace webrtc {
+class TaskQueueFactory;
+}
+
+namespace tgcalls {
+
+// One decoded frame and the downscaled copies made of it. Sinks that want the
+// same size share a copy, which is made by whichever of them gets there first.
+// The sequence orders the frames of one video, later frames count higher.
+class ScaledVideoFrames {
+public:
+    ScaledVideoFrames(webrtc::VideoFrame const &frame, int64_t sequence);
+
+    // Any thread.
+    webrtc::VideoFrame get(int maxWidth, int maxHeight);
+
+    int64_t sequence() const {
+        return _sequence;
+    }
+
+private:
+    struct Scaled {
+        int width = 0;
+        int height = 0;
+        webrtc::VideoFrame frame;
+    };
+
+    webrtc::VideoFrame _frame;
+    int64_t _sequence = 0;
+    webrtc::Mutex _mutex;
+    std::vector<Scaled> _scaled;
+};
+
+// The task queues async video sinks are drained on, see SharedMediaFactories.
+// Sinks are spread over a few queues instead of getting a thread each, a slow
+// sink only holds up the sinks that happen to share its queue.
+class VideoSinkDeliveryQueues {
+public:
+    static constexpr size_t kQueueCount = 2;
+
+    // The factory must outlive this object.
+    explicit VideoSinkDeliveryQueues(webrtc::TaskQueueFactory *taskQueueFactory);
+    ~VideoSinkDeliveryQueues();
+
+    VideoSinkDeliveryQueues(const VideoSinkDeliveryQueues&) = delete;
+    VideoSinkDeliveryQueues& operator=(const VideoSinkDeliveryQueues&) = delete;
+
+    // Any thread. The queues are created as they are first handed out and
+    // live as long as this object.
+    rtc::TaskQueue *next();
+
+private:
+    webrtc::TaskQueueFactory *_taskQueueFactory = nullptr;
+    webrtc::Mutex _mutex;
+    std::vector<std::unique_ptr<rtc::TaskQueue>> _queues;
+    size_t _nextQueue = 0;
+};
+
+// Hands the frames of one incoming video to one sink.
+//
+// Synchronous sinks get each frame on the decoding thread. Async sinks get a
+// single-slot mailbox that is drained on a shared delivery queue: a frame that
+// arrives before the sink took the previous one replaces it, so only the
+// latest frame is ever waiting and a slow sink cannot hold up the decoder.
+//
+// Either way a sink never gets two frames at once, and never a frame older
+// than one it already got. Posted tasks own the mailbox, so a delivery can be
+// dropped on any thread without waiting for a frame the sink is still busy with.
+class VideoSinkDelivery {
+public:
+    // Without a queue async sinks fall back to synchronous delivery. The queue
+    // must outlive every call to deliver.
+    VideoSinkDelivery(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options, rtc::TaskQueue *queue);
+    ~VideoSinkDelivery();
+
+    VideoSinkDelivery(const VideoSinkDelivery&) = delete;
+    VideoSinkDelivery& operator=(const VideoSinkDelivery&) = delete;
+
+    // Any thread. Return false once the sink is gone.
+    bool deliver(std::shared_ptr<ScaledVideoFrames> const &frames);
+    bool deliverDiscarded();
+
+    std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> const &sink() const;
+    VideoSinkOptions const &options() const;
+
+    int64_t deliveredFrames() const;
+    int64_t droppedFrames() const;
+
+private:
+    struct State;
+
+    static void drain(std::shared_ptr<State> state);
+    // Called with the state's mutex held. False for a frame older than one
+    // already accepted, or one that comes too soon for the sink's framerate.
+    bool acceptFrame(int64_t sequence);
+
+    std::shared_ptr<State> _state;
+    rtc::TaskQueue *_queue = nullptr;
+};
+
+} // namespace tgcalls
+
+#endif
@@ -120,20 +120,20 @@ struct VideoStreamInfo {
     std::vector<VideoStreamEvent> events;
 };
 
-absl::optional<int32_t> readInt32(std::vector<uint8_t> const &data, int &offset) {
-    if (offset + 4 > data.size()) {
+absl::optional<int32_t> readInt32(uint8_t const *data, size_t size, int &offset) {
+    if (offset + 4 > size) {
         return absl::nullopt;
     }
 
     int32_t value = 0;
-    memcpy(&value, data.data() + offset, 4);
+    memcpy(&value, data + offset, 4);
     offset += 4;
 
     return value;
 }
 
-absl::optional<uint8_t> readBytesAsInt32(std::vector<uint8_t> const &data, int &offset, int count) {
-    if (offset + count > data.size()) {
+absl::optional<uint8_t> readBytesAsInt32(uint8_t const *data, size_t size, int &offset, int count) {
+    if (offset + count > size) {
         return absl::nullopt;
     }
 
@@ -143,7 +143,7 @@ absl::optional<uint8_t> readBytesAsInt32(std::vector<uint8_t> const &data, int &
 
     if (count <= 4) {
         int32_t value = 0;
-        memcpy(&value, data.data() + offset, count);
+        memcpy(&value, data + offset, count);
         offset += count;
         return value;
     } else {
@@ -164,12 +164,12 @@ int32_t roundUp(int32_t numToRound, int32_t multiple) {
     return numToRound + multiple - remainder;
 }
 
-absl::optional<std::string> readSerializedString(std::vector<uint8_t> const &data, int &offset) {
-    if (const auto tmp = readBytesAsInt32(data, offset, 1)) {
+absl::optional<std::string> readSerializedString(uint8_t const *data, size_t size, int &offset) {
+    if (const auto tmp = readBytesAsInt32(data, size, offset, 1)) {
         int paddingBytes = 0;
         int length = 0;
         if (tmp.value() == 254) {
-            if (const auto len = readBytesAsInt32(data, offset, 3)) {
+            if (const auto len = readBytesAsInt32(data, size, offset, 3)) {
                 length = len.value();
                 paddingBytes = roundUp(length, 4) - length;
             } else {
@@ -181,11 +181,11 @@ absl::optional<std::string> readSerializedString(std::vector<uint8_t> const &dat
             paddingBytes = roundUp(length + 1, 4) - (length + 1);
         }
 
-        if (offset + length > data.size()) {
+        if (offset + length > size) {
             return absl::nullopt;
         }
 
-        std::string result(data.data() + offset, data.data() + offset + length);
+        std::string result(data + offset, data + offset + length);
 
         offset += length;
         offset += paddingBytes;
@@ -196,28 +196,28 @@ absl::optional<std::string> readSerializedString(std::vector<uint8_t> const &dat
     }
 }
 
-absl::optional<VideoStreamEvent> readVideoStreamEvent(std::vector<uint8_t> const &data, int &offset) {
+absl::optional<VideoStreamEvent> readVideoStreamEvent(uint8_t const *data, size_t size, int &offset) {
     VideoStreamEvent event;
 
-    if (const auto offsetValue = readInt32(data, offset)) {
+    if (const auto offsetValue = readInt32(data, size, offset)) {
         event.offset = offsetValue.value();
     } else {
         return absl::nullopt;
     }
 
-    if (const auto endpointId = readSerializedString(data, offset)) {
+    if (const auto endpointId = readSerializedString(data, size, offset)) {
         event.endpointId = endpointId.value();
     } else {
         return absl::nullopt;
     }
 
-    if (const auto rotation = readInt32(data, offset)) {
+    if (const auto rotation = readInt32(data, size, offset)) {
         event.rotation = rotation.value();
     } else {
         return absl::nullopt;
     }
 
-    if (const auto extra = readInt32(data, offset)) {
+    if (const auto extra = readInt32(data, size, offset)) {
         event.extra = extra.value();
     } else {
         return absl::nullopt;
@@ -226,9 +226,8 @@ absl::optional<VideoStreamEvent> readVideoStreamEvent(std::vector<uint8_t> const
     return event;
 }
 
-absl::optional<VideoStreamInfo> consumeVideoStreamInfo(std::vector<uint8_t> &data) {
-    int offset = 0;
-    if (const auto signature = readInt32(data, offset)) {
+absl::optional<VideoStreamInfo> consumeVideoStreamInfo(uint8_t const *data, size_t size, int &offset) {
+    if (const auto signature = readInt32(data, size, offset)) {
         if (signature.value() != 0xa12e810d) {
             return absl::nullopt;
         }
@@ -238,20 +237,20 @@ absl::optional<VideoStreamInfo> consumeVideoStreamInfo(std::vector<uint8_t> &dat
 
     VideoStreamInfo info;
 
-    if (const auto container = readSerializedString(data, offset)) {
+    if (const auto container = readSerializedString(data, size, offset)) {
         info.container = container.value();
     } else {
         return absl::nullopt;
     }
 
-    if (const auto activeMask = readInt32(data, offset)) {
+    if (const auto activeMask = readInt32(data, size, offset)) {
         info.activeMask = activeMask.value();
     } else {
         return absl::nullopt;
     }
 
-    if (const auto eventCount = readInt32(data, offset)) {
-        if (const auto event = readVideoStreamEvent(data, offset)) {
+    if (const auto eventCount = readInt32(data, size, offset)) {
+        if (const auto event = readVideoStreamEvent(data, size, offset)) {
             info.events.push_back(event.value());
         } else {
             return absl::nullopt;
@@ -260,8 +259,6 @@ absl::optional<VideoStreamInfo> consumeVideoStreamInfo(std::vector<uint8_t> &dat
         return absl::nullopt;
     }
 
-    data.erase(data.begin(), data.begin() + offset);
-
     return info;
 }
 
@@ -269,10 +266,10 @@ absl::optional<VideoStreamInfo> consumeVideoStreamInfo(std::vector<uint8_t> &dat
 
 class VideoStreamingPartInternal {
 public:
-    VideoStreamingPartInternal(std::string endpointId, webrtc::VideoRotation rotation, std::vector<uint8_t> &&fileData, std::string const &container) :
+    VideoStreamingPartInternal(std::string endpointId, webrtc::VideoRotation rotation, std::shared_ptr<StreamingPartData> fileData, size_t offset, size_t length, std::string const &container) :
     _endpointId(endpointId),
     _rotation(rotation) {
-        _avIoContext = std::make_unique<AVIOContextImpl>(std::move(fileData));
+        _avIoContext = std::make_unique<AVIOContextImpl>(std::move(fileData), offset, length);
 
         int ret = 0;
 
@@ -359,6 +356,12 @@ public:
         return _endpointId;
     }
 
+    void setSkipsNonReferenceFrames(bool skipsNonReferenceFrames) {
+        if (_codecContext) {
+            _codecContext->skip_frame = skipsNonReferenceFrames ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+        }
+    }
+
     absl::optional<MediaDataPacket> readPacket() {
         if (_didReadToEnd) {
             return absl::nullopt;
@@ -491,29 +494,34 @@ private:
 
 class VideoStreamingPartState {
 public:
-    VideoStreamingPartState(std::vector<uint8_t> &&data, VideoStreamingPart::ContentType contentType) {
-        _videoStreamInfo = consumeVideoStreamInfo(data);
+    VideoStreamingPartState(std::shared_ptr<StreamingPartData> data, VideoStreamingPart::ContentType contentType) {
+        int headerSize = 0;
+        _videoStreamInfo = consumeVideoStreamInfo(data->data(), data->size(), headerSize);
         if (!_videoStreamInfo) {
             return;
         }
 
+        // Event offsets are relative to the end of the header; slices reference the shared data without copying.
+        size_t payloadSize = data->size() - headerSize;
+
         for (size_t i = 0; i < _videoStreamInfo->events.size(); i++) {
             if (_videoStreamInfo->events[i].offset < 0) {
                 continue;
             }
             size_t endOffset = 0;
             if (i == _videoStreamInfo->events.size() - 1) {
-                endOffset = data.size();
+                endOffset = payloadSize;
             } else {
                 endOffset = _videoStreamInfo->events[i + 1].offset;
             }
             if (endOffset <= _videoStreamInfo->events[i].offset) {
                 continue;
             }
-            if (endOffset > data.size()) {
+            if (endOffset > payloadSize) {
                 continue;
             }
-            std::vector<uint8_t> dataSlice(data.begin() + _videoStreamInfo->events[i].offset, data.begin() + endOffset);
+            size_t sliceOffset = headerSize + _videoStreamInfo->events[i].offset;
+            size_t sliceLength = endOffset - _videoStreamInfo->events[i].offset;
             webrtc::VideoRotation rotation = webrtc::VideoRotation::kVideoRotation_0;
             switch (_videoStreamInfo->events[i].rotation) {
                 case 0: {
@@ -539,13 +547,13 @@ public:
 
             switch (contentType) {
                 case VideoStreamingPart::ContentType::Audio: {
-                    auto part = std::make_unique<AudioStreamingPart>(std::move(dataSlice), _videoStreamInfo->container, true);
+                    auto part = std::make_unique<AudioStreamingPart>(data, sliceOffset, sliceLength, _videoStreamInfo->container, true);
                     _parsedAudioParts.push_back(std::move(part));
 
                     break;
                 }
                 case VideoStreamingPart::ContentType::Video: {
-                    auto part = std::make_unique<VideoStreamingPartInternal>(_videoStreamInfo->events[i].endpointId, rotation, std::move(dataSlice), _videoStreamInfo->container);
+                    auto part = std::make_unique<VideoStreamingPartInternal>(_videoStreamInfo->events[i].endpointId, rotation, data, sliceOffset, sliceLength, _videoStreamInfo->container);
                     _parsedVideoParts.push_back(std::move(part));
 
                     break;
@@ -587,6 +595,27 @@ public:
         }
     }
 
+    absl::optional<VideoStreamingPartFrame> getNextFrame() {
+        while (!_parsedVideoParts.empty()) {
+            auto result = _parsedVideoParts[0]->getNextFrame();
+            if (result) {
+                return result;
+            }
+            _parsedVideoParts.erase(_parsedVideoParts.begin());
+        }
+        return absl::nullopt;
+    }
+
+    void setSkipsNonReferenceFrames(bool skipsNonReferenceFrames) {
+        if (_skipsNonReferenceFrames == skipsNonReferenceFrames) {
+            return;
+        }
+        _skipsNonReferenceFrames = skipsNonReferenceFrames;
+        for (const auto &part : _parsedVideoParts) {
+            part->setSkipsNonReferenceFrames(skipsNonReferenceFrames);
+        }
+    }
+
     absl::optional<std::string> getActiveEndpointId() const {
         if (!_parsedVideoParts.empty()) {
             return _parsedVideoParts[0]->endpointId();
@@ -624,12 +653,19 @@ private:
     std::vector<std::unique_ptr<VideoStreamingPartInternal>> _parsedVideoParts;
     absl::optional<VideoStreamingPartFrame> _currentFrame;
     double _relativeTimestamp = 0.0;
+    bool _skipsNonReferenceFrames = false;
 
     std::vector<std::unique_ptr<AudioStreamingPart>> _parsedAudioParts;
 };
 
 VideoStreamingPart::VideoStreamingPart(std::vector<uint8_t> &&data, VideoStreamingPart::ContentType contentType) {
     if (!data.empty()) {
+        _state = new VideoStreamingPartState(std::make_shared<StreamingPartVectorData>(std::move(data)), contentType);
+    }
+}
+
+VideoStreamingPart::VideoStreamingPart(std::shared_ptr<StreamingPartData> data, VideoStreamingPart::ContentType contentType) {
+    if (data && data->size() != 0) {
         _state = new VideoStreamingPartState(std::move(data), contentType);
     }
 }
@@ -646,12 +682,24 @@ absl::optional<VideoStreamingPartFrame> VideoStreamingPart::getFrameAtRelativeTi
         : absl::nullopt;
 }
 
+absl::optional<VideoStreamingPartFrame> VideoStreamingPart::getNextFrame() {
+    return _state
+        ? _state->getNextFrame()
+        : absl::nullopt;
+}
+
 absl::optional<std::string> VideoStreamingPart::getActiveEndpointId() const {
     return _state
         ? _state->getActiveEndpointId()
         : absl::nullopt;
 }
 
+void VideoStreamingPart::setSkipsNonReferenceFrames(bool skipsNonReferenceFrames) {
+    if (_state) {
+        _state->setSkipsNonReferenceFrames(skipsNonReferenceFrames);
+    }
+}
+
 int VideoStreamingPart::getAudioRemainingMilliseconds() {
     return _state
         ? _state->getAudioRemainingMilliseconds()
@@ -40,6 +40,7 @@ public:
     
 public:
     explicit VideoStreamingPart(std::vector<uint8_t> &&data, VideoStreamingPart::ContentType contentType);
+    explicit VideoStreamingPart(std::shared_ptr<StreamingPartData> data, VideoStreamingPart::ContentType contentType);
     ~VideoStreamingPart();
     
     VideoStreamingPart(const VideoStreamingPart&) = delete;
@@ -51,7 +52,11 @@ public:
     VideoStreamingPart& operator=(VideoStreamingPart&&) = delete;
 
     absl::optional<VideoStreamingPartFrame> getFrameAtRelativeTimestamp(double timestamp);
+    // Sequential access for offline processing; not to be mixed with getFrameAtRelativeTimestamp.
+    absl::optional<VideoStreamingPartFrame> getNextFrame();
     absl::optional<std::string> getActiveEndpointId() const;
+    // Lets the decoder drop frames no other frame references, for when playback falls behind.
+    void setSkipsNonReferenceFrames(bool skipsNonReferenceFrames);
     
     int getAudioRemainingMilliseconds();
     std::vector<AudioStreamingPart::StreamingPartChannel> getAudio10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder);
@@ -43,6 +43,8 @@
 #include "CodecSelectHelper.h"
 #include "AudioDeviceHelper.h"
 #include "SignalingEncryption.h"
+#include "Metrics.h"
+#include "ThreadInstrumentation.h"
 #ifdef WEBRTC_IOS
 #include "platform/darwin/iOS/tgcalls_audio_device_module_ios.h"
 #endif
@@ -1177,8 +1179,15 @@ private:
 
 class InstanceV2ImplInternal : public std::enable_shared_from_this<InstanceV2ImplInternal> {
 public:
-    InstanceV2ImplInternal(Descriptor &&descriptor, std::shared_ptr<Threads> threads) :
+    InstanceV2ImplInternal(Descriptor &&descriptor, std::shared_ptr<Threads> threads, std::shared_ptr<MetricsRegistry> metrics) :
     _threads(threads),
+    _metrics(metrics),
+    _signalingMessagesSentMetric(metrics->counter("signaling.messages_sent")),
+    _signalingMessagesReceivedMetric(metrics->counter("signaling.messages_received")),
+    _signalingBytesSentMetric(metrics->counter("signaling.bytes_sent")),
+    _signalingBytesReceivedMetric(metrics->counter("signaling.bytes_received")),
+    _signalingEncryptTimeMetric(metrics->histogram("signaling.encrypt_us")),
+    _signalingDecryptTimeMetric(metrics->histogram("signaling.decrypt_us")),
     _rtcServers(descriptor.rtcServers),
     _encryptionKey(std::move(descriptor.encryptionKey)),
     _stateUpdated(descriptor.stateUpdated),
@@ -1343,12 +1352,20 @@ public:
     }
 
     void sendSignalingMessage(signaling::Message const &message) {
-        auto data = message.serialize();
+        auto data = _peerSupportsBinarySignaling ? message.serializeBinary() : message.serialize();
+
+        RTC_LOG(LS_INFO) << "sendSignalingMessage: " << data.size() << " bytes" << (_peerSupportsBinarySignaling ? " (binary)" : "");
+        if (!_peerSupportsBinarySignaling) {
+            RTC_LOG(LS_VERBOSE) << "sendSignalingMessage: " << std::string(data.begin(), data.end());
+        }
 
-        RTC_LOG(LS_INFO) << "sendSignalingMessage: " << std::string(data.begin(), data.end());
+        _signalingMessagesSentMetric->add();
+        _signalingBytesSentMetric->add((int64_t)data.size());
 
         if (_signalingEncryption) {
+            const auto startUs = rtc::TimeMicros();
             if (const auto encryptedData = _signalingEncryption->encryptOutgoing(data)) {
+                _signalingEncryptTimeMetric->record(rtc::TimeMicros() - startUs);
                 _signalingDataEmitted(std::vector<uint8_t>(encryptedData->data(), encryptedData->data() + encryptedData->size()));
             } else {
                 RTC_LOG(LS_ERROR) << "sendSignalingMessage: failed to encrypt payload";
@@ -1480,6 +1497,7 @@ public:
 
                 data.ufrag = ufrag;
                 data.pwd = pwd;
+                data.supportsBinarySignaling = true;
 
                 signaling::DtlsFingerprint dtlsFingerprint;
                 dtlsFingerprint.hash = hash;
@@ -1498,12 +1516,14 @@ public:
         std::vector<uint8_t> decryptedData;
 
         if (_signalingEncryption) {
+            const auto startUs = rtc::TimeMicros();
             const auto rawDecryptedData = _signalingEncryption->decryptIncoming(data);
             if (!rawDecryptedData) {
                 RTC_LOG(LS_ERROR) << "receiveSignalingData: could not decrypt payload";
 
                 return;
             }
+            _signalingDecryptTimeMetric->record(rtc::TimeMicros() - startUs);
 
             decryptedData = std::vector<uint8_t>(rawDecryptedData->data(), rawDecryptedData->data() + rawDecryptedData->size());
         } else {
@@ -1514,7 +1534,14 @@ public:
     }
 
     void processSignalingData(const std::vector<uint8_t> &data) {
-        RTC_LOG(LS_INFO) << "processSignalingData: " << std::string(data.begin(), data.end());
+        _signalingMessagesReceivedMetric->add();
+        _signalingBytesReceivedMetric->add((int64_t)data.size());
+
+        const auto isBinary = signaling::Message::isBinary(data);
+        RTC_LOG(LS_INFO) << "processSignalingData: " << data.size() << " bytes" << (isBinary ? " (binary)" : "");
+        if (!isBinary) {
+            RTC_LOG(LS_VERBOSE) << "processSignalingData: " << std::string(data.begin(), data.end());
+        }
 
         const auto message = signaling::Message::parse(data);
         if (!message) {
@@ -1522,6 +1549,10 @@ public:
         }
         const auto messageData = &message->data;
         if (const auto initialSetup = absl::get_if<signaling::InitialSetupMessage>(messageData)) {
+            if (initialSetup->supportsBinarySignaling || isBinary) {
+                _peerSupportsBinarySignaling = true;
+            }
+
             PeerIceParameters remoteIceParameters;
             remoteIceParameters.ufrag = initialSetup->ufrag;
             remoteIceParameters.pwd = initialSetup->pwd;
@@ -2036,6 +2067,13 @@ private:
 
 private:
     std::shared_ptr<Threads> _threads;
+    std::shared_ptr<MetricsRegistry> _metrics;
+    MetricsCounter *_signalingMessagesSentMetric = nullptr;
+    MetricsCounter *_signalingMessagesReceivedMetric = nullptr;
+    MetricsCounter *_signalingBytesSentMetric = nullptr;
+    MetricsCounter *_signalingBytesReceivedMetric = nullptr;
+    MetricsHistogram *_signalingEncryptTimeMetric = nullptr;
+    MetricsHistogram *_signalingDecryptTimeMetric = nullptr;
     std::vector<RtcServer> _rtcServers;
     EncryptionKey _encryptionKey;
     std::function<void(State)> _stateUpdated;
@@ -2052,6 +2090,7 @@ private:
     bool _handshakeCompleted = false;
     std::vector<cricket::Candidate> _pendingIceCandidates;
     bool _isDataChannelOpen = false;
+    bool _peerSupportsBinarySignaling = false;
 
     std::unique_ptr<webrtc::RtcEventLogNull> _eventLog;
     std::unique_ptr<webrtc::TaskQueueFactory> _taskQueueFactory;
@@ -2108,8 +2147,10 @@ InstanceV2Impl::InstanceV2Impl(Descriptor &&descriptor) {
     }
 
     _threads = StaticThreads::getThreads();
-    _internal.reset(new ThreadLocalObject<InstanceV2ImplInternal>(_threads->getMediaThread(), [descriptor = std::move(descriptor), threads = _threads]() mutable {
-        return new InstanceV2ImplInternal(std::move(descriptor), threads);
+    _metrics = std::make_shared<MetricsRegistry>();
+    ThreadInstrumentation::addQueueDepthMetrics(_metrics);
+    _internal.reset(new ThreadLocalObject<InstanceV2ImplInternal>(_threads->getMediaThread(), [descriptor = std::move(descriptor), threads = _threads, metrics = _metrics]() mutable {
+        return new InstanceV2ImplInternal(std::move(descriptor), threads, metrics);
     }));
     _internal->perform(RTC_FROM_HERE, [](InstanceV2ImplInternal *internal) {
         internal->start();
@@ -2215,6 +2256,10 @@ TrafficStats InstanceV2Impl::getTrafficStats() {
     return {};
 }
 
+std::shared_ptr<MetricsRegistry> InstanceV2Impl::getMetrics() {
+    return _metrics;
+}
+
 PersistentState InstanceV2Impl::getPersistentState() {
     return {};
 }
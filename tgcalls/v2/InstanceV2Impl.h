@@ -43,12 +43,14 @@ public:
 	int64_t getPreferredRelayId() override;
 	TrafficStats getTrafficStats() override;
 	PersistentState getPersistentState() override;
+	std::shared_ptr<MetricsRegistry> getMetrics() override;
 	void stop(std::function<void(FinalState)> completion) override;
     void sendVideoDeviceUpdated() override {
     }
 
 private:
     std::shared_ptr<Threads> _threads;
+    std::shared_ptr<MetricsRegistry> _metrics;
 	std::unique_ptr<ThreadLocalObject<InstanceV2ImplInternal>> _internal;
 	std::unique_ptr<LogSinkImpl> _logSink;
 
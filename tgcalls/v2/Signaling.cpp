@@ -5,6 +5,7 @@
 #include "rtc_base/checks.h"
 
 #include <sstream>
+#include <stdint.h>
 
 namespace tgcalls {
 namespace signaling {
@@ -329,6 +330,10 @@ std::vector<uint8_t> InitialSetupMessage_serialize(const InitialSetupMessage * c
         object.insert(std::make_pair("screencast", json11::Json(MediaContent_serialize(screencast.value()))));
     }
 
+    if (message->supportsBinarySignaling) {
+        object.insert(std::make_pair("binarySignaling", json11::Json(true)));
+    }
+
     auto json = json11::Json(std::move(object));
     std::string result = json.dump();
     return std::vector<uint8_t>(result.begin(), result.end());
@@ -414,6 +419,11 @@ absl::optional<InitialSetupMessage> InitialSetupMessage_parse(json11::Json::obje
         }
     }
 
+    const auto binarySignaling = object.find("binarySignaling");
+    if (binarySignaling != object.end() && binarySignaling->second.is_bool()) {
+        message.supportsBinarySignaling = binarySignaling->second.bool_value();
+    }
+
     return message;
 }
 
@@ -645,6 +655,414 @@ absl::optional<MediaStateMessage> MediaStateMessage_parse(json11::Json::object c
     return message;
 }
 
+// Binary encoding: magic, version and message type bytes followed by the
+// fields in declaration order. Integers are LEB128 varints, strings and lists
+// are prefixed with their varint length. Readers ignore trailing bytes, so
+// later versions may append fields without breaking older parsers.
+
+static const uint8_t kBinaryMagic = 0xfe;
+static const uint8_t kBinaryVersion = 1;
+
+enum class BinaryMessageType : uint8_t {
+    InitialSetup = 1,
+    Candidates = 2,
+    MediaState = 3
+};
+
+class BinaryWriter {
+public:
+    BinaryWriter(BinaryMessageType type) {
+        _data.reserve(256);
+        writeByte(kBinaryMagic);
+        writeByte(kBinaryVersion);
+        writeByte((uint8_t)type);
+    }
+
+    void writeByte(uint8_t value) {
+        _data.push_back(value);
+    }
+
+    void writeVarint(uint64_t value) {
+        while (value >= 0x80) {
+            _data.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        _data.push_back((uint8_t)value);
+    }
+
+    void writeString(std::string const &value) {
+        writeVarint(value.size());
+        _data.insert(_data.end(), value.begin(), value.end());
+    }
+
+    std::vector<uint8_t> takeData() {
+        return std::move(_data);
+    }
+
+private:
+    std::vector<uint8_t> _data;
+};
+
+class BinaryReader {
+public:
+    BinaryReader(uint8_t const *data, size_t size) :
+    _data(data),
+    _end(data + size) {
+    }
+
+    bool readByte(uint8_t &value) {
+        if (_data == _end) {
+            return false;
+        }
+        value = *_data++;
+        return true;
+    }
+
+    bool readVarint(uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = 0;
+            if (!readByte(byte)) {
+                return false;
+            }
+            value |= ((uint64_t)(byte & 0x7f)) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool readUInt32(uint32_t &value) {
+        uint64_t result = 0;
+        if (!readVarint(result) || result > UINT32_MAX) {
+            return false;
+        }
+        value = (uint32_t)result;
+        return true;
+    }
+
+    // Every list item takes at least one byte, which bounds the count before anything is reserved.
+    bool readCount(size_t &value) {
+        uint64_t result = 0;
+        if (!readVarint(result) || result > (uint64_t)(_end - _data)) {
+            return false;
+        }
+        value = (size_t)result;
+        return true;
+    }
+
+    bool readString(std::string &value) {
+        size_t length = 0;
+        if (!readCount(length)) {
+            return false;
+        }
+        value.assign((const char *)_data, length);
+        _data += length;
+        return true;
+    }
+
+private:
+    uint8_t const *_data = nullptr;
+    uint8_t const *_end = nullptr;
+};
+
+void MediaContent_writeBinary(BinaryWriter &writer, MediaContent const &mediaContent) {
+    writer.writeVarint(mediaContent.ssrc);
+
+    writer.writeVarint(mediaContent.ssrcGroups.size());
+    for (const auto &group : mediaContent.ssrcGroups) {
+        writer.writeString(group.semantics);
+        writer.writeVarint(group.ssrcs.size());
+        for (auto ssrc : group.ssrcs) {
+            writer.writeVarint(ssrc);
+        }
+    }
+
+    writer.writeVarint(mediaContent.payloadTypes.size());
+    for (const auto &payloadType : mediaContent.payloadTypes) {
+        writer.writeVarint(payloadType.id);
+        writer.writeString(payloadType.name);
+        writer.writeVarint(payloadType.clockrate);
+        writer.writeVarint(payloadType.channels);
+        writer.writeVarint(payloadType.feedbackTypes.size());
+        for (const auto &feedbackType : payloadType.feedbackTypes) {
+            writer.writeString(feedbackType.type);
+            writer.writeString(feedbackType.subtype);
+        }
+        writer.writeVarint(payloadType.parameters.size());
+        for (const auto &parameter : payloadType.parameters) {
+            writer.writeString(parameter.first);
+            writer.writeString(parameter.second);
+        }
+    }
+
+    writer.writeVarint(mediaContent.rtpExtensions.size());
+    for (const auto &rtpExtension : mediaContent.rtpExtensions) {
+        writer.writeVarint((uint32_t)rtpExtension.id);
+        writer.writeString(rtpExtension.uri);
+    }
+}
+
+absl::optional<MediaContent> MediaContent_readBinary(BinaryReader &reader) {
+    MediaContent result;
+    size_t count = 0;
+
+    if (!reader.readUInt32(result.ssrc)) {
+        return absl::nullopt;
+    }
+
+    if (!reader.readCount(count)) {
+        return absl::nullopt;
+    }
+    result.ssrcGroups.resize(count);
+    for (auto &group : result.ssrcGroups) {
+        size_t ssrcCount = 0;
+        if (!reader.readString(group.semantics) || !reader.readCount(ssrcCount)) {
+            return absl::nullopt;
+        }
+        group.ssrcs.resize(ssrcCount);
+        for (auto &ssrc : group.ssrcs) {
+            if (!reader.readUInt32(ssrc)) {
+                return absl::nullopt;
+            }
+        }
+    }
+
+    if (!reader.readCount(count)) {
+        return absl::nullopt;
+    }
+    result.payloadTypes.resize(count);
+    for (auto &payloadType : result.payloadTypes) {
+        size_t feedbackTypeCount = 0;
+        if (!reader.readUInt32(payloadType.id)
+            || !reader.readString(payloadType.name)
+            || !reader.readUInt32(payloadType.clockrate)
+            || !reader.readUInt32(payloadType.channels)
+            || !reader.readCount(feedbackTypeCount)) {
+            return absl::nullopt;
+        }
+        payloadType.feedbackTypes.resize(feedbackTypeCount);
+        for (auto &feedbackType : payloadType.feedbackTypes) {
+            if (!reader.readString(feedbackType.type) || !reader.readString(feedbackType.subtype)) {
+                return absl::nullopt;
+            }
+        }
+        size_t parameterCount = 0;
+        if (!reader.readCount(parameterCount)) {
+            return absl::nullopt;
+        }
+        payloadType.parameters.resize(parameterCount);
+        for (auto &parameter : payloadType.parameters) {
+            if (!reader.readString(parameter.first) || !reader.readString(parameter.second)) {
+                return absl::nullopt;
+            }
+        }
+    }
+
+    if (!reader.readCount(count)) {
+        return absl::nullopt;
+    }
+    result.rtpExtensions.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t id = 0;
+        std::string uri;
+        if (!reader.readUInt32(id) || !reader.readString(uri)) {
+            return absl::nullopt;
+        }
+        result.rtpExtensions.emplace_back(uri, (int)id);
+    }
+
+    return result;
+}
+
+std::vector<uint8_t> InitialSetupMessage_serializeBinary(const InitialSetupMessage * const message) {
+    BinaryWriter writer(BinaryMessageType::InitialSetup);
+
+    writer.writeString(message->ufrag);
+    writer.writeString(message->pwd);
+
+    writer.writeVarint(message->fingerprints.size());
+    for (const auto &fingerprint : message->fingerprints) {
+        writer.writeString(fingerprint.hash);
+        writer.writeString(fingerprint.setup);
+        writer.writeString(fingerprint.fingerprint);
+    }
+
+    uint8_t flags = 0;
+    flags |= message->audio ? (1 << 0) : 0;
+    flags |= message->video ? (1 << 1) : 0;
+    flags |= message->screencast ? (1 << 2) : 0;
+    flags |= message->supportsBinarySignaling ? (1 << 3) : 0;
+    writer.writeByte(flags);
+
+    if (message->audio) {
+        MediaContent_writeBinary(writer, message->audio.value());
+    }
+    if (message->video) {
+        MediaContent_writeBinary(writer, message->video.value());
+    }
+    if (message->screencast) {
+        MediaContent_writeBinary(writer, message->screencast.value());
+    }
+
+    return writer.takeData();
+}
+
+absl::optional<InitialSetupMessage> InitialSetupMessage_parseBinary(BinaryReader &reader) {
+    InitialSetupMessage message;
+
+    size_t fingerprintCount = 0;
+    if (!reader.readString(message.ufrag)
+        || !reader.readString(message.pwd)
+        || !reader.readCount(fingerprintCount)) {
+        return absl::nullopt;
+    }
+    message.fingerprints.resize(fingerprintCount);
+    for (auto &fingerprint : message.fingerprints) {
+        if (!reader.readString(fingerprint.hash)
+            || !reader.readString(fingerprint.setup)
+            || !reader.readString(fingerprint.fingerprint)) {
+            return absl::nullopt;
+        }
+    }
+
+    uint8_t flags = 0;
+    if (!reader.readByte(flags)) {
+        return absl::nullopt;
+    }
+    message.supportsBinarySignaling = (flags & (1 << 3)) != 0;
+
+    if (flags & (1 << 0)) {
+        message.audio = MediaContent_readBinary(reader);
+        if (!message.audio) {
+            return absl::nullopt;
+        }
+    }
+    if (flags & (1 << 1)) {
+        message.video = MediaContent_readBinary(reader);
+        if (!message.video) {
+            return absl::nullopt;
+        }
+    }
+    if (flags & (1 << 2)) {
+        message.screencast = MediaContent_readBinary(reader);
+        if (!message.screencast) {
+            return absl::nullopt;
+        }
+    }
+
+    return message;
+}
+
+std::vector<uint8_t> CandidatesMessage_serializeBinary(const CandidatesMessage * const message) {
+    BinaryWriter writer(BinaryMessageType::Candidates);
+
+    writer.writeVarint(message->iceCandidates.size());
+    for (const auto &candidate : message->iceCandidates) {
+        writer.writeString(candidate.sdpString);
+    }
+
+    return writer.takeData();
+}
+
+absl::optional<CandidatesMessage> CandidatesMessage_parseBinary(BinaryReader &reader) {
+    CandidatesMessage message;
+
+    size_t count = 0;
+    if (!reader.readCount(count)) {
+        return absl::nullopt;
+    }
+    message.iceCandidates.resize(count);
+    for (auto &candidate : message.iceCandidates) {
+        if (!reader.readString(candidate.sdpString)) {
+            return absl::nullopt;
+        }
+    }
+
+    return message;
+}
+
+std::vector<uint8_t> MediaStateMessage_serializeBinary(const MediaStateMessage * const message) {
+    BinaryWriter writer(BinaryMessageType::MediaState);
+
+    uint8_t flags = 0;
+    flags |= message->isMuted ? (1 << 0) : 0;
+    flags |= message->isBatteryLow ? (1 << 1) : 0;
+    writer.writeByte(flags);
+    writer.writeByte((uint8_t)message->videoState);
+    writer.writeByte((uint8_t)message->videoRotation);
+    writer.writeByte((uint8_t)message->screencastState);
+
+    return writer.takeData();
+}
+
+absl::optional<MediaStateMessage> MediaStateMessage_parseBinary(BinaryReader &reader) {
+    MediaStateMessage message;
+
+    uint8_t flags = 0;
+    uint8_t videoState = 0;
+    uint8_t videoRotation = 0;
+    uint8_t screencastState = 0;
+    if (!reader.readByte(flags)
+        || !reader.readByte(videoState)
+        || !reader.readByte(videoRotation)
+        || !reader.readByte(screencastState)) {
+        return absl::nullopt;
+    }
+    if (videoState > (uint8_t)MediaStateMessage::VideoState::Active
+        || videoRotation > (uint8_t)MediaStateMessage::VideoRotation::Rotation270
+        || screencastState > (uint8_t)MediaStateMessage::VideoState::Active) {
+        return absl::nullopt;
+    }
+    message.isMuted = (flags & (1 << 0)) != 0;
+    message.isBatteryLow = (flags & (1 << 1)) != 0;
+    message.videoState = (MediaStateMessage::VideoState)videoState;
+    message.videoRotation = (MediaStateMessage::VideoRotation)videoRotation;
+    message.screencastState = (MediaStateMessage::VideoState)screencastState;
+
+    return message;
+}
+
+template <typename T>
+absl::optional<Message> wrapParsedMessage(absl::optional<T> &&parsed) {
+    if (!parsed) {
+        return absl::nullopt;
+    }
+    Message message;
+    message.data = std::move(parsed.value());
+    return message;
+}
+
+absl::optional<Message> parseBinaryMessage(const std::vector<uint8_t> &data) {
+    BinaryReader reader(data.data(), data.size());
+
+    uint8_t magic = 0;
+    uint8_t version = 0;
+    uint8_t type = 0;
+    if (!reader.readByte(magic) || !reader.readByte(version) || !reader.readByte(type)) {
+        return absl::nullopt;
+    }
+    if (magic != kBinaryMagic || version != kBinaryVersion) {
+        return absl::nullopt;
+    }
+
+    switch ((BinaryMessageType)type) {
+        case BinaryMessageType::InitialSetup: {
+            return wrapParsedMessage(InitialSetupMessage_parseBinary(reader));
+        }
+        case BinaryMessageType::Candidates: {
+            return wrapParsedMessage(CandidatesMessage_parseBinary(reader));
+        }
+        case BinaryMessageType::MediaState: {
+            return wrapParsedMessage(MediaStateMessage_parseBinary(reader));
+        }
+        default: {
+            return absl::nullopt;
+        }
+    }
+}
+
 std::vector<uint8_t> Message::serialize() const {
     if (const auto initialSetup = absl::get_if<InitialSetupMessage>(&data)) {
         return InitialSetupMessage_serialize(initialSetup);
@@ -657,7 +1075,28 @@ std::vector<uint8_t> Message::serialize() const {
     }
 }
 
+std::vector<uint8_t> Message::serializeBinary() const {
+    if (const auto initialSetup = absl::get_if<InitialSetupMessage>(&data)) {
+        return InitialSetupMessage_serializeBinary(initialSetup);
+    } else if (const auto candidates = absl::get_if<CandidatesMessage>(&data)) {
+        return CandidatesMessage_serializeBinary(candidates);
+    } else if (const auto mediaState = absl::get_if<MediaStateMessage>(&data)) {
+        return MediaStateMessage_serializeBinary(mediaState);
+    } else {
+        return {};
+    }
+}
+
+bool Message::isBinary(const std::vector<uint8_t> &data) {
+    // JSON payloads always start with '{'.
+    return !data.empty() && data[0] == kBinaryMagic;
+}
+
 absl::optional<Message> Message::parse(const std::vector<uint8_t> &data) {
+    if (isBinary(data)) {
+        return parseBinaryMessage(data);
+    }
+
     std::string parsingError;
     auto json = json11::Json::parse(std::string(data.begin(), data.end()), parsingError);
     if (json.type() != json11::Json::OBJECT) {
@@ -60,6 +60,8 @@ struct InitialSetupMessage {
     absl::optional<MediaContent> audio;
     absl::optional<MediaContent> video;
     absl::optional<MediaContent> screencast;
+    // Lets the peer switch to the binary encoding for the rest of the call.
+    bool supportsBinarySignaling = false;
 };
 
 struct CandidatesMessage {
@@ -95,7 +97,11 @@ struct Message {
         MediaStateMessage> data;
 
     std::vector<uint8_t> serialize() const;
+    // Compact versioned encoding, only for peers that announced support for it.
+    std::vector<uint8_t> serializeBinary() const;
+    // Accepts both encodings.
     static absl::optional<Message> parse(const std::vector<uint8_t> &data);
+    static bool isBinary(const std::vector<uint8_t> &data);
 };
 
 };